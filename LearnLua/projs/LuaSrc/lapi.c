@@ -20,6 +20,8 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "lgcfree.h"
+#include "lgcpar.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -451,8 +453,10 @@ LUA_API int lua_toboolean (lua_State *L, int idx) {
  * 如果idx索引处的元素是字符串,则返回其保存的字符串首地址(Char*),*len=字符串长度,
  * 如果idx索引处的元素是数字(integer或float),则将其转为字符串,新建TString,并更新idx索引处的元素为TString,并返回其保存的字符串首地址(Char*),*len=字符串长度,
  * 如果是其他类型,返回null, *len=0
+** (The contents of a view have no ending zero; 'lua_tolstring' below
+** adds one.)
  */
-LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
+LUA_API const char *lua_tolstringview (lua_State *L, int idx, size_t *len) {
   StkId o = index2addr(L, idx);
   if (!ttisstring(o)) {
     //不是数字(integer或float)
@@ -472,6 +476,24 @@ LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
   return svalue(o);
 }
 
+
+/*
+** Contents of the string (or number) at 'idx', with an ending zero.
+** A view gets a copy of its contents on the first call, so, as with
+** numbers, this may allocate memory and run a GC step;
+** 'lua_tolstringview' never allocates for strings.
+*/
+LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
+  const char *s = lua_tolstringview(L, idx, len);
+  if (s != NULL && isstrview(tsvalue(index2addr(L, idx)))) {
+    lua_lock(L);
+    s = luaS_materialize(L, tsvalue(index2addr(L, idx)));
+    luaC_checkGC(L);
+    lua_unlock(L);
+  }
+  return s;
+}
+
 /*
  * 简单的len操作,不涉及元方法,
  */
@@ -592,6 +614,28 @@ LUA_API const char *lua_pushlstring (lua_State *L, const char *s, size_t len) {
   return getstr(ts);
 }
 
+/*
+** Pushes the 'l' bytes at offset 'i' of the string at 'idx'. A long
+** result shares the memory of that string (see 'luaS_newsubstr'), so
+** the returned contents have no ending zero; 'lua_tolstring' gives it.
+*/
+LUA_API const char *lua_pushsubstring (lua_State *L, int idx, size_t i,
+                                                              size_t l) {
+  TString *ts;
+  StkId o;
+  lua_lock(L);
+  o = index2addr(L, idx);
+  api_check(L, ttisstring(o), "string expected");
+  api_check(L, i <= vslen(o) && l <= vslen(o) - i, "invalid substring");
+  ts = luaS_newsubstr(L, tsvalue(o), i, l);
+  setsvalue2s(L, L->top, ts);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return getstr(ts);
+}
+
+
 /*
  * 使用字符串s(len可以为0) 新建一个TString并push到栈中, 返回保存在TString中的字符串首字符地址,
  * 如果s为null,则push一个nil到栈中,
@@ -1025,6 +1069,19 @@ LUA_API void lua_rawsetp (lua_State *L, int idx, const void *p) {
   lua_unlock(L);
 }
 
+/*
+** Removes all entries of the table at 'idx', keeping its memory for
+** new entries. Does not call metamethods.
+*/
+LUA_API void lua_cleartable (lua_State *L, int idx) {
+  StkId o;
+  lua_lock(L);
+  o = index2addr(L, idx);
+  api_check(L, ttistable(o), "table expected");
+  luaH_clear(L, hvalue(o));
+  lua_unlock(L);
+}
+
 /*
  *赋值 val(objindex).metatable = metatable
  执行前的栈: [metatable][top]
@@ -1279,6 +1336,24 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
         res = 1;  /* signal it */
       break;
     }
+    case LUA_GCSTEPUS: {
+      res = luaC_steptime(L, data);
+      break;
+    }
+    case LUA_GCPARMARK: {
+      res = luaC_setparmark(L, data);
+      break;
+    }
+    case LUA_GCBGSWEEP: {
+      res = luaC_setbgsweep(L, data);
+      break;
+    }
+    case LUA_GCLIMIT: {  /* limit in Kbytes; a negative 'data' only gets it */
+      res = cast_int(g->memlimit >> 10);
+      if (data >= 0)
+        g->memlimit = cast(lu_mem, data) << 10;
+      break;
+    }
     case LUA_GCSETPAUSE: {
       res = g->gcpause;
       g->gcpause = data;
@@ -1294,6 +1369,18 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       res = g->gcrunning;
       break;
     }
+    case LUA_GCGEN: {
+      res = (g->gckind == KGC_GEN) ? LUA_GCGEN : LUA_GCINC;
+      if (data != 0)
+        g->genminormul = cast_byte(data < 100 ? data : 100);
+      luaC_changemode(L, KGC_GEN);
+      break;
+    }
+    case LUA_GCINC: {
+      res = (g->gckind == KGC_GEN) ? LUA_GCGEN : LUA_GCINC;
+      luaC_changemode(L, KGC_NORMAL);
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
@@ -1380,6 +1467,21 @@ LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud) {
 }
 
 
+/*
+** Set the maximum number of bytes the state may use (0 for no limit);
+** returns the previous limit. Allocations that would cross it run an
+** emergency collection and, if that is not enough, raise a memory error.
+*/
+LUA_API size_t lua_setmemlimit (lua_State *L, size_t limit) {
+  size_t old;
+  lua_lock(L);
+  old = G(L)->memlimit;
+  G(L)->memlimit = limit;
+  lua_unlock(L);
+  return old;
+}
+
+
 LUA_API void *lua_newuserdata (lua_State *L, size_t size) {
   Udata *u;
   lua_lock(L);
@@ -558,7 +558,7 @@ LUALIB_API void luaL_pushresultsize (luaL_Buffer *B, size_t sz) {
 LUALIB_API void luaL_addvalue (luaL_Buffer *B) {
   lua_State *L = B->L;
   size_t l;
-  const char *s = lua_tolstring(L, -1, &l);
+  const char *s = lua_tolstringview(L, -1, &l);  /* (no ending zero needed) */
   if (buffonstack(B))
     lua_insert(L, -2);  /* put value below buffer */
   luaL_addlstring(B, s, l);
@@ -1040,6 +1040,232 @@ LUALIB_API lua_State *luaL_newstate (void) {
 }
 
 
+/*
+** {======================================================
+** Pooled allocator
+** =======================================================
+*/
+
+/* size classes are multiples of POOLGRAIN up to POOLMAX */
+#define POOLGRAIN	16
+#define POOLMAX		512
+#define POOLCLASSES	(POOLMAX / POOLGRAIN)
+
+/* size of each slab */
+#define POOLSLAB	(64 * 1024)
+
+#define poolclass(sz)	(((sz) - 1) / POOLGRAIN)
+#define classsize(c)	((size_t)((c) + 1) * POOLGRAIN)
+
+
+typedef union PoolBlock {
+  union PoolBlock *next;  /* next free block of the same class */
+  char pad[POOLGRAIN];
+} PoolBlock;
+
+
+typedef union PoolSlab {
+  union PoolSlab *next;  /* list of all slabs */
+  char pad[POOLGRAIN];  /* keep blocks aligned */
+} PoolSlab;
+
+
+typedef struct Pool {
+  PoolBlock *freeblocks[POOLCLASSES];  /* free blocks of each class */
+  PoolSlab *slabs;
+  char *avail;  /* unused space at the end of the current slab */
+  size_t navail;
+  size_t nblocks;  /* number of live blocks (small and large) */
+  int owned;  /* pool belongs to a state (and dies with its last block) */
+  luaL_PoolStats st;
+} Pool;
+
+
+static void poolput (Pool *p, void *block, size_t size) {
+  int c = poolclass(size);
+  PoolBlock *b = (PoolBlock *)block;
+  b->next = p->freeblocks[c];
+  p->freeblocks[c] = b;
+}
+
+
+/* start a new slab; what is left of the current one becomes a free block */
+static int newslab (Pool *p) {
+  PoolSlab *s = (PoolSlab *)malloc(POOLSLAB);
+  if (s == NULL)
+    return 0;
+  if (p->navail > 0)  /* (already counted as free) */
+    poolput(p, p->avail, p->navail);
+  s->next = p->slabs;
+  p->slabs = s;
+  p->avail = (char *)(s + 1);
+  p->navail = POOLSLAB - sizeof(PoolSlab);
+  p->st.slabs += p->navail;
+  p->st.free += p->navail;
+  return 1;
+}
+
+
+static void *poolnew (Pool *p, size_t size) {
+  if (size > POOLMAX) {
+    void *block = malloc(size);
+    if (block != NULL)
+      p->st.large += size;
+    return block;
+  }
+  else {
+    int c = poolclass(size);
+    size_t bsize = classsize(c);
+    PoolBlock *b = p->freeblocks[c];
+    if (b != NULL)
+      p->freeblocks[c] = b->next;
+    else {
+      if (p->navail < bsize && !newslab(p))
+        return NULL;
+      b = (PoolBlock *)p->avail;
+      p->avail += bsize;
+      p->navail -= bsize;
+    }
+    p->st.free -= bsize;
+    p->st.pooled += bsize;
+    p->st.used += size;
+    return b;
+  }
+}
+
+
+static void pooldel (Pool *p, void *block, size_t size) {
+  if (size > POOLMAX) {
+    free(block);
+    p->st.large -= size;
+  }
+  else {
+    size_t bsize = classsize(poolclass(size));
+    poolput(p, block, size);
+    p->st.free += bsize;
+    p->st.pooled -= bsize;
+    p->st.used -= size;
+  }
+}
+
+
+/*
+** Turn large block 'ptr' into a slab holding just one block of size
+** 'nsize', with its contents (used when shrinking it to a small size
+** finds no memory for a new small block). The slab is freed with the
+** others; the block is pooled like any other from now on.
+*/
+static void *pooladopt (Pool *p, void *ptr, size_t osize, size_t nsize) {
+  size_t bsize = classsize(poolclass(nsize));
+  size_t ssize = sizeof(PoolSlab) + bsize;
+  PoolSlab *s = (PoolSlab *)realloc(ptr, ssize);
+  if (s == NULL) {
+    if (osize < ssize)  /* had to grow? */
+      return NULL;
+    s = (PoolSlab *)ptr;  /* a shrinking 'realloc' failed; keep it all */
+  }
+  memmove(s + 1, s, nsize);
+  s->next = p->slabs;
+  p->slabs = s;
+  p->st.large -= osize;
+  p->st.slabs += bsize;
+  p->st.pooled += bsize;
+  p->st.used += nsize;
+  return s + 1;
+}
+
+
+static void pooldestroy (Pool *p) {
+  while (p->slabs != NULL) {
+    PoolSlab *s = p->slabs;
+    p->slabs = s->next;
+    free(s);
+  }
+  free(p);
+}
+
+
+static void *pool_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  Pool *p = (Pool *)ud;
+  void *nptr;
+  if (ptr == NULL)
+    osize = 0;  /* 'osize' is only a type tag */
+  if (nsize == 0) {
+    if (ptr != NULL) {
+      pooldel(p, ptr, osize);
+      if (--p->nblocks == 0 && p->owned)  /* state was closed? */
+        pooldestroy(p);
+    }
+    return NULL;
+  }
+  if (osize > POOLMAX && nsize > POOLMAX) {  /* large to large? */
+    nptr = realloc(ptr, nsize);
+    if (nptr != NULL)
+      p->st.large = p->st.large - osize + nsize;
+    return nptr;
+  }
+  if (osize > 0 && osize <= POOLMAX && nsize <= POOLMAX &&
+      poolclass(osize) == poolclass(nsize)) {  /* same class? */
+    p->st.used = p->st.used - osize + nsize;
+    return ptr;
+  }
+  nptr = poolnew(p, nsize);
+  if (nptr == NULL) {  /* shrinking should not fail */
+    if (osize > POOLMAX && nsize <= POOLMAX)  /* large to small? */
+      return pooladopt(p, ptr, osize, nsize);
+    else if (nsize < osize) {
+      /* small to smaller: keep the block as a (too large) block of the
+         new size; its extra bytes are lost for the pool */
+      size_t nbsize = classsize(poolclass(nsize));
+      size_t obsize = classsize(poolclass(osize));
+      p->st.slabs = p->st.slabs - obsize + nbsize;
+      p->st.pooled = p->st.pooled - obsize + nbsize;
+      p->st.used = p->st.used - osize + nsize;
+      return ptr;
+    }
+    return NULL;
+  }
+  if (ptr != NULL) {
+    memcpy(nptr, ptr, (osize < nsize) ? osize : nsize);
+    pooldel(p, ptr, osize);
+  }
+  else
+    p->nblocks++;
+  return nptr;
+}
+
+
+LUALIB_API lua_State *luaL_newstate_pooled (void) {
+  lua_State *L;
+  Pool *p = (Pool *)calloc(1, sizeof(Pool));
+  if (p == NULL)
+    return NULL;
+  L = lua_newstate(pool_alloc, p);
+  if (L == NULL) {  /* all its blocks were already freed */
+    pooldestroy(p);
+    return NULL;
+  }
+  p->owned = 1;  /* now 'lua_close' will free the pool */
+  lua_atpanic(L, &panic);
+  return L;
+}
+
+
+/*
+** Gets the statistics of a pooled state; returns false if 'L' does not
+** use the pooled allocator. Fragmentation is '1 - used / slabs'.
+*/
+LUALIB_API int luaL_poolstats (lua_State *L, luaL_PoolStats *st) {
+  void *ud;
+  if (lua_getallocf(L, &ud) != pool_alloc)
+    return 0;
+  *st = ((Pool *)ud)->st;
+  return 1;
+}
+
+/* }====================================================== */
+
+
 LUALIB_API void luaL_checkversion_ (lua_State *L, lua_Number ver, size_t sz) {
   const lua_Number *v = lua_version(L);
   if (sz != LUAL_NUMSIZES)  /* check numeric types */
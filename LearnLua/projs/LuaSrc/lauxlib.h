@@ -180,6 +180,34 @@ LUALIB_API char *(luaL_buffinitsize) (lua_State *L, luaL_Buffer *B, size_t sz);
 
 
 
+/*
+** {======================================================
+** Pooled allocator
+** =======================================================
+*/
+
+/*
+** 'luaL_newstate_pooled' creates a state whose small blocks come from
+** size-class slabs owned by the state; they are given back to 'malloc'
+** only when the state is closed. The allocator is not thread safe (so
+** it cannot be used with LUA_GCBGSWEEP).
+*/
+
+typedef struct luaL_PoolStats {
+  size_t used;  /* bytes requested by live small blocks */
+  size_t pooled;  /* bytes in live small blocks (after rounding) */
+  size_t free;  /* bytes in slabs not in use */
+  size_t slabs;  /* bytes in slabs (pooled + free) */
+  size_t large;  /* bytes in large blocks (from 'malloc') */
+} luaL_PoolStats;
+
+LUALIB_API lua_State *(luaL_newstate_pooled) (void);
+LUALIB_API int (luaL_poolstats) (lua_State *L, luaL_PoolStats *st);
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** File handles for IO library
@@ -1201,3 +1201,50 @@ void luaK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+
+/*
+** can an equality test against constant 'k' be done without metamethods
+** and coercions? (see OP_EQK)
+*/
+#define israwk(k)	(ttisnil(k) || ttisboolean(k) || ttisshrstring(k))
+
+
+/*
+** Peephole pass over the final code of a function: rewrite frequent
+** pairs of instructions into superinstructions (see lopcodes.h). The
+** second instruction of each pair is left unchanged, so jumps into it,
+** line information and dumps (which undo the rewrite) are not affected.
+*/
+void luaK_fuse (Proto *f) {
+  int pc;
+  for (pc = 0; pc < f->sizecode - 1; pc++) {
+    Instruction *i = &f->code[pc];
+    Instruction next = f->code[pc + 1];
+    switch (GET_OPCODE(*i)) {
+      case OP_EQ: {
+        int c = GETARG_C(*i);
+        if (ISK(c) && israwk(&f->k[INDEXK(c)]))
+          SET_OPCODE(*i, OP_EQK);
+        break;
+      }
+      case OP_LOADK: {
+        if (GET_OPCODE(next) == OP_LOADK) {
+          SET_OPCODE(*i, OP_LOADK2);
+          pc++;  /* next instruction cannot start another pair */
+        }
+        break;
+      }
+      case OP_GETTABUP: case OP_GETTABLE: {
+        if (GET_OPCODE(next) == OP_GETTABLE &&
+            GETARG_B(next) == GETARG_A(*i)) {
+          SET_OPCODE(*i, (GET_OPCODE(*i) == OP_GETTABUP) ? OP_GETTABUP2
+                                                         : OP_GETTABLE2);
+          pc++;  /* next instruction cannot start another pair */
+        }
+        break;
+      }
+      default: break;
+    }
+  }
+}
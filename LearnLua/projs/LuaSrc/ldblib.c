@@ -298,6 +298,65 @@ static int db_upvaluejoin (lua_State *L) {
 }
 
 
+static int db_gettraces (lua_State *L) {
+  if (lua_isnoneornil(L, 1))
+    lua_pushnil(L);  /* traces of all functions */
+  else {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_pushvalue(L, 1);
+  }
+  lua_gettraces(L);
+  return 1;
+}
+
+
+static int writer (lua_State *L, const void *b, size_t size, void *f) {
+  (void)L;
+  return (fwrite(b, size, 1, (FILE *)f) != 1);
+}
+
+
+static int db_heapsnapshot (lua_State *L) {
+  const char *fname = luaL_checkstring(L, 1);
+  FILE *f = fopen(fname, "wb");
+  int ok;
+  if (f == NULL)
+    return luaL_fileresult(L, 0, fname);
+  ok = (lua_heapsnapshot(L, writer, f) == 0);
+  ok = (fclose(f) == 0) && ok;
+  return luaL_fileresult(L, ok, fname);
+}
+
+
+static int db_allocsampling (lua_State *L) {
+  size_t old;
+  if (lua_isnoneornil(L, 1)) {  /* only query the rate? */
+    old = lua_setallocsampling(L, 0);
+    lua_setallocsampling(L, old);
+  }
+  else {
+    lua_Integer rate = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, rate >= 0, 1, "negative rate");
+    old = lua_setallocsampling(L, (size_t)rate);
+  }
+  lua_pushinteger(L, (lua_Integer)old);
+  return 1;
+}
+
+
+static int db_allocsamples (lua_State *L) {
+  const char *fname = luaL_checkstring(L, 1);
+  int reset = lua_toboolean(L, 2);
+  FILE *f = fopen(fname, "w");
+  int ok;
+  if (f == NULL)
+    return luaL_fileresult(L, 0, fname);
+  ok = (lua_dumpallocsamples(L, writer, f, reset) == 0);
+  ok = (fclose(f) == 0) && ok;
+  return luaL_fileresult(L, ok, fname);
+}
+
+
 /*
 ** Call hook function registered at hook table for the current
 ** thread (if there is one)
@@ -437,6 +496,10 @@ static const luaL_Reg dblib[] = {
   {"getregistry", db_getregistry},
   {"getmetatable", db_getmetatable},
   {"getupvalue", db_getupvalue},
+  {"gettraces", db_gettraces},
+  {"heapsnapshot", db_heapsnapshot},
+  {"allocsampling", db_allocsampling},
+  {"allocsamples", db_allocsamples},
   {"upvaluejoin", db_upvaluejoin},
   {"upvalueid", db_upvalueid},
   {"setuservalue", db_setuservalue},
@@ -12,6 +12,7 @@
 
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "lua.h"
@@ -27,6 +28,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "ltrace.h"
 #include "lvm.h"
 
 
@@ -88,7 +90,7 @@ LUA_API void lua_sethook (lua_State *L, lua_Hook func, int mask, int count) {
   L->hook = func;
   L->basehookcount = count;
   resethookcount(L);
-  L->hookmask = cast_byte(mask);
+  L->hookmask = cast_byte(mask | (L->hookmask & MASKREC));
 }
 
 
@@ -98,7 +100,7 @@ LUA_API lua_Hook lua_gethook (lua_State *L) {
 
 
 LUA_API int lua_gethookmask (lua_State *L) {
-  return L->hookmask;
+  return L->hookmask & ~MASKREC;
 }
 
 
@@ -388,7 +390,7 @@ static int findsetreg (Proto *p, int lastpc, int reg) {
   int jmptarget = 0;  /* any code before this address is conditional */
   for (pc = 0; pc < lastpc; pc++) {
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = luaP_generic(GET_OPCODE(i));
     int a = GETARG_A(i);
     switch (op) {
       case OP_LOADNIL: {
@@ -438,7 +440,7 @@ static const char *getobjname (Proto *p, int lastpc, int reg,
   pc = findsetreg(p, lastpc, reg);
   if (pc != -1) {  /* could find instruction? */
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = luaP_generic(GET_OPCODE(i));
     switch (op) {
       case OP_MOVE: {
         int b = GETARG_B(i);  /* move from 'b' to 'a' */
@@ -494,11 +496,12 @@ static const char *funcnamefromcode (lua_State *L, CallInfo *ci,
   Proto *p = ci_func(ci)->p;  /* calling function */
   int pc = currentpc(ci);  /* calling instruction index */
   Instruction i = p->code[pc];  /* calling instruction */
+  OpCode op = luaP_generic(GET_OPCODE(i));
   if (ci->callstatus & CIST_HOOKED) {  /* was it called inside a hook? */
     *name = "?";
     return "hook";
   }
-  switch (GET_OPCODE(i)) {
+  switch (op) {
     case OP_CALL:
     case OP_TAILCALL:
       return getobjname(p, pc, GETARG_A(i), name);  /* get function name */
@@ -516,7 +519,7 @@ static const char *funcnamefromcode (lua_State *L, CallInfo *ci,
     case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
     case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND:
     case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR: {
-      int offset = cast_int(GET_OPCODE(i)) - cast_int(OP_ADD);  /* ORDER OP */
+      int offset = cast_int(op) - cast_int(OP_ADD);  /* ORDER OP */
       tm = cast(TMS, offset + cast_int(TM_ADD));  /* ORDER TM */
       break;
     }
@@ -537,6 +540,48 @@ static const char *funcnamefromcode (lua_State *L, CallInfo *ci,
 /* }====================================================== */
 
 
+static void addframestr (char *buff, size_t size, size_t *n, const char *s) {
+  while (*s != '\0' && *n < size) {
+    char c = *s++;
+    buff[(*n)++] = (c == ';') ? ',' : c;  /* ';' separates frames */
+  }
+}
+
+
+/*
+** Writes "name@source:line" for the function running in 'ci' into
+** 'buff' (at most 'size' bytes, not zero terminated) and returns its
+** length. Used by the allocation profiler, so it cannot allocate
+** memory or raise errors.
+*/
+size_t luaG_framename (lua_State *L, CallInfo *ci, char *buff, size_t size) {
+  Closure *cl = ttisclosure(ci->func) ? clvalue(ci->func) : NULL;
+  const char *name = NULL;
+  size_t n = 0;
+  if (getfuncname(L, ci, &name) == NULL) {
+    if (!noLuaClosure(cl) && cl->l.p->linedefined == 0)
+      name = "main chunk";
+    else
+      name = "?";
+  }
+  addframestr(buff, size, &n, name);
+  if (noLuaClosure(cl))
+    addframestr(buff, size, &n, "@[C]");
+  else {
+    Proto *p = cl->l.p;
+    char src[LUA_IDSIZE];
+    char line[LUAI_MAXSHORTLEN];
+    int pc = currentpc(ci);
+    luaO_chunkid(src, p->source ? getstr(p->source) : "=?", LUA_IDSIZE);
+    l_sprintf(line, sizeof(line), ":%d", getfuncline(p, (pc < 0) ? 0 : pc));
+    addframestr(buff, size, &n, "@");
+    addframestr(buff, size, &n, src);
+    addframestr(buff, size, &n, line);
+  }
+  return n;
+}
+
+
 
 /*
 ** The subtraction of two potentially unrelated pointers is
@@ -665,7 +710,10 @@ l_noret luaG_runerror (lua_State *L, const char *fmt, ...) {
 void luaG_traceexec (lua_State *L) {
   CallInfo *ci = L->ci;
   lu_byte mask = L->hookmask;
-  int counthook = (--L->hookcount == 0 && (mask & LUA_MASKCOUNT));
+  int counthook;
+  if (mask & MASKREC)  /* recording a hot loop? */
+    luaR_record(L);
+  counthook = (--L->hookcount == 0 && (mask & LUA_MASKCOUNT));
   if (counthook)
     resethookcount(L);  /* reset count */
   else if (!(mask & LUA_MASKLINE))
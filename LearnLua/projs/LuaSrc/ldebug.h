@@ -34,6 +34,8 @@ LUAI_FUNC const char *luaG_addinfo (lua_State *L, const char *msg,
                                                   TString *src, int line);
 LUAI_FUNC l_noret luaG_errormsg (lua_State *L);
 LUAI_FUNC void luaG_traceexec (lua_State *L);
+LUAI_FUNC size_t luaG_framename (lua_State *L, CallInfo *ci, char *buff,
+                                                             size_t size);
 
 
 #endif
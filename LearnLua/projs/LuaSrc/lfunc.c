@@ -16,9 +16,11 @@
 
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
+#include "ltrace.h"
 
 
 /*新建CClosure,n为 upvalue个数*/
@@ -105,6 +107,9 @@ Proto *luaF_newproto (lua_State *L) {
   f->sizep = 0;
   f->code = NULL;
   f->cache = NULL;
+  f->ic = NULL;
+  f->jit = NULL;
+  f->ncalls = 0;
   f->sizecode = 0;
   f->lineinfo = NULL;
   f->sizelineinfo = 0;
@@ -113,6 +118,7 @@ Proto *luaF_newproto (lua_State *L) {
   f->numparams = 0;
   f->is_vararg = 0;
   f->maxstacksize = 0;
+  f->traced = 0;
   f->locvars = NULL;
   f->sizelocvars = 0;
   f->linedefined = 0;
@@ -122,7 +128,27 @@ Proto *luaF_newproto (lua_State *L) {
 }
 
 
+/*
+** Create the inline-cache slots of a prototype, once its code is
+** complete. Slots are indexed by 'pc'; only field-access instructions
+** (OP_GETTABUP, OP_GETTABLE and OP_SELF) use them.
+*/
+void luaF_initcache (lua_State *L, Proto *f) {
+  int i;
+  lua_assert(f->ic == NULL);
+  f->ic = luaM_newvector(L, f->sizecode, FieldCache);
+  for (i = 0; i < f->sizecode; i++)
+    f->ic[i].idx = 0;
+}
+
+
 void luaF_freeproto (lua_State *L, Proto *f) {
+  if (f->jit != NULL)
+    luaJ_free(L, f);
+  if (f->traced)
+    luaR_freeproto(L, f);
+  if (f->ic != NULL)
+    luaM_freearray(L, f->ic, f->sizecode);
   luaM_freearray(L, f->code, f->sizecode);
   luaM_freearray(L, f->p, f->sizep);
   luaM_freearray(L, f->k, f->sizek);
@@ -11,6 +11,7 @@
 
 
 #include <string.h>
+#include <time.h>
 
 #include "lua.h"
 
@@ -18,6 +19,8 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "lgcfree.h"
+#include "lgcpar.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -44,6 +47,9 @@
 /* cost of calling one finalizer */
 #define GCFINALIZECOST	GCSWEEPCOST
 
+/* maximum number of slots of a table to traverse in a single step */
+#define GCTRAVMAX	1024
+
 
 /*
 ** macro to adjust 'stepmul': 'stepmul' is actually used like
@@ -59,6 +65,13 @@
 #define PAUSEADJ		100
 
 
+/*
+** with a memory limit, collections start when memory use reaches 7/8
+** of it, whatever the pause
+*/
+#define limitthreshold(g)	cast(l_mem, (g)->memlimit - (g)->memlimit / 8)
+
+
 /*
 ** 'makewhite' erases all color bits then sets only the current white
 ** bit
@@ -70,6 +83,9 @@
 #define white2gray(x)	resetbits(x->marked, WHITEBITS)
 #define black2gray(x)	resetbit(x->marked, BLACKBIT)
 
+/* mask to erase all color and age bits */
+#define maskgcbits	(maskcolors & ~AGEBITS)
+
 
 #define valiswhite(x)   (iscollectable(x) && iswhite(gcvalue(x)))
 
@@ -113,6 +129,19 @@ static void reallymarkobject (global_State *g, GCObject *o);
 #define linkgclist(o,p)	((o)->gclist = (p), (p) = obj2gco(o))
 
 
+/* get the 'gclist' field of an object that may be in a gray list */
+static GCObject **getgclist (GCObject *o) {
+  switch (o->tt) {
+    case LUA_TTABLE: return &gco2t(o)->gclist;
+    case LUA_TLCL: return &gco2lcl(o)->gclist;
+    case LUA_TCCL: return &gco2ccl(o)->gclist;
+    case LUA_TTHREAD: return &gco2th(o)->gclist;
+    case LUA_TPROTO: return &gco2p(o)->gclist;
+    default: lua_assert(0); return NULL;
+  }
+}
+
+
 /*
 ** If key is not marked, mark its entry as dead. This allows key to be
 ** collected, but keeps its entry in the table.  A dead node is needed
@@ -155,8 +184,13 @@ static int iscleared (global_State *g, const TValue *o) {
 void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v) {
   global_State *g = G(L);
   lua_assert(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o));
-  if (keepinvariant(g))  /* must keep invariant? */
+  if (keepinvariant(g)) {  /* must keep invariant? */
     reallymarkobject(g, v);  /* restore invariant */
+    if (isold(o)) {
+      lua_assert(!isold(v));  /* white object could not be old */
+      setage(v, G_OLD0);  /* restore generational invariant */
+    }
+  }
   else {  /* sweep phase */
     lua_assert(issweepphase(g));
     makewhite(g, o);  /* mark main obj. as white to avoid other barriers */
@@ -166,13 +200,19 @@ void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v) {
 
 /*
 ** barrier that moves collector backward, that is, mark the black object
-** pointing to a white object as gray again.
+** pointing to a white object as gray again. (A table touched in the
+** previous generational cycle is still in 'grayagain'.)
 */
 void luaC_barrierback_ (lua_State *L, Table *t) {
   global_State *g = G(L);
   lua_assert(isblack(t) && !isdead(g, t));
   black2gray(t);  /* make table gray (again) */
-  linkgclist(t, g->grayagain);
+  if (t == g->travtable)  /* was being traversed in chunks? */
+    g->travtable = NULL;  /* atomic phase will traverse it again */
+  if (getage(t) != G_TOUCHED2)  /* not already in gray list? */
+    linkgclist(t, g->grayagain);
+  if (isold(t))  /* generational mode? */
+    setage(t, G_TOUCHED1);  /* touched in current cycle */
 }
 
 
@@ -180,14 +220,18 @@ void luaC_barrierback_ (lua_State *L, Table *t) {
 ** barrier for assignments to closed upvalues. Because upvalues are
 ** shared among closures, it is impossible to know the color of all
 ** closures pointing to it. So, we assume that the object being assigned
-** must be marked.
+** must be marked, and (in generational mode) that some of those
+** closures is old.
 */
 void luaC_upvalbarrier_ (lua_State *L, UpVal *uv) {
   global_State *g = G(L);
   GCObject *o = gcvalue(uv->v);
   lua_assert(!upisopen(uv));  /* ensured by macro luaC_upvalbarrier */
-  if (keepinvariant(g))
-    markobject(g, o);
+  if (keepinvariant(g) && iswhite(o)) {
+    reallymarkobject(g, o);
+    if (g->gckind == KGC_GEN)
+      setage(o, G_OLD0);
+  }
 }
 
 
@@ -196,6 +240,7 @@ void luaC_fix (lua_State *L, GCObject *o) {
   global_State *g = G(L);
   lua_assert(g->allgc == o);  /* object must be 1st in 'allgc' list! 看起来这个函数需要紧接着newObject之后调用,这样g->allgc链表第一个元素就是该元素 */
   white2gray(o);  /* they will be gray forever */
+  setage(o, G_OLD);  /* and old forever */
   g->allgc = o->next;  /* remove object from 'allgc' list */
   o->next = g->fixedgc;  /* link it to 'fixedgc' list */
   g->fixedgc = o;
@@ -244,7 +289,9 @@ static void reallymarkobject (global_State *g, GCObject *o) {
     }
     case LUA_TLNGSTR: {
       gray2black(o);
-      g->GCmemtrav += sizelstring(gco2ts(o)->u.lnglen);
+      g->GCmemtrav += sizelngstr(gco2ts(o));
+      if (isstrview(gco2ts(o)))  /* (a parent is never a view) */
+        markobject(g, strview(gco2ts(o))->parent);
       break;
     }
     case LUA_TUSERDATA: {
@@ -294,6 +341,32 @@ static void markmt (global_State *g) {
 }
 
 
+#if defined(LUA_USE_SHAPES)
+/*
+** mark the keys of all record shapes (each shape adds one key to its
+** parent's; the root has none). Tables do not mark their field keys.
+*/
+static void markshapes (global_State *g) {
+  Shape *s = g->shaperoot;
+  if (s == NULL) return;
+  for (;;) {
+    if (s->kids != NULL)
+      s = s->kids;
+    else {
+      while (s->sibling == NULL) {
+        s = s->parent;
+        if (s == NULL) return;  /* back above the root */
+      }
+      s = s->sibling;
+    }
+    markobject(g, s->keys[s->nkeys - 1]);
+  }
+}
+#else
+#define markshapes(g)	((void)0)
+#endif
+
+
 /*
 ** mark all objects in list of being-finalized
 */
@@ -337,6 +410,7 @@ static void remarkupvals (global_State *g) {
 */
 static void restartcollection (global_State *g) {
   g->gray = g->grayagain = NULL;
+  g->travtable = NULL;
   g->weak = g->allweak = g->ephemeron = NULL;
   markobject(g, g->mainthread);
   markvalue(g, &g->l_registry);
@@ -357,28 +431,39 @@ static void restartcollection (global_State *g) {
 ** Traverse a table with weak values and link it to proper list. During
 ** propagate phase, keep it in 'grayagain' list, to be revisited in the
 ** atomic phase. In the atomic phase, if table has any white value,
-** put it in 'weak' list, to be cleared.
+** put it in 'weak' list, to be cleared; otherwise, keep it in
+** 'grayagain', so that the generational mode still sees it.
 */
 static void traverseweakvalue (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
+  Node *n, *limit;
+  Table *p;
   /* if there is array part, assume it may have white values (it is not
      worth traversing it now just to check) */
   int hasclears = (h->sizearray > 0);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
-    checkdeadkey(n);
-    if (ttisnil(gval(n)))  /* entry is empty? */
-      removeentry(n);  /* remove it */
-    else {
-      lua_assert(!ttisnil(gkey(n)));
-      markvalue(g, gkey(n));  /* mark key */
-      if (!hasclears && iscleared(g, gval(n)))  /* is there a white value? */
-        hasclears = 1;  /* table will have to be cleared */
+#if defined(LUA_USE_SHAPES)
+  unsigned int i;
+  for (i = 0; i < nfields(h); i++) {  /* traverse fields */
+    if (!hasclears && iscleared(g, gfield(h, i)))
+      hasclears = 1;
+  }
+#endif
+  for (p = h; p != NULL; p = nextpart(h, p)) {  /* traverse hash part */
+    for (n = gnode(p, 0), limit = gnodelast(p); n < limit; n++) {
+      checkdeadkey(n);
+      if (ttisnil(gval(n)))  /* entry is empty? */
+        removeentry(n);  /* remove it */
+      else {
+        lua_assert(!ttisnil(gkey(n)));
+        markvalue(g, gkey(n));  /* mark key */
+        if (!hasclears && iscleared(g, gval(n)))  /* is there a white value? */
+          hasclears = 1;  /* table will have to be cleared */
+      }
     }
   }
-  if (g->gcstate == GCSpropagate)
-    linkgclist(h, g->grayagain);  /* must retraverse it in atomic phase */
-  else if (hasclears)
+  if (g->gcstate == GCSinsideatomic && hasclears)
     linkgclist(h, g->weak);  /* has to be cleared later */
+  else
+    linkgclist(h, g->grayagain);  /* must retraverse it in atomic phase */
 }
 
 
@@ -390,13 +475,15 @@ static void traverseweakvalue (global_State *g, Table *h) {
 ** the atomic phase, if table has any white->white entry, it has to
 ** be revisited during ephemeron convergence (as that key may turn
 ** black). Otherwise, if it has any white key, table has to be cleared
-** (in the atomic phase).
+** (in the atomic phase). Otherwise, it goes to 'grayagain', like the
+** other weak tables.
 */
 static int traverseephemeron (global_State *g, Table *h) {
   int marked = 0;  /* true if an object is marked in this traversal */
   int hasclears = 0;  /* true if table has white keys */
   int hasww = 0;  /* true if table has entry "white-key -> white-value" */
-  Node *n, *limit = gnodelast(h);
+  Node *n, *limit;
+  Table *p;
   unsigned int i;
   /* traverse array part */
   for (i = 0; i < h->sizearray; i++) {
@@ -405,19 +492,30 @@ static int traverseephemeron (global_State *g, Table *h) {
       reallymarkobject(g, gcvalue(&h->array[i]));
     }
   }
-  /* traverse hash part */
-  for (n = gnode(h, 0); n < limit; n++) {
-    checkdeadkey(n);
-    if (ttisnil(gval(n)))  /* entry is empty? */
-      removeentry(n);  /* remove it */
-    else if (iscleared(g, gkey(n))) {  /* key is not marked (yet)? */
-      hasclears = 1;  /* table must be cleared */
-      if (valiswhite(gval(n)))  /* value not marked yet? */
-        hasww = 1;  /* white-white entry */
-    }
-    else if (valiswhite(gval(n))) {  /* value not marked yet? */
+#if defined(LUA_USE_SHAPES)
+  /* traverse fields (their keys are strings, never cleared) */
+  for (i = 0; i < nfields(h); i++) {
+    if (valiswhite(gfield(h, i))) {
       marked = 1;
-      reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+      reallymarkobject(g, gcvalue(gfield(h, i)));
+    }
+  }
+#endif
+  /* traverse hash part */
+  for (p = h; p != NULL; p = nextpart(h, p)) {
+    for (n = gnode(p, 0), limit = gnodelast(p); n < limit; n++) {
+      checkdeadkey(n);
+      if (ttisnil(gval(n)))  /* entry is empty? */
+        removeentry(n);  /* remove it */
+      else if (iscleared(g, gkey(n))) {  /* key is not marked (yet)? */
+        hasclears = 1;  /* table must be cleared */
+        if (valiswhite(gval(n)))  /* value not marked yet? */
+          hasww = 1;  /* white-white entry */
+      }
+      else if (valiswhite(gval(n))) {  /* value not marked yet? */
+        marked = 1;
+        reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+      }
     }
   }
   /* link table into proper list */
@@ -427,16 +525,56 @@ static int traverseephemeron (global_State *g, Table *h) {
     linkgclist(h, g->ephemeron);  /* have to propagate again */
   else if (hasclears)  /* table has white keys? */
     linkgclist(h, g->allweak);  /* may have to clean white keys */
+  else
+    linkgclist(h, g->grayagain);  /* keep it in a gray list */
   return marked;
 }
 
 
-static void traversestrongtable (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
-  unsigned int i;
-  for (i = 0; i < h->sizearray; i++)  /* traverse array part */
+/*
+** In generational mode, a table touched in this cycle must be visited
+** again in the next one, as it may still point to young objects.
+*/
+static void genlink (global_State *g, Table *h) {
+  lua_assert(isblack(h));
+  if (getage(h) == G_TOUCHED1) {  /* touched in this cycle? */
+    black2gray(h);  /* keep it gray */
+    linkgclist(h, g->grayagain);  /* link it back in 'grayagain' */
+  }
+  else if (getage(h) == G_TOUCHED2)
+    changeage(h, G_TOUCHED2, G_OLD);  /* advance age */
+}
+
+
+/*
+** Traverse a strong table. In the propagate phase, a large table is
+** traversed in chunks of GCTRAVMAX slots (array part, fields, hash
+** part, then a part being migrated), one chunk per step. Until it is finished, the table stays black in
+** 'travtable', so that a write into it (or any move of its entries,
+** see 'luaC_movebarrier') calls the back barrier, which leaves the
+** table to the atomic phase. 'travpos' is where to resume. Returns the
+** memory traversed.
+*/
+static lu_mem traversestrongtable (global_State *g, Table *h) {
+  unsigned int asize = h->sizearray;
+  unsigned int fsize = asize + nfields(h);
+  unsigned int hsize = fsize + sizenode(h);
+  unsigned int size = hsize + sizeoldpart(h);
+  unsigned int i = (h == g->travtable) ? g->travpos : 0;
+  unsigned int lim = size;
+  unsigned int from = i;
+  lu_mem work = (i == 0) ? sizeof(Table) : 0;
+  if (g->gcstate == GCSpropagate && size - i > GCTRAVMAX)
+    lim = i + GCTRAVMAX;  /* traverse only one chunk */
+  for (; i < asize && i < lim; i++)  /* traverse array part */
     markvalue(g, &h->array[i]);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+  for (; i < fsize && i < lim; i++)  /* traverse fields */
+    markvalue(g, gfield(h, i - asize));
+  work += sizeof(TValue) * (i - from);
+  from = i;
+  for (; i < lim; i++) {  /* traverse hash part */
+    Node *n = (i < hsize) ? gnode(h, i - fsize)
+                          : gnode(oldpart(h), i - hsize);
     checkdeadkey(n);
     if (ttisnil(gval(n)))  /* entry is empty? */
       removeentry(n);  /* remove it */
@@ -446,40 +584,81 @@ static void traversestrongtable (global_State *g, Table *h) {
       markvalue(g, gval(n));  /* mark value */
     }
   }
+  work += sizeof(Node) * (i - from);
+  if (i < size) {  /* not finished? */
+    g->travtable = h;
+    g->travpos = i;
+  }
+  else {
+    if (h == g->travtable)
+      g->travtable = NULL;
+    genlink(g, h);
+  }
+  return work;
 }
 
 
-static lu_mem traversetable (global_State *g, Table *h) {
-  const char *weakkey, *weakvalue;
+/* weakness of a table, given by its '__mode' field */
+#define WEAKKEY		1
+#define WEAKVALUE	2
+
+static int weakmode (global_State *g, Table *h) {
   const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
+  int wm = 0;
+  if (mode && ttisstring(mode)) {  /* is there a weak mode? */
+    /* (views have no ending zero) */
+    if (memchr(svalue(mode), 'k', vslen(mode))) wm |= WEAKKEY;
+    if (memchr(svalue(mode), 'v', vslen(mode))) wm |= WEAKVALUE;
+  }
+  return wm;
+}
+
+
+#define tablesize(h)	(sizeof(Table) + sizeof(TValue) * (h)->sizearray + \
+                         sizeof(TValue) * sizefields(h) + \
+                         sizeof(Node) * cast(size_t, allocsizenode(h)) + \
+                         sizeof(Node) * cast(size_t, sizeoldpart(h)))
+
+
+static lu_mem traversetable (global_State *g, Table *h) {
+  int wm = weakmode(g, h);
   markobjectN(g, h->metatable);
-  if (mode && ttisstring(mode) &&  /* is there a weak mode? */
-      ((weakkey = strchr(svalue(mode), 'k')),
-       (weakvalue = strchr(svalue(mode), 'v')),
-       (weakkey || weakvalue))) {  /* is really weak? */
+  if (wm != 0) {  /* is really weak? */
     black2gray(h);  /* keep table gray */
-    if (!weakkey)  /* strong keys? */
+    if (!(wm & WEAKKEY))  /* strong keys? */
       traverseweakvalue(g, h);
-    else if (!weakvalue)  /* strong values? */
+    else if (!(wm & WEAKVALUE))  /* strong values? */
       traverseephemeron(g, h);
     else  /* all weak */
       linkgclist(h, g->allweak);  /* nothing to traverse now */
   }
   else  /* not weak */
-    traversestrongtable(g, h);
-  return sizeof(Table) + sizeof(TValue) * h->sizearray +
-                         sizeof(Node) * cast(size_t, allocsizenode(h));
+    return traversestrongtable(g, h);
+  return tablesize(h);
+}
+
+
+static lu_mem protosize (Proto *f) {
+  return sizeof(Proto) + sizeof(Instruction) * f->sizecode +
+                         (f->ic ? sizeof(FieldCache) * f->sizecode : 0) +
+                         sizeof(Proto *) * f->sizep +
+                         sizeof(TValue) * f->sizek +
+                         sizeof(int) * f->sizelineinfo +
+                         sizeof(LocVar) * f->sizelocvars +
+                         sizeof(Upvaldesc) * f->sizeupvalues;
 }
 
 
 /*
 ** Traverse a prototype. (While a prototype is being build, its
 ** arrays can be larger than needed; the extra slots are filled with
-** NULL, so the use of 'markobjectN')
+** NULL, so the use of 'markobjectN') In generational mode, the cache
+** is always cleared: the prototype may become old while the cached
+** closure is still young.
 */
 static int traverseproto (global_State *g, Proto *f) {
   int i;
-  if (f->cache && iswhite(f->cache))
+  if (f->cache && (iswhite(f->cache) || g->gckind == KGC_GEN))
     f->cache = NULL;  /* allow cache to be collected */
   markobjectN(g, f->source);
   for (i = 0; i < f->sizek; i++)  /* mark literals */
@@ -490,12 +669,7 @@ static int traverseproto (global_State *g, Proto *f) {
     markobjectN(g, f->p[i]);
   for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
     markobjectN(g, f->locvars[i].varname);
-  return sizeof(Proto) + sizeof(Instruction) * f->sizecode +
-                         sizeof(Proto *) * f->sizep +
-                         sizeof(TValue) * f->sizek +
-                         sizeof(int) * f->sizelineinfo +
-                         sizeof(LocVar) * f->sizelocvars +
-                         sizeof(Upvaldesc) * f->sizeupvalues;
+  return protosize(f);
 }
 
 
@@ -528,6 +702,10 @@ static lu_mem traverseLclosure (global_State *g, LClosure *cl) {
 }
 
 
+#define threadsize(th)	(sizeof(lua_State) + sizeof(TValue) * (th)->stacksize + \
+                         sizeof(CallInfo) * (th)->nci)
+
+
 static lu_mem traversethread (global_State *g, lua_State *th) {
   StkId o = th->stack;
   if (o == NULL)
@@ -546,10 +724,11 @@ static lu_mem traversethread (global_State *g, lua_State *th) {
       g->twups = th;
     }
   }
-  else if (g->gckind != KGC_EMERGENCY)
+  /* (generational mode traverses threads only in the atomic phase) */
+  if ((g->gcstate != GCSinsideatomic || g->gckind == KGC_GEN) &&
+      !g->gcemergency)
     luaD_shrinkstack(th); /* do not change stack in emergency cycle */
-  return (sizeof(lua_State) + sizeof(TValue) * th->stacksize +
-          sizeof(CallInfo) * th->nci);
+  return threadsize(th);
 }
 
 
@@ -560,7 +739,12 @@ static lu_mem traversethread (global_State *g, lua_State *th) {
 static void propagatemark (global_State *g) {
   lu_mem size;
   GCObject *o = g->gray;
-  lua_assert(isgray(o));
+  if (g->travtable != NULL) {  /* resume traversal of a large table */
+    lua_assert(isblack(g->travtable));
+    g->GCmemtrav += traversestrongtable(g, g->travtable);
+    return;
+  }
+  lua_assert(!iswhite(o));  /* black TOUCHED2 tables may be in 'gray' */
   gray2black(o);
   switch (o->tt) {
     case LUA_TTABLE: {
@@ -601,8 +785,46 @@ static void propagatemark (global_State *g) {
 }
 
 
+#if defined(LUA_USE_PARMARK)
+
+/*
+** Propagate marks with the helpers of 'lgcpar.c'. A few objects are
+** traversed here first, as small gray sets do not pay a parallel round;
+** objects the helpers leave to the collector (threads, weak tables,
+** etc.) are traversed here too, which may start another round.
+*/
+static void parpropagateall (global_State *g) {
+  int n = 0;
+  while (g->gray || g->travtable) {
+    if (n < LUAI_PARMARKMIN || g->travtable != NULL) {
+      propagatemark(g);
+      n++;
+    }
+    else {
+      GCObject *left = luaC_parmark(g);  /* drains 'g->gray' */
+      while (left != NULL) {
+        GCObject *o = left;
+        left = *getgclist(o);
+        *getgclist(o) = g->gray;  /* put 'o' alone in front of the list */
+        g->gray = o;
+        propagatemark(g);  /* and traverse it */
+      }
+      n = 0;
+    }
+  }
+}
+
+#endif
+
+
 static void propagateall (global_State *g) {
-  while (g->gray) propagatemark(g);
+#if defined(LUA_USE_PARMARK)
+  if (g->parmark != NULL) {
+    parpropagateall(g);
+    return;
+  }
+#endif
+  while (g->gray || g->travtable) propagatemark(g);
 }
 
 
@@ -626,6 +848,171 @@ static void convergeephemerons (global_State *g) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** Reference enumeration (for heap snapshots)
+** =======================================================
+*/
+
+#define visitvalue(f,ud,kind,k,v)  \
+	{ if (iscollectable(v)) (*(f))(ud, kind, k, gcvalue(v)); }
+
+#define visitobjectN(f,ud,kind,k,t)  \
+	{ if (t) (*(f))(ud, kind, k, obj2gco(t)); }
+
+
+static void visittable (global_State *g, Table *h, luaC_RefVisitor f,
+                                                   void *ud) {
+  int wm = weakmode(g, h);
+  int kk = LUAC_RKEY | ((wm & WEAKKEY) ? LUAC_RWEAK : 0);
+  int vk = LUAC_RVALUE | ((wm & WEAKVALUE) ? LUAC_RWEAK : 0);
+  Node *n, *limit;
+  Table *p;
+  unsigned int i;
+  TValue k;
+  visitobjectN(f, ud, LUAC_RMETA, NULL, h->metatable);
+  for (i = 0; i < h->sizearray; i++) {
+    setivalue(&k, cast(lua_Integer, i) + 1);
+    visitvalue(f, ud, vk, &k, &h->array[i]);
+  }
+#if defined(LUA_USE_SHAPES)
+  for (i = 0; i < nfields(h); i++) {
+    if (!ttisnil(gfield(h, i))) {
+      setsvalue(cast(lua_State *, NULL), &k, gfieldkey(h, i));
+      visitobjectN(f, ud, kk, NULL, gfieldkey(h, i));
+      visitvalue(f, ud, vk, &k, gfield(h, i));
+    }
+  }
+#endif
+  for (p = h; p != NULL; p = nextpart(h, p)) {
+    for (n = gnode(p, 0), limit = gnodelast(p); n < limit; n++) {
+      if (!ttisnil(gval(n))) {
+        visitvalue(f, ud, kk, NULL, gkey(n));
+        visitvalue(f, ud, vk, gkey(n), gval(n));
+      }
+    }
+  }
+}
+
+
+static void visitproto (Proto *p, luaC_RefVisitor f, void *ud) {
+  int i;
+  TValue k;
+  visitobjectN(f, ud, LUAC_RNAME, NULL, p->source);
+  for (i = 0; i < p->sizek; i++) {
+    setivalue(&k, i + 1);
+    visitvalue(f, ud, LUAC_RCONST, &k, &p->k[i]);
+  }
+  for (i = 0; i < p->sizeupvalues; i++)
+    visitobjectN(f, ud, LUAC_RNAME, NULL, p->upvalues[i].name);
+  for (i = 0; i < p->sizep; i++)
+    visitobjectN(f, ud, LUAC_RPROTO, NULL, p->p[i]);
+  for (i = 0; i < p->sizelocvars; i++)
+    visitobjectN(f, ud, LUAC_RNAME, NULL, p->locvars[i].varname);
+  visitobjectN(f, ud, LUAC_RCACHE | LUAC_RWEAK, NULL, p->cache);
+}
+
+
+static void visitLclosure (LClosure *cl, luaC_RefVisitor f, void *ud) {
+  int i;
+  visitobjectN(f, ud, LUAC_RPROTO, NULL, cl->p);
+  for (i = 0; i < cl->nupvalues; i++) {
+    UpVal *uv = cl->upvals[i];
+    TString *name = (cl->p != NULL && i < cl->p->sizeupvalues)
+                  ? cl->p->upvalues[i].name : NULL;
+    TValue k;
+    if (uv == NULL)
+      continue;
+    if (name != NULL) {
+      setsvalue(cast(lua_State *, NULL), &k, name);
+    }
+    else {
+      setivalue(&k, i + 1);
+    }
+    visitvalue(f, ud, LUAC_RUPVAL, &k, uv->v);
+  }
+}
+
+
+/*
+** Calls 'f' for each reference from 'o' to a collectable object, with
+** the view of 'o' of the traversals above (weak references are flagged
+** with LUAC_RWEAK), but without marking or changing anything. Returns
+** the size of 'o'. (With no 'f', only computes the size.)
+*/
+lu_mem luaC_traverserefs (global_State *g, GCObject *o, luaC_RefVisitor f,
+                                                         void *ud) {
+  TValue k;
+  int i;
+  if (f == NULL) {
+    switch (o->tt) {
+      case LUA_TSHRSTR: return sizelstring(gco2ts(o)->shrlen);
+      case LUA_TLNGSTR: return sizelngstr(gco2ts(o));
+      case LUA_TUSERDATA: return sizeudata(gco2u(o));
+      case LUA_TTABLE: return tablesize(gco2t(o));
+      case LUA_TLCL: return sizeLclosure(gco2lcl(o)->nupvalues);
+      case LUA_TCCL: return sizeCclosure(gco2ccl(o)->nupvalues);
+      case LUA_TTHREAD:
+        return (gco2th(o)->stack == NULL) ? sizeof(lua_State)
+                                          : threadsize(gco2th(o));
+      case LUA_TPROTO: return protosize(gco2p(o));
+      default: lua_assert(0); return 0;
+    }
+  }
+  switch (o->tt) {
+    case LUA_TSHRSTR: return sizelstring(gco2ts(o)->shrlen);
+    case LUA_TLNGSTR: {
+      TString *ts = gco2ts(o);
+      if (isstrview(ts))
+        visitobjectN(f, ud, LUAC_RPARENT, NULL, strview(ts)->parent);
+      return sizelngstr(ts);
+    }
+    case LUA_TUSERDATA: {
+      Udata *u = gco2u(o);
+      TValue uvalue;
+      visitobjectN(f, ud, LUAC_RMETA, NULL, u->metatable);
+      getuservalue(cast(lua_State *, NULL), u, &uvalue);
+      visitvalue(f, ud, LUAC_RUSER, NULL, &uvalue);
+      return sizeudata(u);
+    }
+    case LUA_TTABLE: {
+      visittable(g, gco2t(o), f, ud);
+      return tablesize(gco2t(o));
+    }
+    case LUA_TLCL: {
+      visitLclosure(gco2lcl(o), f, ud);
+      return sizeLclosure(gco2lcl(o)->nupvalues);
+    }
+    case LUA_TCCL: {
+      CClosure *cl = gco2ccl(o);
+      for (i = 0; i < cl->nupvalues; i++) {
+        setivalue(&k, i + 1);
+        visitvalue(f, ud, LUAC_RUPVAL, &k, &cl->upvalue[i]);
+      }
+      return sizeCclosure(cl->nupvalues);
+    }
+    case LUA_TTHREAD: {
+      lua_State *th = gco2th(o);
+      StkId s;
+      if (th->stack == NULL)
+        return sizeof(lua_State);  /* stack not completely built yet */
+      for (s = th->stack; s < th->top; s++) {
+        setivalue(&k, cast(lua_Integer, s - th->stack) + 1);
+        visitvalue(f, ud, LUAC_RSTACK, &k, s);
+      }
+      return threadsize(th);
+    }
+    case LUA_TPROTO: {
+      visitproto(gco2p(o), f, ud);
+      return protosize(gco2p(o));
+    }
+    default: lua_assert(0); return 0;
+  }
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** Sweep Functions
@@ -640,11 +1027,14 @@ static void convergeephemerons (global_State *g) {
 static void clearkeys (global_State *g, GCObject *l, GCObject *f) {
   for (; l != f; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *n, *limit = gnodelast(h);
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (!ttisnil(gval(n)) && (iscleared(g, gkey(n)))) {
-        setnilvalue(gval(n));  /* remove value ... */
-        removeentry(n);  /* and remove entry from table */
+    Node *n, *limit;
+    Table *p;
+    for (p = h; p != NULL; p = nextpart(h, p)) {
+      for (n = gnode(p, 0), limit = gnodelast(p); n < limit; n++) {
+        if (!ttisnil(gval(n)) && (iscleared(g, gkey(n)))) {
+          setnilvalue(gval(n));  /* remove value ... */
+          removeentry(n);  /* and remove entry from table */
+        }
       }
     }
   }
@@ -658,17 +1048,27 @@ static void clearkeys (global_State *g, GCObject *l, GCObject *f) {
 static void clearvalues (global_State *g, GCObject *l, GCObject *f) {
   for (; l != f; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *n, *limit = gnodelast(h);
+    Node *n, *limit;
+    Table *p;
     unsigned int i;
     for (i = 0; i < h->sizearray; i++) {
       TValue *o = &h->array[i];
       if (iscleared(g, o))  /* value was collected? */
         setnilvalue(o);  /* remove value */
     }
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (!ttisnil(gval(n)) && iscleared(g, gval(n))) {
-        setnilvalue(gval(n));  /* remove value ... */
-        removeentry(n);  /* and remove entry from table */
+#if defined(LUA_USE_SHAPES)
+    for (i = 0; i < nfields(h); i++) {
+      TValue *o = gfield(h, i);
+      if (iscleared(g, o))  /* value was collected? */
+        setnilvalue(o);  /* leave a hole */
+    }
+#endif
+    for (p = h; p != NULL; p = nextpart(h, p)) {
+      for (n = gnode(p, 0), limit = gnodelast(p); n < limit; n++) {
+        if (!ttisnil(gval(n)) && iscleared(g, gval(n))) {
+          setnilvalue(gval(n));  /* remove value ... */
+          removeentry(n);  /* and remove entry from table */
+        }
       }
     }
   }
@@ -713,7 +1113,14 @@ static void freeobj (lua_State *L, GCObject *o) {
       luaM_freemem(L, o, sizelstring(gco2ts(o)->shrlen));
       break;
     case LUA_TLNGSTR: {
-      luaM_freemem(L, o, sizelstring(gco2ts(o)->u.lnglen));
+      TString *ts = gco2ts(o);
+      if (!isstrview(ts))
+        luaM_freemem(L, o, sizelstring(ts->u.lnglen));
+      else {
+        if (strview(ts)->cstr != NULL)
+          luaM_freearray(L, strview(ts)->cstr, ts->u.lnglen + 1);
+        luaM_freemem(L, o, sizeof(UTString) + sizeof(StrView));
+      }
       break;
     }
     default: lua_assert(0);
@@ -776,7 +1183,7 @@ static GCObject **sweeptolive (lua_State *L, GCObject **p) {
 ** If possible, shrink string table
 */
 static void checkSizes (lua_State *L, global_State *g) {
-  if (g->gckind != KGC_EMERGENCY) {
+  if (!g->gcemergency) {
     l_mem olddebt = g->GCdebt;
     if (g->strt.nuse < g->strt.size / 4)  /* string table too big? */
       luaS_resize(L, g->strt.size / 2);  /* shrink it a little */
@@ -794,6 +1201,8 @@ static GCObject *udata2finalize (global_State *g) {
   resetbit(o->marked, FINALIZEDBIT);  /* object is "normal" again */
   if (issweepphase(g))
     makewhite(g, o);  /* "sweep" object */
+  else if (getage(o) == G_OLD1)
+    g->firstold1 = o;  /* it is the first OLD1 object in the list */
   return o;
 }
 
@@ -827,7 +1236,7 @@ static void GCTM (lua_State *L, int propagateerrors) {
     if (status != LUA_OK && propagateerrors) {  /* error while running __gc? */
       if (status == LUA_ERRRUN) {  /* is there an error object? */
         const char *msg = (ttisstring(L->top - 1))
-                            ? svalue(L->top - 1)
+                            ? luaS_cstr(L, tsvalue(L->top - 1))
                             : "no message";
         luaO_pushfstring(L, "error in __gc metamethod (%s)", msg);
         status = LUA_ERRGCMM;  /* error in __gc metamethod */
@@ -875,17 +1284,20 @@ static GCObject **findlast (GCObject **p) {
 
 /*
 ** move all unreachable objects (or 'all' objects) that need
-** finalization from list 'finobj' to list 'tobefnz' (to be finalized)
+** finalization from list 'finobj' to list 'tobefnz' (to be finalized).
+** (Old objects, from 'finobjold1' on, cannot be unreachable.)
 */
 static void separatetobefnz (global_State *g, int all) {
   GCObject *curr;
   GCObject **p = &g->finobj;
   GCObject **lastnext = findlast(&g->tobefnz);
-  while ((curr = *p) != NULL) {  /* traverse all finalizable objects */
+  while ((curr = *p) != g->finobjold1) {  /* traverse finalizable objects */
     lua_assert(tofinalize(curr));
     if (!(iswhite(curr) || all))  /* not being collected? */
       p = &curr->next;  /* don't bother with it */
     else {
+      if (curr == g->finobjsur)  /* removing 'finobjsur'? */
+        g->finobjsur = curr->next;  /* correct it */
       *p = curr->next;  /* remove 'curr' from 'finobj' list */
       curr->next = *lastnext;  /* link at the end of 'tobefnz' list */
       *lastnext = curr;
@@ -895,6 +1307,27 @@ static void separatetobefnz (global_State *g, int all) {
 }
 
 
+/*
+** if pointer 'p' points to 'o', move it to the next element
+*/
+static void checkpointer (GCObject **p, GCObject *o) {
+  if (o == *p)
+    *p = o->next;
+}
+
+
+/*
+** correct pointers to objects inside 'allgc' list when object 'o' is
+** being removed from the list
+*/
+static void correctpointers (global_State *g, GCObject *o) {
+  checkpointer(&g->survival, o);
+  checkpointer(&g->old1, o);
+  checkpointer(&g->reallyold, o);
+  checkpointer(&g->firstold1, o);
+}
+
+
 /*
 ** if object 'o' has a finalizer, remove it from 'allgc' list (must
 ** search the list to find it) and link it in 'finobj' list.
@@ -911,6 +1344,8 @@ void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
       if (g->sweepgc == &o->next)  /* should not remove 'sweepgc' object */
         g->sweepgc = sweeptolive(L, g->sweepgc);  /* change 'sweepgc' */
     }
+    else
+      correctpointers(g, o);
     /* search for pointer pointing to 'o' */
     for (p = &g->allgc; *p != o; p = &(*p)->next) { /* empty */ }
     *p = o->next;  /* remove 'o' from 'allgc' list */
@@ -924,6 +1359,7 @@ void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
 
 
 
+
 /*
 ** {======================================================
 ** GC control
@@ -931,6 +1367,11 @@ void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
 */
 
 
+static void setminordebt (global_State *g);
+static void fullgen (lua_State *L, global_State *g);
+static void genstep (lua_State *L, global_State *g);
+
+
 /*
 ** Set a reasonable "time" to wait before starting a new GC cycle; cycle
 ** will start when memory use hits threshold. (Division by 'estimate'
@@ -944,6 +1385,8 @@ static void setpause (global_State *g) {
   threshold = (g->gcpause < MAX_LMEM / estimate)  /* overflow? */
             ? estimate * g->gcpause  /* no overflow */
             : MAX_LMEM;  /* overflow; truncate to maximum */
+  if (g->memlimit > 0 && threshold > limitthreshold(g))
+    threshold = limitthreshold(g);  /* start next cycle before the limit */
   debt = gettotalbytes(g) - threshold;
   luaE_setdebt(g, debt);
 }
@@ -961,20 +1404,23 @@ static void entersweep (lua_State *L) {
   g->gcstate = GCSswpallgc;
   lua_assert(g->sweepgc == NULL);
   g->sweepgc = sweeplist(L, &g->allgc, 1);
+  g->travtable = NULL;  /* (a full collection may interrupt a traversal) */
 }
 
 
 void luaC_freeallobjects (lua_State *L) {
   global_State *g = G(L);
+  luaC_changemode(L, KGC_NORMAL);
   separatetobefnz(g, 1);  /* separate all objects with finalizers */
   lua_assert(g->finobj == NULL);
   callallpendingfinalizers(L);
   lua_assert(g->tobefnz == NULL);
   g->currentwhite = WHITEBITS; /* this "white" makes all objects look dead */
-  g->gckind = KGC_NORMAL;
   sweepwholelist(L, &g->finobj);
   sweepwholelist(L, &g->allgc);
   sweepwholelist(L, &g->fixedgc);  /* collect fixed objects */
+  luaC_freeparmark(L);
+  luaC_freebgsweep(L);  /* wait for pending frees */
   lua_assert(g->strt.nuse == 0);
 }
 
@@ -984,6 +1430,7 @@ static l_mem atomic (lua_State *L) {
   l_mem work;
   GCObject *origweak, *origall;
   GCObject *grayagain = g->grayagain;  /* save original list */
+  g->grayagain = NULL;
   lua_assert(g->ephemeron == NULL && g->weak == NULL);
   lua_assert(!iswhite(g->mainthread));
   g->gcstate = GCSinsideatomic;
@@ -992,6 +1439,7 @@ static l_mem atomic (lua_State *L) {
   /* registry and global metatables may be changed by API */
   markvalue(g, &g->l_registry);
   markmt(g);  /* mark global metatables */
+  markshapes(g);  /* mark keys of records */
   /* remark occasional upvalues of (maybe) dead threads */
   remarkupvals(g);
   propagateall(g);  /* propagate changes */
@@ -1046,16 +1494,16 @@ static lu_mem singlestep (lua_State *L) {
   global_State *g = G(L);
   switch (g->gcstate) {
     case GCSpause: {
-      g->GCmemtrav = g->strt.size * sizeof(GCObject*);
+      g->GCmemtrav = (g->strt.size + g->strt.oldsize) * sizeof(GCObject*);
       restartcollection(g);
       g->gcstate = GCSpropagate;
       return g->GCmemtrav;
     }
     case GCSpropagate: {
       g->GCmemtrav = 0;
-      lua_assert(g->gray);
+      lua_assert(g->gray || g->travtable);
       propagatemark(g);
-       if (g->gray == NULL)  /* no more gray objects? */
+      if (g->gray == NULL && g->travtable == NULL)  /* no more gray objects? */
         g->gcstate = GCSatomic;  /* finish propagate phase */
       return g->GCmemtrav;  /* memory traversed in this step */
     }
@@ -1083,7 +1531,7 @@ static lu_mem singlestep (lua_State *L) {
       return 0;
     }
     case GCScallfin: {  /* call remaining finalizers */
-      if (g->tobefnz && g->gckind != KGC_EMERGENCY) {
+      if (g->tobefnz && !g->gcemergency) {
         int n = runafewfinalizers(L);
         return (n * GCFINALIZECOST);
       }
@@ -1129,14 +1577,22 @@ static l_mem getdebt (global_State *g) {
 void luaC_step (lua_State *L) {
   global_State *g = G(L);
   l_mem debt = getdebt(g);  /* GC deficit (be paid now) */
+  if (luaS_resizing(g))
+    luaS_resizestep(L, STRTGCMOVE);
   if (!g->gcrunning) {  /* not running? */
     luaE_setdebt(g, -GCSTEPSIZE * 10);  /* avoid being called too often */
     return;
   }
+  if (g->gckind == KGC_GEN) {
+    genstep(L, g);
+    luaC_bgflush(g);
+    return;
+  }
   do {  /* repeat until pause or enough "credit" (negative debt) */
     lu_mem work = singlestep(L);  /* perform one single step */
     debt -= work;
   } while (debt > -GCSTEPSIZE && g->gcstate != GCSpause);
+  luaC_bgflush(g);  /* let the helper free what was swept */
   if (g->gcstate == GCSpause)
     setpause(g);  /* pause until next cycle */
   else {
@@ -1147,6 +1603,55 @@ void luaC_step (lua_State *L) {
 }
 
 
+/*
+** current time in microseconds, for 'luaC_steptime'
+*/
+static double gcclock (void) {
+#if defined(LUA_USE_POSIX) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+#else
+  return (double)clock() * (1e6 / CLOCKS_PER_SEC);
+#endif
+}
+
+
+/*
+** Performs incremental steps for about 'us' microseconds (at least one
+** step), stopping at the end of a cycle; the work done is discounted
+** from the debt. (No single step is long: large tables are traversed
+** in chunks and sweeps go by GCSWEEPMAX objects.) In generational
+** mode, does a collection if there is debt. Returns true if a cycle
+** was finished.
+*/
+int luaC_steptime (lua_State *L, int us) {
+  global_State *g = G(L);
+  double limit = gcclock() + us;
+  l_mem work = 0;
+  if (luaS_resizing(g))
+    luaS_resizestep(L, STRTGCMOVE);
+  if (g->gckind == KGC_GEN) {
+    if (g->GCdebt <= 0)
+      return 0;
+    genstep(L, g);
+    luaC_bgflush(g);
+    return 1;
+  }
+  do {
+    work += singlestep(L);
+  } while (g->gcstate != GCSpause && gcclock() < limit);
+  luaC_bgflush(g);
+  if (g->gcstate == GCSpause) {
+    setpause(g);  /* pause until next cycle */
+    return 1;
+  }
+  else {  /* convert 'work units' to Kb */
+    luaE_setdebt(g, g->GCdebt - (work / g->gcstepmul) * STEPMULADJ);
+    return 0;
+  }
+}
+
 /*
 ** Performs a full GC cycle; if 'isemergency', set a flag to avoid
 ** some operations which could change the interpreter state in some
@@ -1158,22 +1663,369 @@ void luaC_step (lua_State *L) {
 */
 void luaC_fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
-  lua_assert(g->gckind == KGC_NORMAL);
-  if (isemergency) g->gckind = KGC_EMERGENCY;  /* set flag */
+  lua_assert(!g->gcemergency);
+  g->gcemergency = cast_byte(isemergency);  /* set flag */
+  if (g->gckind == KGC_GEN) {
+    fullgen(L, g);
+    setminordebt(g);
+    luaC_bgflush(g);
+    g->gcemergency = 0;
+    return;
+  }
   if (keepinvariant(g)) {  /* black objects? */
     entersweep(L); /* sweep everything to turn them back to white */
   }
   /* finish any pending sweep phase to start a new cycle */
   luaC_runtilstate(L, bitmask(GCSpause));
   luaC_runtilstate(L, ~bitmask(GCSpause));  /* start new collection */
+  propagateall(g);  /* mark everything at once (maybe in parallel) */
+  g->gcstate = GCSatomic;
   luaC_runtilstate(L, bitmask(GCScallfin));  /* run up to finalizers */
   /* estimate must be correct after a full GC cycle */
   lua_assert(g->GCestimate == gettotalbytes(g));
   luaC_runtilstate(L, bitmask(GCSpause));  /* finish collection */
-  g->gckind = KGC_NORMAL;
+  luaC_bgflush(g);
+  g->gcemergency = 0;
   setpause(g);
 }
 
 /* }====================================================== */
 
+/*
+** {======================================================
+** Generational Collector
+** =======================================================
+*/
+
+
+/*
+** In generational mode, lists 'allgc' and 'finobj' are split by age:
+** objects before 'survival' ('finobjsur') were created after the last
+** collection; those up to 'old1' ('finobjold1') survived one
+** collection; those up to 'reallyold' ('finobjrold') became old in the
+** last collection; the rest are old. A minor collection traverses only
+** young objects, old objects touched by a barrier (which are kept in
+** 'grayagain') and objects that just became old (which may still point
+** to survivals). 'firstold1' points to the first OLD1 object in the
+** young part of 'allgc', if any.
+*/
+
+
+/*
+** Sweep a list of objects up to 'limit', freeing the dead ones and
+** advancing the age of the others. New objects become white survivals;
+** older ones keep their color. Returns where the sweep stopped.
+*/
+static GCObject **sweepgen (lua_State *L, global_State *g, GCObject **p,
+                            GCObject *limit, GCObject **pfirstold1) {
+  static const lu_byte nextage[] = {
+    G_SURVIVAL,  /* from G_NEW */
+    G_OLD1,      /* from G_SURVIVAL */
+    G_OLD1,      /* from G_OLD0 */
+    G_OLD,       /* from G_OLD1 */
+    G_OLD,       /* from G_OLD (do not change) */
+    G_TOUCHED1,  /* from G_TOUCHED1 (do not change) */
+    G_TOUCHED2   /* from G_TOUCHED2 (do not change) */
+  };
+  int white = luaC_white(g);
+  GCObject *curr;
+  while ((curr = *p) != limit) {
+    if (iswhite(curr)) {  /* is 'curr' dead? */
+      lua_assert(!isold(curr) && isdead(g, curr));
+      *p = curr->next;  /* remove 'curr' from list */
+      freeobj(L, curr);  /* erase 'curr' */
+    }
+    else {  /* correct mark and age */
+      if (getage(curr) == G_NEW)
+        curr->marked = cast_byte((curr->marked & maskgcbits) |
+                                 (G_SURVIVAL << AGESHIFT) | white);
+      else {  /* all other objects will be old, and so keep their color */
+        setage(curr, nextage[getage(curr)]);
+        if (getage(curr) == G_OLD1 && *pfirstold1 == NULL)
+          *pfirstold1 = curr;  /* first OLD1 object in the list */
+      }
+      p = &curr->next;  /* go to next element */
+    }
+  }
+  return p;
+}
+
+
+/*
+** Traverse a list making all its elements white and clearing their
+** age (used when entering the incremental mode)
+*/
+static void whitelist (global_State *g, GCObject *p) {
+  int white = luaC_white(g);
+  for (; p != NULL; p = p->next)
+    p->marked = cast_byte((p->marked & maskgcbits) | white);
+}
+
+
+/*
+** Correct a gray list after a collection: white (dead or young)
+** objects and old objects not touched in this cycle are removed (the
+** old ones turned black, for the barriers); touched tables become
+** black TOUCHED2, still in the list, to be visited in the next cycle;
+** threads stay gray. Returns the end of the corrected list.
+*/
+static GCObject **correctgraylist (GCObject **p) {
+  GCObject *curr;
+  while ((curr = *p) != NULL) {
+    GCObject **next = getgclist(curr);
+    if (iswhite(curr))
+      *p = *next;  /* remove it */
+    else if (getage(curr) == G_TOUCHED1) {  /* touched in this cycle? */
+      lua_assert(isgray(curr));
+      gray2black(curr);  /* make it black, for next barrier */
+      changeage(curr, G_TOUCHED1, G_TOUCHED2);
+      p = next;  /* keep it in the list */
+    }
+    else if (curr->tt == LUA_TTHREAD) {
+      lua_assert(isgray(curr));
+      p = next;  /* old threads remain gray */
+    }
+    else {
+      lua_assert(isold(curr));  /* young objects should be white here */
+      if (getage(curr) == G_TOUCHED2)  /* advance from TOUCHED2... */
+        changeage(curr, G_TOUCHED2, G_OLD);  /* ... to OLD */
+      gray2black(curr);  /* make it black */
+      *p = *next;  /* and remove it */
+    }
+  }
+  return p;
+}
+
+
+/*
+** Correct all gray lists, coalescing them into 'grayagain'
+*/
+static void correctgraylists (global_State *g) {
+  GCObject **list = correctgraylist(&g->grayagain);
+  *list = g->weak; g->weak = NULL;
+  list = correctgraylist(list);
+  *list = g->allweak; g->allweak = NULL;
+  list = correctgraylist(list);
+  *list = g->ephemeron; g->ephemeron = NULL;
+  correctgraylist(list);
+}
+
 
+/*
+** Mark black OLD1 objects when starting a new young collection. They
+** are old now, but may still point to survivals that were not marked
+** in the last collection.
+*/
+static void markold (global_State *g, GCObject *from, GCObject *to) {
+  GCObject *p;
+  for (p = from; p != to; p = p->next) {
+    if (getage(p) == G_OLD1) {
+      lua_assert(!iswhite(p));
+      changeage(p, G_OLD1, G_OLD);  /* now they are old */
+      if (isblack(p)) {
+        black2gray(p);  /* should be gray to be traversed */
+        reallymarkobject(g, p);
+      }
+    }
+  }
+}
+
+
+static void cleargraylists (global_State *g) {
+  g->gray = g->grayagain = NULL;
+  g->travtable = NULL;
+  g->weak = g->allweak = g->ephemeron = NULL;
+}
+
+
+/*
+** Sweep a list after a full cycle, making all survivors old: threads
+** stay gray (in 'grayagain'), everything else becomes black.
+*/
+static void sweep2old (lua_State *L, GCObject **p) {
+  GCObject *curr;
+  global_State *g = G(L);
+  while ((curr = *p) != NULL) {
+    if (iswhite(curr)) {  /* is 'curr' dead? */
+      lua_assert(isdead(g, curr));
+      *p = curr->next;  /* remove 'curr' from list */
+      freeobj(L, curr);  /* erase 'curr' */
+    }
+    else {  /* all surviving objects become old */
+      setage(curr, G_OLD);
+      if (curr->tt == LUA_TTHREAD) {  /* threads must be watched */
+        lua_State *th = gco2th(curr);
+        linkgclist(th, g->grayagain);  /* insert into 'grayagain' list */
+      }
+      else
+        gray2black(curr);  /* everything else is black */
+      p = &curr->next;  /* go to next element */
+    }
+  }
+}
+
+
+/*
+** Finish a young or full generational collection: correct the gray
+** lists, shrink the string table and call pending finalizers
+*/
+static void finishgencycle (lua_State *L, global_State *g) {
+  correctgraylists(g);
+  checkSizes(L, g);
+  g->gcstate = GCSpropagate;  /* skip restart */
+  if (!g->gcemergency)
+    callallpendingfinalizers(L);
+}
+
+
+/*
+** Does a young collection. First, mark OLD1 objects. Then do the
+** atomic step. Then, sweep all lists and advance pointers. Finally,
+** finish the collection.
+*/
+static void youngcollection (lua_State *L, global_State *g) {
+  GCObject **psurvival;  /* to point to first non-dead survival object */
+  GCObject *dummy;  /* dummy out parameter to 'sweepgen' */
+  lua_assert(g->gcstate == GCSpropagate);
+  if (g->firstold1) {  /* are there regular OLD1 objects? */
+    markold(g, g->firstold1, g->reallyold);  /* mark them */
+    g->firstold1 = NULL;  /* no more OLD1 objects (for now) */
+  }
+  markold(g, g->finobj, g->finobjrold);
+  markold(g, g->tobefnz, NULL);
+  atomic(L);
+  /* sweep nursery and get a pointer to its last live element */
+  g->gcstate = GCSswpallgc;
+  psurvival = sweepgen(L, g, &g->allgc, g->survival, &g->firstold1);
+  /* sweep 'survival' */
+  sweepgen(L, g, psurvival, g->old1, &g->firstold1);
+  g->reallyold = g->old1;
+  g->old1 = *psurvival;  /* 'survival' survivals are old now */
+  g->survival = g->allgc;  /* all news are survivals */
+  /* repeat for 'finobj' lists */
+  dummy = NULL;  /* no 'firstold1' optimization for 'finobj' lists */
+  psurvival = sweepgen(L, g, &g->finobj, g->finobjsur, &dummy);
+  sweepgen(L, g, psurvival, g->finobjold1, &dummy);
+  g->finobjrold = g->finobjold1;
+  g->finobjold1 = *psurvival;
+  g->finobjsur = g->finobj;
+  sweepgen(L, g, &g->tobefnz, NULL, &dummy);
+  finishgencycle(L, g);
+}
+
+
+/*
+** Clears all gray lists, sweeps objects, and makes all survivors old.
+** (The main thread is not in 'allgc', so it is handled apart.)
+*/
+static void atomic2gen (lua_State *L, global_State *g) {
+  cleargraylists(g);
+  g->gcstate = GCSswpallgc;
+  sweep2old(L, &g->allgc);
+  /* everything alive now is old */
+  g->reallyold = g->old1 = g->survival = g->allgc;
+  g->firstold1 = NULL;  /* there are no OLD1 objects anywhere */
+  /* repeat for 'finobj' lists */
+  sweep2old(L, &g->finobj);
+  g->finobjrold = g->finobjold1 = g->finobjsur = g->finobj;
+  sweep2old(L, &g->tobefnz);
+  setage(g->mainthread, G_OLD);
+  linkgclist(g->mainthread, g->grayagain);
+  g->gckind = KGC_GEN;
+  g->GCestimate = gettotalbytes(g);  /* base for memory control */
+  finishgencycle(L, g);
+}
+
+
+/*
+** Set debt for the next minor collection, which will happen when
+** memory grows 'genminormul'%.
+*/
+static void setminordebt (global_State *g) {
+  l_mem credit = cast(l_mem, (gettotalbytes(g) / 100)) * g->genminormul;
+  if (g->memlimit > 0) {  /* do not let minor collections wait too long */
+    l_mem room = limitthreshold(g) - cast(l_mem, gettotalbytes(g));
+    if (credit > room)
+      credit = (room > 0) ? room : 0;
+  }
+  luaE_setdebt(g, -credit);
+}
+
+
+/*
+** Enter generational mode. Must go until the end of an atomic cycle to
+** ensure that all objects are correctly marked and weak tables are
+** cleared. Then, turn all objects into old and finish the collection.
+*/
+static void entergen (lua_State *L, global_State *g) {
+  luaC_runtilstate(L, bitmask(GCSpause));  /* prepare to start a new cycle */
+  luaC_runtilstate(L, bitmask(GCSpropagate));  /* start new cycle */
+  atomic(L);  /* propagates all and then do the atomic stuff */
+  atomic2gen(L, g);
+}
+
+
+/*
+** Enter incremental mode. Turn all objects white, make all
+** intermediate lists point to NULL (to avoid invalid pointers),
+** and go to the pause state.
+*/
+static void enterinc (global_State *g) {
+  whitelist(g, g->allgc);
+  g->reallyold = g->old1 = g->survival = NULL;
+  whitelist(g, g->finobj);
+  whitelist(g, g->tobefnz);
+  g->finobjrold = g->finobjold1 = g->finobjsur = NULL;
+  g->firstold1 = NULL;
+  g->mainthread->marked = cast_byte((g->mainthread->marked & maskgcbits) |
+                                    luaC_white(g));
+  g->gcstate = GCSpause;
+  g->gckind = KGC_NORMAL;
+}
+
+
+/*
+** Change collector mode to 'newmode'.
+*/
+void luaC_changemode (lua_State *L, int newmode) {
+  global_State *g = G(L);
+  if (newmode != g->gckind) {
+    if (newmode == KGC_GEN) {  /* entering generational mode? */
+      entergen(L, g);
+      setminordebt(g);
+    }
+    else {  /* entering incremental mode */
+      enterinc(g);
+      setpause(g);
+    }
+  }
+}
+
+
+/*
+** Does a full collection in generational mode.
+*/
+static void fullgen (lua_State *L, global_State *g) {
+  enterinc(g);
+  entergen(L, g);
+}
+
+
+/*
+** Does a generational "step". Usually it does a young collection; a
+** full (major) collection runs instead when memory grows more than
+** LUAI_GENMAJORMUL% over its size after the last major collection.
+*/
+static void genstep (lua_State *L, global_State *g) {
+  lu_mem majorbase = g->GCestimate;  /* memory after last major collection */
+  lu_mem majorinc = (majorbase / 100) * LUAI_GENMAJORMUL;
+  if (g->GCdebt > 0 && gettotalbytes(g) > majorbase + majorinc)
+    fullgen(L, g);  /* do a major collection (resets 'GCestimate') */
+  else {
+    youngcollection(L, g);
+    g->GCestimate = majorbase;  /* preserve base value */
+  }
+  setminordebt(g);
+}
+
+/* }====================================================== */
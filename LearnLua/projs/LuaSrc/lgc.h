@@ -22,6 +22,13 @@
 ** allweak, ephemeron) so that it can be visited again before finishing
 ** the collection cycle. These lists have no meaning when the invariant
 ** is not being enforced (e.g., sweep phase).
+**
+** In generational mode, the collector does each cycle atomically and
+** stays in GCSpropagate between cycles, so the invariant always holds.
+** Old objects are black and are not visited by minor collections; the
+** barriers keep them from pointing to white (young) objects. Old tables
+** touched by a barrier stay in 'grayagain' for one more cycle after
+** being turned black (TOUCHED2), so gray lists may hold black objects.
 */
 
 
@@ -79,6 +86,7 @@
 #define WHITE1BIT	1  /* object is white (type 1) */
 #define BLACKBIT	2  /* object is black */
 #define FINALIZEDBIT	3  /* object has been marked for finalization */
+/* bits 4-6 keep the age of the object (generational mode) */
 /* bit 7 is currently used by tests (luaL_checkmemory) */
 
 #define WHITEBITS	bit2mask(WHITE0BIT, WHITE1BIT)
@@ -101,6 +109,41 @@
 #define luaC_white(g)	cast(lu_byte, (g)->currentwhite & WHITEBITS)
 
 
+/* object age in generational mode */
+#define G_NEW		0	/* created in current cycle */
+#define G_SURVIVAL	1	/* created in previous cycle */
+#define G_OLD0		2	/* marked old by frw. barrier in this cycle */
+#define G_OLD1		3	/* first full cycle as old */
+#define G_OLD		4	/* really old object (not to be visited) */
+#define G_TOUCHED1	5	/* old object touched this cycle */
+#define G_TOUCHED2	6	/* old object touched in previous cycle */
+
+#define AGESHIFT	4
+#define AGEBITS		(7 << AGESHIFT)  /* all age bits (111 in bits 4-6) */
+
+#define getage(o)	(((o)->marked & AGEBITS) >> AGESHIFT)
+#define setage(o,a)  ((o)->marked = cast_byte(((o)->marked & (~AGEBITS)) | \
+                                              ((a) << AGESHIFT)))
+#define isold(o)	(getage(o) > G_SURVIVAL)
+
+#define changeage(o,f,t)  \
+	check_exp(getage(o) == (f), (o)->marked ^= (((f)^(t)) << AGESHIFT))
+
+
+/*
+** Default values for the generational mode: a minor collection runs
+** after the heap grows LUAI_GENMINORMUL% since the last collection, a
+** major one after it grows LUAI_GENMAJORMUL% since the last major one.
+*/
+#if !defined(LUAI_GENMINORMUL)
+#define LUAI_GENMINORMUL	20
+#endif
+
+#if !defined(LUAI_GENMAJORMUL)
+#define LUAI_GENMAJORMUL	100
+#endif
+
+
 /*
 ** Does one step of collection when debt becomes positive. 'pre'/'pos'
 ** allows some adjustments to be done only when needed. macro
@@ -131,9 +174,18 @@
 	(iscollectable((uv)->v) && !upisopen(uv)) ? \
          luaC_upvalbarrier_(L,uv) : cast_void(0))
 
+/*
+** barrier for operations that move entries inside a table (rehash,
+** collision resolution): a table being traversed in chunks may have
+** entries moved from its unvisited part to its visited part
+*/
+#define luaC_movebarrier(L,t) ( \
+	((t) == G(L)->travtable) ? luaC_barrierback_(L,t) : cast_void(0))
+
 LUAI_FUNC void luaC_fix (lua_State *L, GCObject *o);
 LUAI_FUNC void luaC_freeallobjects (lua_State *L);
 LUAI_FUNC void luaC_step (lua_State *L);
+LUAI_FUNC int luaC_steptime (lua_State *L, int us);
 LUAI_FUNC void luaC_runtilstate (lua_State *L, int statesmask);
 LUAI_FUNC void luaC_fullgc (lua_State *L, int isemergency);
 LUAI_FUNC GCObject *luaC_newobj (lua_State *L, int tt, size_t sz);
@@ -142,6 +194,30 @@ LUAI_FUNC void luaC_barrierback_ (lua_State *L, Table *o);
 LUAI_FUNC void luaC_upvalbarrier_ (lua_State *L, UpVal *uv);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUAI_FUNC void luaC_upvdeccount (lua_State *L, UpVal *uv);
+LUAI_FUNC void luaC_changemode (lua_State *L, int newmode);
+
+
+/* kinds of references reported by 'luaC_traverserefs' */
+#define LUAC_RMETA	0	/* metatable */
+#define LUAC_RKEY	1	/* key of a table entry */
+#define LUAC_RVALUE	2	/* value of a table entry ('key' is its key) */
+#define LUAC_RUPVAL	3	/* upvalue ('key' is its name or index) */
+#define LUAC_RUSER	4	/* user value */
+#define LUAC_RPROTO	5	/* prototype of a closure, or a nested one */
+#define LUAC_RCONST	6	/* constant of a prototype ('key' is its index) */
+#define LUAC_RSTACK	7	/* stack slot of a thread ('key' is its index) */
+#define LUAC_RNAME	8	/* source or variable name of a prototype */
+#define LUAC_RCACHE	9	/* closure cached by a prototype */
+#define LUAC_RPARENT	10	/* string holding the contents of a view */
+
+/* flag added to references that do not keep an object alive */
+#define LUAC_RWEAK	16
+
+typedef void (*luaC_RefVisitor) (void *ud, int kind, const TValue *key,
+                                 GCObject *o);
+
+LUAI_FUNC lu_mem luaC_traverserefs (global_State *g, GCObject *o,
+                                    luaC_RefVisitor f, void *ud);
 
 
 #endif
@@ -0,0 +1,221 @@
+/*
+** $Id: lgcfree.c $
+** Background freeing of memory blocks
+** See Copyright Notice in lua.h
+*/
+
+#define lgcfree_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "lgcfree.h"
+
+#if defined(LUA_USE_BGSWEEP)
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "lgc.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** The collector still unlinks dead objects (and removes dead strings
+** from the string table) itself, as that touches the state; it only
+** hands the blocks to be freed to a helper thread. Blocks are collected
+** in batches; full batches go to a lock-free stack ('queue') with a
+** compare-and-swap, and the helper takes the whole stack at once, so
+** there is a single consumer and no ABA problem. The mutex and the
+** condition variables are used only for sleeping: the collector wakes
+** the helper only when it is waiting on 'wake'. The collector accounts
+** for freed memory right away (in 'luaM_realloc_'), as if the block had
+** already been freed.
+*/
+
+
+typedef struct Batch {
+  struct Batch *next;
+  lua_Alloc frealloc;  /* allocator (and its data) for these blocks */
+  void *ud;
+  int n;  /* number of blocks */
+  struct {
+    void *block;
+    size_t osize;
+  } b[LUAI_BGBATCH];
+} Batch;
+
+
+typedef struct BgSweep {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;  /* signals new batches (or 'quit') */
+  pthread_cond_t idle;  /* signals that all batches were freed */
+  Batch *queue;  /* (atomic) batches waiting for the helper */
+  Batch *cur;  /* batch being filled (only used by the collector) */
+  int pending;  /* (atomic) batches queued or being freed */
+  int sleeping;  /* (atomic) helper is waiting on 'wake' */
+  int quit;
+} BgSweep;
+
+
+#define aload(x)	__atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define astore(x,v)	__atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+
+static void *helper (void *ud) {
+  BgSweep *bs = (BgSweep *)ud;
+  for (;;) {
+    Batch *b = __atomic_exchange_n(&bs->queue, NULL, __ATOMIC_SEQ_CST);
+    if (b == NULL) {  /* nothing to do? */
+      int quit;
+      pthread_mutex_lock(&bs->lock);
+      astore(bs->sleeping, 1);
+      while (aload(bs->queue) == NULL && !bs->quit)
+        pthread_cond_wait(&bs->wake, &bs->lock);
+      astore(bs->sleeping, 0);
+      quit = (bs->quit && aload(bs->queue) == NULL);
+      pthread_mutex_unlock(&bs->lock);
+      if (quit)
+        break;
+      continue;
+    }
+    while (b != NULL) {
+      Batch *next = b->next;
+      int i;
+      for (i = 0; i < b->n; i++)
+        (*b->frealloc)(b->ud, b->b[i].block, b->b[i].osize, 0);
+      free(b);
+      b = next;
+      if (__atomic_sub_fetch(&bs->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        pthread_mutex_lock(&bs->lock);
+        pthread_cond_broadcast(&bs->idle);
+        pthread_mutex_unlock(&bs->lock);
+      }
+    }
+  }
+  return NULL;
+}
+
+
+/* hand a batch to the helper */
+static void submit (BgSweep *bs, Batch *b) {
+  Batch *old = aload(bs->queue);
+  __atomic_add_fetch(&bs->pending, 1, __ATOMIC_SEQ_CST);
+  do {
+    b->next = old;
+  } while (!__atomic_compare_exchange_n(&bs->queue, &old, b, 1,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+  if (aload(bs->sleeping)) {  /* helper may be waiting? */
+    pthread_mutex_lock(&bs->lock);
+    pthread_cond_signal(&bs->wake);
+    pthread_mutex_unlock(&bs->lock);
+  }
+}
+
+
+/*
+** Queue 'block' to be freed by the helper. Returns false (and the caller
+** frees the block itself) if the helper is too far behind or there is
+** no memory for a new batch.
+*/
+int luaC_bgfree_ (global_State *g, void *block, size_t osize) {
+  BgSweep *bs = g->bgsweep;
+  Batch *b = bs->cur;
+  if (b != NULL && (b->frealloc != g->frealloc || b->ud != g->ud)) {
+    submit(bs, b);  /* allocator changed: close current batch */
+    b = bs->cur = NULL;
+  }
+  if (b == NULL) {
+    if (aload(bs->pending) >= LUAI_BGMAXPENDING)
+      return 0;
+    b = (Batch *)malloc(sizeof(Batch));
+    if (b == NULL)
+      return 0;
+    b->frealloc = g->frealloc;
+    b->ud = g->ud;
+    b->n = 0;
+    bs->cur = b;
+  }
+  b->b[b->n].block = block;
+  b->b[b->n].osize = osize;
+  if (++b->n == LUAI_BGBATCH) {
+    submit(bs, b);
+    bs->cur = NULL;
+  }
+  return 1;
+}
+
+
+/* hand the current (partial) batch to the helper */
+void luaC_bgflush (global_State *g) {
+  BgSweep *bs = g->bgsweep;
+  if (bs != NULL && bs->cur != NULL) {
+    submit(bs, bs->cur);
+    bs->cur = NULL;
+  }
+}
+
+
+/* wait until all queued blocks are freed */
+void luaC_bgsync (global_State *g) {
+  BgSweep *bs = g->bgsweep;
+  if (bs == NULL)
+    return;
+  luaC_bgflush(g);
+  pthread_mutex_lock(&bs->lock);
+  while (aload(bs->pending) > 0)
+    pthread_cond_wait(&bs->idle, &bs->lock);
+  pthread_mutex_unlock(&bs->lock);
+}
+
+
+static void destroy (BgSweep *bs) {
+  pthread_mutex_destroy(&bs->lock);
+  pthread_cond_destroy(&bs->wake);
+  pthread_cond_destroy(&bs->idle);
+  free(bs);
+}
+
+
+/*
+** Turn background freeing on or off; returns its previous state. When
+** turned off, waits for the helper to free everything queued.
+*/
+int luaC_setbgsweep (lua_State *L, int on) {
+  global_State *g = G(L);
+  BgSweep *bs = g->bgsweep;
+  int old = (bs != NULL);
+  on = (on != 0);
+  if (on == old)
+    return old;
+  if (!on) {
+    luaC_bgflush(g);
+    pthread_mutex_lock(&bs->lock);
+    bs->quit = 1;
+    pthread_cond_signal(&bs->wake);
+    pthread_mutex_unlock(&bs->lock);
+    pthread_join(bs->thread, NULL);  /* helper drains the queue first */
+    g->bgsweep = NULL;
+    destroy(bs);
+    return old;
+  }
+  bs = (BgSweep *)calloc(1, sizeof(BgSweep));
+  if (bs == NULL)
+    return old;
+  pthread_mutex_init(&bs->lock, NULL);
+  pthread_cond_init(&bs->wake, NULL);
+  pthread_cond_init(&bs->idle, NULL);
+  if (pthread_create(&bs->thread, NULL, helper, bs) != 0)
+    destroy(bs);
+  else
+    g->bgsweep = bs;
+  return old;
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+** $Id: lgcfree.h $
+** Background freeing of memory blocks
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lgcfree_h
+#define lgcfree_h
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** Background freeing is optional: build with LUA_USE_BGSWEEP (it needs
+** POSIX threads and the GCC '__atomic' builtins). Once turned on with
+** 'luaC_setbgsweep', the allocation function must be thread safe: it
+** is called by a helper thread to free blocks.
+*/
+#if defined(LUA_USE_BGSWEEP)
+#if !defined(LUA_USE_POSIX) || !defined(__GNUC__)
+#error "LUA_USE_BGSWEEP needs LUA_USE_POSIX and GCC atomic builtins"
+#endif
+#endif
+
+
+/* number of blocks handed to the helper at a time */
+#if !defined(LUAI_BGBATCH)
+#define LUAI_BGBATCH		256
+#endif
+
+/* batches waiting for the helper before blocks are freed in place */
+#if !defined(LUAI_BGMAXPENDING)
+#define LUAI_BGMAXPENDING	256
+#endif
+
+
+#if defined(LUA_USE_BGSWEEP)
+
+/* free 'block' in the background if that is on; true if it did */
+#define luaC_bgfree(g,b,s)  \
+	((g)->bgsweep != NULL && luaC_bgfree_(g, b, s))
+
+LUAI_FUNC int luaC_bgfree_ (global_State *g, void *block, size_t osize);
+LUAI_FUNC void luaC_bgflush (global_State *g);
+LUAI_FUNC void luaC_bgsync (global_State *g);
+LUAI_FUNC int luaC_setbgsweep (lua_State *L, int on);
+
+#define luaC_freebgsweep(L)	((void)luaC_setbgsweep(L, 0))
+
+#else
+
+#define luaC_bgfree(g,b,s)	0
+#define luaC_bgflush(g)		((void)0)
+#define luaC_bgsync(g)		((void)0)
+#define luaC_setbgsweep(L,on)	(-1)
+#define luaC_freebgsweep(L)	((void)0)
+
+#endif
+
+#endif
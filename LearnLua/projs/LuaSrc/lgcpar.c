@@ -0,0 +1,576 @@
+/*
+** $Id: lgcpar.c $
+** Parallel marking for the garbage collector
+** See Copyright Notice in lua.h
+*/
+
+#define lgcpar_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "lgcpar.h"
+
+#if defined(LUA_USE_PARMARK)
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lfunc.h"
+#include "lgc.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "lstring.h"
+#include "ltable.h"
+#include "ltm.h"
+
+
+/*
+** 'luaC_parmark' drains the gray list with the collector's thread and
+** the helpers. Each worker keeps a private stack of gray objects and a
+** deque (protected by a mutex) with its surplus, from which idle
+** workers steal. A worker owns an object after turning it from white
+** to gray with a compare-and-swap on 'marked'; only the owner traverses
+** it and turns it black, so those are the only concurrent writes to
+** shared objects. Objects whose traversal touches global lists or may
+** allocate (threads, weak tables, tables touched in generational mode,
+** tables whose metatable has not cached the absence of '__mode') are
+** left gray in a list of deferred objects, to be traversed by the
+** collector itself.
+*/
+
+
+/* size of the private stack of each worker */
+#define LOCALSIZE	256
+
+
+typedef struct Worker {
+  struct ParMark *pm;
+  pthread_t thread;
+  pthread_mutex_t lock;  /* protects the deque */
+  GCObject **deque;  /* shared work: entries in [head, tail) */
+  size_t head, tail, size;
+  size_t n;  /* number of entries in the deque (read without the lock) */
+  GCObject *local[LOCALSIZE];  /* private work (a stack) */
+  int nlocal;
+  GCObject *deferred;  /* objects left to the collector ('gclist') */
+  lu_mem traversed;  /* memory traversed */
+} Worker;
+
+
+typedef struct ParMark {
+  global_State *g;
+  int nw;  /* number of workers ('w[0]' is the collector) */
+  Worker *w;
+  pthread_mutex_t lock;  /* protects the fields below */
+  pthread_cond_t start;  /* signals a new round (or 'quit') */
+  pthread_cond_t done;  /* signals that a helper finished its round */
+  unsigned int round;
+  int finished;  /* number of helpers that finished current round */
+  int quit;
+  int nidle;  /* (atomic) number of workers without work */
+} ParMark;
+
+
+#define aload(x)	__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define astore(x,v)	__atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+#define pwhite(o)	(aload((o)->marked) & WHITEBITS)
+#define pblack(o)  \
+	((void)__atomic_fetch_or(&(o)->marked, bitmask(BLACKBIT), \
+	                         __ATOMIC_RELAXED))
+
+#define gnodelast(h)	gnode(h, cast(size_t, sizenode(h)))
+
+
+/* turn 'o' from white to gray; return true if this worker did it */
+static int claim (GCObject *o) {
+  lu_byte m = aload(o->marked);
+  while (m & WHITEBITS) {
+    if (__atomic_compare_exchange_n(&o->marked, &m,
+                                    cast_byte(m & ~WHITEBITS), 1,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      return 1;
+  }
+  return 0;
+}
+
+
+static GCObject **gclist (GCObject *o) {
+  switch (o->tt) {
+    case LUA_TTABLE: return &gco2t(o)->gclist;
+    case LUA_TLCL: return &gco2lcl(o)->gclist;
+    case LUA_TCCL: return &gco2ccl(o)->gclist;
+    case LUA_TTHREAD: return &gco2th(o)->gclist;
+    case LUA_TPROTO: return &gco2p(o)->gclist;
+    default: lua_assert(0); return NULL;
+  }
+}
+
+
+static void defer (Worker *w, GCObject *o) {
+  *gclist(o) = w->deferred;
+  w->deferred = o;
+}
+
+
+/*
+** {======================================================
+** Deques
+** =======================================================
+*/
+
+/* add 'n' entries to the deque of 'w' (which must be locked) */
+static int dqpush (Worker *w, GCObject **o, size_t n) {
+  if (w->tail + n > w->size) {
+    size_t live = w->tail - w->head;
+    if (live > 0 && w->head > 0)  /* ('deque' may be NULL otherwise) */
+      memmove(w->deque, w->deque + w->head, live * sizeof(GCObject *));
+    w->head = 0; w->tail = live;
+    if (live + n > w->size) {  /* still no room? */
+      size_t nsize = (w->size == 0) ? 1024 : w->size * 2;
+      GCObject **nd;
+      while (nsize < live + n) nsize *= 2;
+      nd = (GCObject **)realloc(w->deque, nsize * sizeof(GCObject *));
+      if (nd == NULL)
+        return 0;
+      w->deque = nd;
+      w->size = nsize;
+    }
+  }
+  if (n > 0)
+    memcpy(w->deque + w->tail, o, n * sizeof(GCObject *));
+  w->tail += n;
+  astore(w->n, w->tail - w->head);
+  return 1;
+}
+
+
+/* move the older half of the private stack to the deque */
+static void spill (Worker *w) {
+  int half = LOCALSIZE / 2;
+  int ok;
+  pthread_mutex_lock(&w->lock);
+  ok = dqpush(w, w->local, half);
+  pthread_mutex_unlock(&w->lock);
+  if (!ok) {  /* no memory? leave them to the collector */
+    int i;
+    for (i = 0; i < half; i++)
+      defer(w, w->local[i]);
+  }
+  memmove(w->local, w->local + half, (LOCALSIZE - half) * sizeof(GCObject *));
+  w->nlocal -= half;
+}
+
+
+static void push (Worker *w, GCObject *o) {
+  if (w->nlocal == LOCALSIZE)
+    spill(w);
+  w->local[w->nlocal++] = o;
+}
+
+
+/*
+** move up to 'max' entries from the deque of 'v' to the private stack
+** of 'w': the newest ones if 'v' is 'w', the oldest ones otherwise
+*/
+static int take (Worker *w, Worker *v, size_t max) {
+  size_t n;
+  pthread_mutex_lock(&v->lock);
+  n = v->tail - v->head;
+  if (v != w && n > 1) n = (n + 1) / 2;  /* steal half of it */
+  if (n > max) n = max;
+  if (v == w) {
+    v->tail -= n;
+    memcpy(w->local, v->deque + v->tail, n * sizeof(GCObject *));
+  }
+  else {
+    memcpy(w->local, v->deque + v->head, n * sizeof(GCObject *));
+    v->head += n;
+  }
+  astore(v->n, v->tail - v->head);
+  pthread_mutex_unlock(&v->lock);
+  w->nlocal = cast_int(n);
+  return (n > 0);
+}
+
+
+/* get next object to traverse, or NULL if no worker has work to spare */
+static GCObject *next (Worker *w) {
+  ParMark *pm = w->pm;
+  int i;
+  if (w->nlocal > 0)
+    return w->local[--w->nlocal];
+  if (aload(w->n) > 0 && take(w, w, LOCALSIZE / 2))
+    return w->local[--w->nlocal];
+  for (i = 1; i < pm->nw; i++) {  /* try to steal */
+    Worker *v = &pm->w[(cast_int(w - pm->w) + i) % pm->nw];
+    if (aload(v->n) > 0 && take(w, v, LOCALSIZE / 2))
+      return w->local[--w->nlocal];
+  }
+  return NULL;
+}
+
+
+static int anywork (ParMark *pm) {
+  int i;
+  for (i = 0; i < pm->nw; i++) {
+    if (aload(pm->w[i].n) > 0)
+      return 1;
+  }
+  return 0;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Traversal (see the serial versions in 'lgc.c')
+** =======================================================
+*/
+
+/* mark an object; strings and userdata are finished here */
+static void mark (Worker *w, GCObject *o) {
+  for (;;) {
+    if (!pwhite(o) || !claim(o))
+      return;  /* already marked (maybe by another worker) */
+    switch (o->tt) {
+      case LUA_TSHRSTR: {
+        pblack(o);
+        w->traversed += sizelstring(gco2ts(o)->shrlen);
+        return;
+      }
+      case LUA_TLNGSTR: {
+        TString *ts = gco2ts(o);
+        pblack(o);
+        w->traversed += sizelngstr(ts);
+        if (!isstrview(ts))
+          return;
+        o = obj2gco(strview(ts)->parent);  /* mark its parent */
+        break;
+      }
+      case LUA_TUSERDATA: {
+        TValue uvalue;
+        if (gco2u(o)->metatable)
+          mark(w, obj2gco(gco2u(o)->metatable));
+        pblack(o);
+        w->traversed += sizeudata(gco2u(o));
+        /* (no 'L': its liveness check would read colors) */
+        getuservalue(cast(lua_State *, NULL), gco2u(o), &uvalue);
+        if (!iscollectable(&uvalue))
+          return;
+        o = gcvalue(&uvalue);  /* mark its user value */
+        break;
+      }
+      case LUA_TTHREAD: {
+        defer(w, o);
+        return;
+      }
+      default: {
+        push(w, o);
+        return;
+      }
+    }
+  }
+}
+
+
+#define markvalue(w,o)	{ if (iscollectable(o)) mark(w, gcvalue(o)); }
+#define markobjectN(w,t)	{ if (t) mark(w, obj2gco(t)); }
+
+
+/*
+** a table can be traversed here if it is strong and is not in the
+** middle of the generational bookkeeping of 'genlink'
+*/
+static int plaintable (Table *h) {
+  Table *mt = h->metatable;
+  int age = getage(h);
+  if (age == G_TOUCHED1 || age == G_TOUCHED2)
+    return 0;
+  return (mt == NULL || (mt->flags & (1u << TM_MODE)));
+}
+
+
+static void traversetable (Worker *w, Table *h) {
+  Node *n, *limit;
+  Table *p;
+  unsigned int i;
+  markobjectN(w, h->metatable);
+  for (i = 0; i < h->sizearray; i++)  /* traverse array part */
+    markvalue(w, &h->array[i]);
+#if defined(LUA_USE_SHAPES)
+  for (i = 0; i < nfields(h); i++)  /* traverse fields */
+    markvalue(w, gfield(h, i));
+#endif
+  for (p = h; p != NULL; p = nextpart(h, p)) {  /* traverse hash part */
+    for (n = gnode(p, 0), limit = gnodelast(p); n < limit; n++) {
+      if (ttisnil(gval(n))) {  /* entry is empty? */
+        const TValue *k = gkey(n);
+        if (iscollectable(k) && pwhite(gcvalue(k)))
+          setdeadvalue(wgkey(n));  /* unused and unmarked key; remove it */
+      }
+      else {
+        markvalue(w, gkey(n));
+        markvalue(w, gval(n));
+      }
+    }
+  }
+  w->traversed += sizeof(Table) + sizeof(TValue) * h->sizearray +
+                  sizeof(TValue) * sizefields(h) + sizeof(Node) * cast(size_t, allocsizenode(h)) +
+                  sizeof(Node) * cast(size_t, sizeoldpart(h));
+}
+
+
+static void traverseproto (Worker *w, Proto *f) {
+  int i;
+  if (f->cache &&
+      (pwhite(obj2gco(f->cache)) || w->pm->g->gckind == KGC_GEN))
+    f->cache = NULL;  /* allow cache to be collected */
+  markobjectN(w, f->source);
+  for (i = 0; i < f->sizek; i++)  /* mark literals */
+    markvalue(w, &f->k[i]);
+  for (i = 0; i < f->sizeupvalues; i++)  /* mark upvalue names */
+    markobjectN(w, f->upvalues[i].name);
+  for (i = 0; i < f->sizep; i++)  /* mark nested protos */
+    markobjectN(w, f->p[i]);
+  for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
+    markobjectN(w, f->locvars[i].varname);
+  w->traversed += sizeof(Proto) + sizeof(Instruction) * f->sizecode +
+                  (f->ic ? sizeof(FieldCache) * f->sizecode : 0) +
+                  sizeof(Proto *) * f->sizep +
+                  sizeof(TValue) * f->sizek +
+                  sizeof(int) * f->sizelineinfo +
+                  sizeof(LocVar) * f->sizelocvars +
+                  sizeof(Upvaldesc) * f->sizeupvalues;
+}
+
+
+/*
+** values of open upvalues are always marked here, instead of being
+** left to 'remarkupvals' (marking them early is only conservative)
+*/
+static void traverseLclosure (Worker *w, LClosure *cl) {
+  int i;
+  markobjectN(w, cl->p);  /* mark its prototype */
+  for (i = 0; i < cl->nupvalues; i++) {  /* mark its upvalues */
+    UpVal *uv = cl->upvals[i];
+    if (uv != NULL)
+      markvalue(w, uv->v);
+  }
+  w->traversed += sizeLclosure(cl->nupvalues);
+}
+
+
+static void traverseCclosure (Worker *w, CClosure *cl) {
+  int i;
+  for (i = 0; i < cl->nupvalues; i++)  /* mark its upvalues */
+    markvalue(w, &cl->upvalue[i]);
+  w->traversed += sizeCclosure(cl->nupvalues);
+}
+
+
+static void traverse (Worker *w, GCObject *o) {
+  switch (o->tt) {
+    case LUA_TTABLE: {
+      if (!plaintable(gco2t(o))) {
+        defer(w, o);
+        return;
+      }
+      pblack(o);
+      traversetable(w, gco2t(o));
+      break;
+    }
+    case LUA_TLCL: pblack(o); traverseLclosure(w, gco2lcl(o)); break;
+    case LUA_TCCL: pblack(o); traverseCclosure(w, gco2ccl(o)); break;
+    case LUA_TPROTO: pblack(o); traverseproto(w, gco2p(o)); break;
+    default: lua_assert(0);
+  }
+}
+
+
+/*
+** Work until no worker has anything left. A worker without work counts
+** itself idle; as only its owner adds entries to a deque, all deques
+** are empty (and stay empty) once all workers are idle.
+*/
+static void work (Worker *w) {
+  ParMark *pm = w->pm;
+  for (;;) {
+    GCObject *o;
+    while ((o = next(w)) != NULL)
+      traverse(w, o);
+    __atomic_add_fetch(&pm->nidle, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+      if (__atomic_load_n(&pm->nidle, __ATOMIC_SEQ_CST) == pm->nw)
+        return;  /* everybody is idle: round is over */
+      if (anywork(pm)) {  /* somebody has work to spare? */
+        __atomic_sub_fetch(&pm->nidle, 1, __ATOMIC_SEQ_CST);
+        break;  /* try to steal it */
+      }
+      sched_yield();
+    }
+  }
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Rounds and helper threads
+** =======================================================
+*/
+
+static void *helper (void *ud) {
+  Worker *w = (Worker *)ud;
+  ParMark *pm = w->pm;
+  unsigned int round = 0;  /* (helpers are created before any round) */
+  pthread_mutex_lock(&pm->lock);
+  for (;;) {
+    while (!pm->quit && pm->round == round)
+      pthread_cond_wait(&pm->start, &pm->lock);
+    if (pm->quit)
+      break;
+    round = pm->round;
+    pthread_mutex_unlock(&pm->lock);
+    work(w);
+    pthread_mutex_lock(&pm->lock);
+    pm->finished++;
+    pthread_cond_signal(&pm->done);
+  }
+  pthread_mutex_unlock(&pm->lock);
+  return NULL;
+}
+
+
+/*
+** Traverse all objects reachable from the gray list, which becomes
+** empty. Returns the gray objects left to the collector (linked by
+** 'gclist'); adds the memory traversed to 'g->GCmemtrav'.
+*/
+GCObject *luaC_parmark (global_State *g) {
+  ParMark *pm = g->parmark;
+  GCObject *deferred = NULL;
+  int i = 0;
+  lua_assert(pm != NULL);
+  while (g->gray != NULL) {  /* distribute gray objects among workers */
+    GCObject *o = g->gray;
+    Worker *w = &pm->w[i];
+    g->gray = *gclist(o);
+    if (o->tt == LUA_TTHREAD || !dqpush(w, &o, 1))
+      defer(&pm->w[0], o);
+    i = (i + 1) % pm->nw;
+  }
+  pthread_mutex_lock(&pm->lock);
+  pm->nidle = 0;
+  pm->finished = 0;
+  pm->round++;
+  pthread_cond_broadcast(&pm->start);
+  pthread_mutex_unlock(&pm->lock);
+  work(&pm->w[0]);
+  pthread_mutex_lock(&pm->lock);
+  while (pm->finished < pm->nw - 1)  /* wait for all helpers */
+    pthread_cond_wait(&pm->done, &pm->lock);
+  pthread_mutex_unlock(&pm->lock);
+  for (i = 0; i < pm->nw; i++) {  /* collect results */
+    Worker *w = &pm->w[i];
+    lua_assert(w->nlocal == 0 && w->head == w->tail);
+    g->GCmemtrav += w->traversed;
+    w->traversed = 0;
+    while (w->deferred != NULL) {
+      GCObject *o = w->deferred;
+      w->deferred = *gclist(o);
+      *gclist(o) = deferred;
+      deferred = o;
+    }
+  }
+  return deferred;
+}
+
+
+static void stophelpers (ParMark *pm) {
+  int i;
+  pthread_mutex_lock(&pm->lock);
+  pm->quit = 1;
+  pthread_cond_broadcast(&pm->start);
+  pthread_mutex_unlock(&pm->lock);
+  for (i = 1; i < pm->nw; i++)
+    pthread_join(pm->w[i].thread, NULL);
+  for (i = 0; i < pm->nw; i++) {
+    pthread_mutex_destroy(&pm->w[i].lock);
+    free(pm->w[i].deque);
+  }
+  pthread_mutex_destroy(&pm->lock);
+  pthread_cond_destroy(&pm->start);
+  pthread_cond_destroy(&pm->done);
+  free(pm->w);
+  free(pm);
+}
+
+
+/*
+** Set the number of helper threads (0 turns parallel marking off).
+** Returns the previous number. (Helpers are plain threads, allocated
+** outside the Lua allocator; if some cannot be started, runs with the
+** ones that could.)
+*/
+int luaC_setparmark (lua_State *L, int n) {
+  global_State *g = G(L);
+  ParMark *pm = g->parmark;
+  int old = (pm == NULL) ? 0 : pm->nw - 1;
+  int i;
+  if (n < 0) n = 0;
+  else if (n > LUAI_MAXPARMARK) n = LUAI_MAXPARMARK;
+  if (n == old)
+    return old;
+  if (pm != NULL) {
+    g->parmark = NULL;
+    stophelpers(pm);
+  }
+  if (n == 0)
+    return old;
+  pm = (ParMark *)calloc(1, sizeof(ParMark));
+  if (pm == NULL)
+    return old;
+  pm->w = (Worker *)calloc(n + 1, sizeof(Worker));
+  if (pm->w == NULL) {
+    free(pm);
+    return old;
+  }
+  pm->g = g;
+  pthread_mutex_init(&pm->lock, NULL);
+  pthread_cond_init(&pm->start, NULL);
+  pthread_cond_init(&pm->done, NULL);
+  pm->nw = 1;
+  pm->w[0].pm = pm;
+  pthread_mutex_init(&pm->w[0].lock, NULL);
+  for (i = 1; i <= n; i++) {
+    Worker *w = &pm->w[i];
+    w->pm = pm;
+    pthread_mutex_init(&w->lock, NULL);
+    if (pthread_create(&w->thread, NULL, helper, w) != 0) {
+      pthread_mutex_destroy(&w->lock);
+      break;
+    }
+    pm->nw++;
+  }
+  if (pm->nw == 1)  /* no helper could be started? */
+    stophelpers(pm);
+  else
+    g->parmark = pm;
+  return old;
+}
+
+/* }====================================================== */
+
+#endif
@@ -0,0 +1,55 @@
+/*
+** $Id: lgcpar.h $
+** Parallel marking for the garbage collector
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lgcpar_h
+#define lgcpar_h
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** Parallel marking is optional: build with LUA_USE_PARMARK (it needs
+** POSIX threads and the GCC '__atomic' builtins). It is used only by
+** the atomic step and by full collections, when the mutator is
+** stopped, and only after 'luaC_setparmark' starts some helpers.
+** The helpers and their work deques are allocated with 'calloc' and
+** 'realloc', as helper threads cannot call the state's allocator: that
+** memory is not counted in 'totalbytes' (nor against the memory limit).
+*/
+#if defined(LUA_USE_PARMARK)
+#if !defined(LUA_USE_POSIX) || !defined(__GNUC__)
+#error "LUA_USE_PARMARK needs LUA_USE_POSIX and GCC atomic builtins"
+#endif
+#endif
+
+
+/* gray objects traversed serially before starting a parallel round */
+#if !defined(LUAI_PARMARKMIN)
+#define LUAI_PARMARKMIN		1000
+#endif
+
+/* maximum number of helper threads */
+#if !defined(LUAI_MAXPARMARK)
+#define LUAI_MAXPARMARK		64
+#endif
+
+
+#if defined(LUA_USE_PARMARK)
+
+LUAI_FUNC GCObject *luaC_parmark (global_State *g);
+LUAI_FUNC int luaC_setparmark (lua_State *L, int n);
+
+#define luaC_freeparmark(L)	((void)luaC_setparmark(L, 0))
+
+#else
+
+#define luaC_setparmark(L,n)	(-1)
+#define luaC_freeparmark(L)	((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,271 @@
+/*
+** $Id: lhash.c $
+** Full-content string hash
+** See Copyright Notice in lua.h
+*/
+
+#define lhash_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "lhash.h"
+
+#if defined(LUA_USE_FULLHASH)
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lstring.h"
+
+
+/*
+** The hash reads every byte of the string. Up to LUAI_HASHSTRIPES
+** bytes it follows wyhash: 16 bytes at a time (48 for medium strings,
+** in three independent lanes) go through a 64x64->128-bit multiply
+** folded to 64 bits ('mix'). Longer strings follow XXH3: 64-byte
+** stripes are combined with a 'secret' into 8 64-bit accumulators,
+** using only 32x32->64-bit multiplies, which SSE2, AVX2 and NEON do on
+** 2 or 4 lanes at once; the accumulators are scrambled every 16 stripes
+** and then mixed down. All kernels compute the same values.
+*/
+
+
+#define LU64(x)		UINT64_C(x)
+
+#define P0	LU64(0xa0761d6478bd642f)
+#define P1	LU64(0xe7037ed1a0b428db)
+#define P2	LU64(0x8ebc6af09c88c6e3)
+#define P3	LU64(0x589965cc75374cc3)
+
+#define STRIPE		64	/* bytes in a stripe */
+#define NACC		8	/* number of accumulators */
+#define BLOCKSTRIPES	16	/* stripes between scrambles */
+
+
+/* keys for stripe 'i' of a block are 'secret[i..i+NACC-1]' */
+static const uint64_t secret[BLOCKSTRIPES + NACC] = {
+  LU64(0x6917734ccfacffe9), LU64(0xd4b54b8511d68f6d), LU64(0x33063ef33cda0d27),
+  LU64(0x9c307e3d19edb87b), LU64(0xb5e1a07b114a5d56), LU64(0xac459fa7d6cf2bf4),
+  LU64(0x25ac766ac04ae5a2), LU64(0xe714333346770de4), LU64(0xb15adcefcbccef2a),
+  LU64(0xcc3fa07375f406b6), LU64(0x795cd83d16be06cb), LU64(0x78ef67b4f70a6bfe),
+  LU64(0x57c8600f1dfac57e), LU64(0x1a5cca4af9124c0b), LU64(0xb5f123b6ae0fc9cf),
+  LU64(0x19f45ecc81aca0d0), LU64(0xf2e8f749e29f876f), LU64(0x7bb0d385c849693b),
+  LU64(0x68fbce10a1b7292f), LU64(0xe3d18d53955c6572), LU64(0xb64b2973cbab95d6),
+  LU64(0x8b3140856225164d), LU64(0x4ad0a8bee3a45ee3), LU64(0x37ee439fb4f5f946),
+};
+
+
+static uint64_t rd8 (const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+
+static uint64_t rd4 (const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+
+/* 64x64->128-bit product of 'a' and 'b', folded to 64 bits */
+static uint64_t mix (uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 r = (unsigned __int128)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+  uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif
+}
+
+
+/*
+** {======================================================
+** Stripe kernels: accumulate 'n' stripes from 'p', using the keys
+** 'k[i..i+NACC-1]' for stripe 'i'
+** =======================================================
+*/
+
+#if defined(__AVX2__) && !defined(LUAI_HASHSCALAR)
+
+#include <immintrin.h>
+
+static void accumulate (uint64_t *acc, const unsigned char *p, int n,
+                        const uint64_t *key) {
+  __m256i a0 = _mm256_loadu_si256((const __m256i *)acc);
+  __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + 4));
+  int i;
+  for (i = 0; i < n; i++, p += STRIPE) {
+    const uint64_t *k = key + i;
+    __m256i d0 = _mm256_loadu_si256((const __m256i *)p);
+    __m256i d1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+    __m256i k0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i *)k));
+    __m256i k1 = _mm256_xor_si256(d1,
+                   _mm256_loadu_si256((const __m256i *)(k + 4)));
+    a0 = _mm256_add_epi64(a0, _mm256_mul_epu32(k0, _mm256_srli_epi64(k0, 32)));
+    a1 = _mm256_add_epi64(a1, _mm256_mul_epu32(k1, _mm256_srli_epi64(k1, 32)));
+    a0 = _mm256_add_epi64(a0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1,0,3,2)));
+    a1 = _mm256_add_epi64(a1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1,0,3,2)));
+  }
+  _mm256_storeu_si256((__m256i *)acc, a0);
+  _mm256_storeu_si256((__m256i *)(acc + 4), a1);
+}
+
+#elif defined(__SSE2__) && !defined(LUAI_HASHSCALAR)
+
+#include <emmintrin.h>
+
+static void accumulate (uint64_t *acc, const unsigned char *p, int n,
+                        const uint64_t *key) {
+  __m128i a[NACC / 2];
+  int i, j;
+  for (j = 0; j < NACC / 2; j++)
+    a[j] = _mm_loadu_si128((const __m128i *)(acc + 2 * j));
+  for (i = 0; i < n; i++, p += STRIPE) {
+    const uint64_t *k = key + i;
+    for (j = 0; j < NACC / 2; j++) {
+      __m128i d = _mm_loadu_si128((const __m128i *)(p + 16 * j));
+      __m128i dk = _mm_xor_si128(d, _mm_loadu_si128((const __m128i *)(k + 2 * j)));
+      a[j] = _mm_add_epi64(a[j], _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32)));
+      a[j] = _mm_add_epi64(a[j], _mm_shuffle_epi32(d, _MM_SHUFFLE(1,0,3,2)));
+    }
+  }
+  for (j = 0; j < NACC / 2; j++)
+    _mm_storeu_si128((__m128i *)(acc + 2 * j), a[j]);
+}
+
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && \
+      !defined(LUAI_HASHSCALAR)
+
+#include <arm_neon.h>
+
+static void accumulate (uint64_t *acc, const unsigned char *p, int n,
+                        const uint64_t *key) {
+  uint64x2_t a[NACC / 2];
+  int i, j;
+  for (j = 0; j < NACC / 2; j++)
+    a[j] = vld1q_u64(acc + 2 * j);
+  for (i = 0; i < n; i++, p += STRIPE) {
+    const uint64_t *k = key + i;
+    for (j = 0; j < NACC / 2; j++) {
+      uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(p + 16 * j));
+      uint64x2_t dk = veorq_u64(d, vld1q_u64(k + 2 * j));
+      a[j] = vmlal_u32(a[j], vmovn_u64(dk), vshrn_n_u64(dk, 32));
+      a[j] = vaddq_u64(a[j], vextq_u64(d, d, 1));
+    }
+  }
+  for (j = 0; j < NACC / 2; j++)
+    vst1q_u64(acc + 2 * j, a[j]);
+}
+
+#else
+
+static void accumulate (uint64_t *acc, const unsigned char *p, int n,
+                        const uint64_t *key) {
+  int i, j;
+  for (i = 0; i < n; i++, p += STRIPE) {
+    const uint64_t *k = key + i;
+    for (j = 0; j < NACC; j++) {
+      uint64_t d = rd8(p + 8 * j);
+      uint64_t dk = d ^ k[j];
+      acc[j ^ 1] += d;  /* swapped lanes */
+      acc[j] += (dk & 0xffffffffu) * (dk >> 32);
+    }
+  }
+}
+
+#endif
+
+/* }====================================================== */
+
+
+static void scramble (uint64_t *acc) {
+  int j;
+  for (j = 0; j < NACC; j++) {
+    uint64_t a = acc[j];
+    a ^= a >> 47;
+    a ^= secret[BLOCKSTRIPES + j];
+    acc[j] = a * LU64(0x9e3779b1);
+  }
+}
+
+
+static uint64_t stripehash (const unsigned char *p, size_t l, uint64_t seed) {
+  uint64_t acc[NACC];
+  size_t nstripes = (l - 1) / STRIPE;  /* full stripes before the last */
+  const unsigned char *last = p + l - STRIPE;  /* (may overlap others) */
+  uint64_t h = (uint64_t)l * P1;
+  int j;
+  lua_assert(l >= STRIPE);
+  acc[0] = P0 ^ seed; acc[1] = P1; acc[2] = P2; acc[3] = P3 ^ seed;
+  acc[4] = P3; acc[5] = P2 ^ seed; acc[6] = P1 ^ seed; acc[7] = P0;
+  for (; nstripes >= BLOCKSTRIPES; nstripes -= BLOCKSTRIPES) {
+    accumulate(acc, p, BLOCKSTRIPES, secret);
+    scramble(acc);
+    p += BLOCKSTRIPES * STRIPE;
+  }
+  accumulate(acc, p, (int)nstripes, secret);
+  accumulate(acc, last, 1, secret + 7);
+  for (j = 0; j < NACC; j += 2)
+    h += mix(acc[j] ^ secret[j + 3], acc[j + 1] ^ secret[j + 11]);
+  return h;
+}
+
+
+unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
+  const unsigned char *p = (const unsigned char *)str;
+  uint64_t s = seed ^ P0;
+  uint64_t a, b;
+  if (l <= 16) {
+    if (l >= 4) {
+      size_t m = (l >> 3) << 2;  /* 0 or 4 */
+      a = (rd4(p) << 32) | rd4(p + m);
+      b = (rd4(p + l - 4) << 32) | rd4(p + l - 4 - m);
+    }
+    else if (l > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[l >> 1] << 8) | p[l - 1];
+      b = 0;
+    }
+    else
+      a = b = 0;
+  }
+  else if (l >= LUAI_HASHSTRIPES) {
+    a = stripehash(p, l, s);
+    b = P2;
+  }
+  else {
+    size_t i = l;
+    if (i > 48) {  /* three lanes */
+      uint64_t s1 = s, s2 = s;
+      do {
+        s = mix(rd8(p) ^ P1, rd8(p + 8) ^ s);
+        s1 = mix(rd8(p + 16) ^ P2, rd8(p + 24) ^ s1);
+        s2 = mix(rd8(p + 32) ^ P3, rd8(p + 40) ^ s2);
+        p += 48; i -= 48;
+      } while (i > 48);
+      s ^= s1 ^ s2;
+    }
+    while (i > 16) {
+      s = mix(rd8(p) ^ P1, rd8(p + 8) ^ s);
+      p += 16; i -= 16;
+    }
+    a = rd8(p + i - 16);  /* last 16 bytes (may overlap) */
+    b = rd8(p + i - 8);
+  }
+  a = mix(a ^ P1, b ^ s);
+  a = mix(a ^ P0 ^ l, a ^ P1);
+  return (unsigned int)(a ^ (a >> 32));
+}
+
+#endif
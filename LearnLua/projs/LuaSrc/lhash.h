@@ -0,0 +1,35 @@
+/*
+** $Id: lhash.h $
+** Full-content string hash
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lhash_h
+#define lhash_h
+
+#include "llimits.h"
+
+
+/*
+** The full-content hash is optional: build with LUA_USE_FULLHASH (it
+** needs a 64-bit integer type). It then replaces the sampling
+** 'luaS_hash' of 'lstring.c'.
+*/
+#if defined(LUA_USE_FULLHASH)
+#if defined(LUA_USE_C89)
+#error "LUA_USE_FULLHASH needs C99 ('uint64_t')"
+#endif
+#endif
+
+
+/*
+** Strings with at least this length are hashed in 64-byte stripes,
+** with SIMD instructions when possible (SSE2/AVX2 or NEON); shorter
+** ones with a scalar loop of 64-bit multiplications.
+*/
+#if !defined(LUAI_HASHSTRIPES)
+#define LUAI_HASHSTRIPES	256
+#endif
+
+
+#endif
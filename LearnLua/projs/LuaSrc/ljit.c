@@ -0,0 +1,1209 @@
+/*
+** $Id: ljit.c $
+** Baseline compiler from Lua bytecode to x86-64 machine code
+** See Copyright Notice in lua.h
+*/
+
+#define ljit_c
+#define LUA_CORE
+#define _DEFAULT_SOURCE  /* for MAP_ANONYMOUS */
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "ljit.h"
+
+#if defined(LUA_USE_JIT)
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ldebug.h"
+#include "ldo.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lstate.h"
+#include "ltable.h"
+#include "ltm.h"
+#include "lvm.h"
+
+
+/*
+** The compiler translates each instruction of a hot function into a
+** template: a few simple opcodes (moves, loads, integer arithmetic,
+** integer comparisons and integer 'for' loops) are done inline; all
+** others call a helper with the same semantics as the corresponding
+** case in 'luaV_execute'. Compiled code keeps 'L', 'ci' and the frame
+** base in callee-saved registers and jumps directly between
+** instructions, so there is no dispatch and no operand decoding.
+**
+** Compiled code always leaves 'ci->u.l.savedpc' pointing to the next
+** instruction before anything that may raise an error, yield or run a
+** metamethod, so the interpreter can take over at any of those points.
+** It returns to the interpreter (LUAJ_EXIT) for opcodes it does not
+** handle (OP_TAILCALL, OP_CLOSURE) and as soon as a hook is set; it
+** returns LUAJ_CALL after setting up a call to a Lua function, which
+** the interpreter then runs ('luaV_execute' reenters compiled code when
+** the call returns), and LUAJ_RETURN after finishing its own call.
+*/
+
+
+/* status returned by helpers; JIT_EXIT/JIT_CALL also leave the code */
+#define JIT_NEXT	0	/* go to next instruction */
+#define JIT_JUMP	1	/* do the jump of the instruction */
+#define JIT_EXIT	LUAJ_EXIT
+#define JIT_CALL	LUAJ_CALL
+#define JIT_RETURN	LUAJ_RETURN
+
+
+/* maximum size of the code for one instruction */
+#define MAXOPCODE	256
+
+/* maximum number of jumps to other instructions in one template */
+#define MAXOPFIX	4
+
+
+typedef int (*JitHelper) (lua_State *L, Instruction i);
+
+typedef int (*JitEnter) (lua_State *L, CallInfo *ci, void *target);
+
+
+typedef struct JitCode {
+  lu_byte *mem;  /* executable memory */
+  size_t size;  /* size of 'mem' */
+  int sizecode;  /* number of instructions (size of 'labels') */
+  int *labels;  /* offset in 'mem' of the code of each instruction */
+} JitCode;
+
+/* size of a JitCode block for 'n' instructions (with room for fixups) */
+#define jitsize(n)	(sizeof(JitCode) + (n) * (1 + 2 * MAXOPFIX) * sizeof(int))
+
+
+/*
+** {======================================================
+** Helpers (copies of the corresponding cases in 'luaV_execute')
+** =======================================================
+*/
+
+#define RA(i)	(base+GETARG_A(i))
+#define RB(i)	(base+GETARG_B(i))
+#define RC(i)	(base+GETARG_C(i))
+#define RKB(i)	(ISK(GETARG_B(i)) ? k+INDEXK(GETARG_B(i)) : base+GETARG_B(i))
+#define RKC(i)	(ISK(GETARG_C(i)) ? k+INDEXK(GETARG_C(i)) : base+GETARG_C(i))
+
+
+/* local copies of the state of the running frame */
+#define jitframe(L) \
+  CallInfo *ci = L->ci; \
+  LClosure *cl = clLvalue(ci->func); \
+  TValue *k = cl->p->k; \
+  StkId base = ci->u.l.base
+
+#define Protect(x)	{ {x;}; base = ci->u.l.base; }
+
+#define checkGC(L,c)  \
+	{ luaC_condGC(L, L->top = (c), L->top = ci->top); \
+	  luai_threadyield(L); }
+
+/* finish a helper, going back to the interpreter if a hook was set */
+#define jitnext(L)	return ((L)->hookmask ? JIT_EXIT : JIT_NEXT)
+#define jitjump(L)	return ((L)->hookmask ? JIT_EXIT : JIT_JUMP)
+
+
+/*
+** finish a test instruction: skip the jump that follows it, or do
+** that jump
+*/
+static int jittest (lua_State *L, CallInfo *ci, int skip) {
+  if (skip) {
+    ci->u.l.savedpc++;
+    jitnext(L);
+  }
+  else {
+    Instruction i = *ci->u.l.savedpc;
+    int a = GETARG_A(i);
+    if (a != 0) luaF_close(L, ci->u.l.base + a - 1);
+    ci->u.l.savedpc += GETARG_sBx(i) + 1;
+    jitjump(L);
+  }
+}
+
+
+static void jitgettable (lua_State *L, CallInfo *ci, const TValue *t,
+                         TValue *key, StkId ra, int kcache) {
+  const TValue *slot;
+  if (!ttistable(t)) slot = NULL;
+  else if (kcache && ttisshrstring(key)) {
+    LClosure *cl = clLvalue(ci->func);
+    FieldCache *fc = &cl->p->ic[ci->u.l.savedpc - cl->p->code - 1];
+    slot = luaH_getshortstrcached(hvalue(t), tsvalue(key), fc);
+  }
+  else slot = luaH_get(hvalue(t), key);
+  if (slot != NULL && !ttisnil(slot)) { setobj2s(L, ra, slot); }
+  else luaV_finishget(L, t, key, ra, slot);
+}
+
+
+static void jitsettable (lua_State *L, const TValue *t, TValue *key,
+                         TValue *val) {
+  const TValue *slot;
+  if (!luaV_fastset(L, t, key, slot, luaH_get, val))
+    luaV_finishset(L, t, key, val, slot);
+}
+
+
+static int j_loadkx (lua_State *L, Instruction i) {
+  jitframe(L);
+  setobj2s(L, RA(i), k + GETARG_Ax(*ci->u.l.savedpc++));
+  jitnext(L);
+}
+
+
+static int j_getupval (lua_State *L, Instruction i) {
+  jitframe(L);
+  (void)k;
+  setobj2s(L, RA(i), cl->upvals[GETARG_B(i)]->v);
+  jitnext(L);
+}
+
+
+static int j_gettabup (lua_State *L, Instruction i) {
+  jitframe(L);
+  jitgettable(L, ci, cl->upvals[GETARG_B(i)]->v, RKC(i), RA(i),
+              ISK(GETARG_C(i)));
+  jitnext(L);
+}
+
+
+static int j_gettable (lua_State *L, Instruction i) {
+  jitframe(L);
+  jitgettable(L, ci, RB(i), RKC(i), RA(i), ISK(GETARG_C(i)));
+  jitnext(L);
+}
+
+
+static int j_settabup (lua_State *L, Instruction i) {
+  jitframe(L);
+  jitsettable(L, cl->upvals[GETARG_A(i)]->v, RKB(i), RKC(i));
+  jitnext(L);
+}
+
+
+static int j_setupval (lua_State *L, Instruction i) {
+  jitframe(L);
+  UpVal *uv = cl->upvals[GETARG_B(i)];
+  (void)k;
+  setobj(L, uv->v, RA(i));
+  luaC_upvalbarrier(L, uv);
+  jitnext(L);
+}
+
+
+static int j_settable (lua_State *L, Instruction i) {
+  jitframe(L);
+  jitsettable(L, RA(i), RKB(i), RKC(i));
+  jitnext(L);
+}
+
+
+static int j_newtable (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  Table *t = luaH_new(L);
+  (void)k;
+  sethvalue(L, ra, t);
+  if (b != 0 || c != 0)
+    luaH_resize(L, t, luaO_fb2int(b), luaO_fb2int(c));
+  checkGC(L, ra + 1);
+  jitnext(L);
+}
+
+
+static int j_self (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  StkId rb = RB(i);
+  setobjs2s(L, ra + 1, rb);
+  jitgettable(L, ci, rb, RKC(i), ra, ISK(GETARG_C(i)));
+  jitnext(L);
+}
+
+
+/* arithmetic with integer and float versions */
+#define jitarith(name,iop,fop,tm) \
+static int name (lua_State *L, Instruction i) { \
+  jitframe(L); \
+  StkId ra = RA(i); \
+  TValue *rb = RKB(i); \
+  TValue *rc = RKC(i); \
+  lua_Number nb; lua_Number nc; \
+  if (ttisinteger(rb) && ttisinteger(rc)) { \
+    lua_Integer ib = ivalue(rb); lua_Integer ic = ivalue(rc); \
+    setivalue(ra, iop); \
+  } \
+  else if (tonumber(rb, &nb) && tonumber(rc, &nc)) { \
+    fop; \
+  } \
+  else { Protect(luaT_trybinTM(L, rb, rc, ra, tm)); } \
+  jitnext(L); \
+}
+
+/* arithmetic with only a float version */
+#define jitarithf(name,fop,tm) \
+static int name (lua_State *L, Instruction i) { \
+  jitframe(L); \
+  StkId ra = RA(i); \
+  TValue *rb = RKB(i); \
+  TValue *rc = RKC(i); \
+  lua_Number nb; lua_Number nc; \
+  if (tonumber(rb, &nb) && tonumber(rc, &nc)) { \
+    setfltvalue(ra, fop); \
+  } \
+  else { Protect(luaT_trybinTM(L, rb, rc, ra, tm)); } \
+  jitnext(L); \
+}
+
+/* bitwise operations */
+#define jitbitwise(name,iop,tm) \
+static int name (lua_State *L, Instruction i) { \
+  jitframe(L); \
+  StkId ra = RA(i); \
+  TValue *rb = RKB(i); \
+  TValue *rc = RKC(i); \
+  lua_Integer ib; lua_Integer ic; \
+  if (tointeger(rb, &ib) && tointeger(rc, &ic)) { \
+    setivalue(ra, iop); \
+  } \
+  else { Protect(luaT_trybinTM(L, rb, rc, ra, tm)); } \
+  jitnext(L); \
+}
+
+jitarith(j_add, intop(+, ib, ic),
+         setfltvalue(ra, luai_numadd(L, nb, nc)), TM_ADD)
+jitarith(j_sub, intop(-, ib, ic),
+         setfltvalue(ra, luai_numsub(L, nb, nc)), TM_SUB)
+jitarith(j_mul, intop(*, ib, ic),
+         setfltvalue(ra, luai_nummul(L, nb, nc)), TM_MUL)
+jitarith(j_mod, luaV_mod(L, ib, ic),
+         lua_Number m; luai_nummod(L, nb, nc, m); setfltvalue(ra, m), TM_MOD)
+jitarith(j_idiv, luaV_div(L, ib, ic),
+         setfltvalue(ra, luai_numidiv(L, nb, nc)), TM_IDIV)
+jitarithf(j_div, luai_numdiv(L, nb, nc), TM_DIV)
+jitarithf(j_pow, luai_numpow(L, nb, nc), TM_POW)
+jitbitwise(j_band, intop(&, ib, ic), TM_BAND)
+jitbitwise(j_bor, intop(|, ib, ic), TM_BOR)
+jitbitwise(j_bxor, intop(^, ib, ic), TM_BXOR)
+jitbitwise(j_shl, luaV_shiftl(ib, ic), TM_SHL)
+jitbitwise(j_shr, luaV_shiftl(ib, -ic), TM_SHR)
+
+
+static int j_unm (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  TValue *rb = RB(i);
+  lua_Number nb;
+  (void)k;
+  if (ttisinteger(rb)) {
+    lua_Integer ib = ivalue(rb);
+    setivalue(ra, intop(-, 0, ib));
+  }
+  else if (tonumber(rb, &nb)) {
+    setfltvalue(ra, luai_numunm(L, nb));
+  }
+  else {
+    Protect(luaT_trybinTM(L, rb, rb, ra, TM_UNM));
+  }
+  jitnext(L);
+}
+
+
+static int j_bnot (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  TValue *rb = RB(i);
+  lua_Integer ib;
+  (void)k;
+  if (tointeger(rb, &ib)) {
+    setivalue(ra, intop(^, ~l_castS2U(0), ib));
+  }
+  else {
+    Protect(luaT_trybinTM(L, rb, rb, ra, TM_BNOT));
+  }
+  jitnext(L);
+}
+
+
+static int j_not (lua_State *L, Instruction i) {
+  jitframe(L);
+  TValue *rb = RB(i);
+  int res = l_isfalse(rb);  /* next assignment may change this value */
+  (void)k;
+  setbvalue(RA(i), res);
+  jitnext(L);
+}
+
+
+static int j_len (lua_State *L, Instruction i) {
+  jitframe(L);
+  (void)k;
+  luaV_objlen(L, RA(i), RB(i));
+  jitnext(L);
+}
+
+
+static int j_concat (lua_State *L, Instruction i) {
+  jitframe(L);
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  StkId ra, rb;
+  (void)k;
+  L->top = base + c + 1;  /* mark the end of concat operands */
+  Protect(luaV_concat(L, c - b + 1));
+  ra = RA(i);  /* 'luaV_concat' may invoke TMs and move the stack */
+  rb = base + b;
+  setobjs2s(L, ra, rb);
+  checkGC(L, (ra >= rb ? ra + 1 : rb));
+  L->top = ci->top;  /* restore top */
+  jitnext(L);
+}
+
+
+static int j_jmp (lua_State *L, Instruction i) {
+  jitframe(L);
+  (void)k;
+  luaF_close(L, base + GETARG_A(i) - 1);
+  ci->u.l.savedpc += GETARG_sBx(i);
+  jitjump(L);
+}
+
+
+static int j_eq (lua_State *L, Instruction i) {
+  jitframe(L);
+  int res = luaV_equalobj(L, RKB(i), RKC(i));
+  return jittest(L, ci, res != GETARG_A(i));
+}
+
+
+static int j_lt (lua_State *L, Instruction i) {
+  jitframe(L);
+  int res = luaV_lessthan(L, RKB(i), RKC(i));
+  return jittest(L, ci, res != GETARG_A(i));
+}
+
+
+static int j_le (lua_State *L, Instruction i) {
+  jitframe(L);
+  int res = luaV_lessequal(L, RKB(i), RKC(i));
+  return jittest(L, ci, res != GETARG_A(i));
+}
+
+
+static int j_test (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  (void)k;
+  return jittest(L, ci, GETARG_C(i) ? l_isfalse(ra) : !l_isfalse(ra));
+}
+
+
+static int j_testset (lua_State *L, Instruction i) {
+  jitframe(L);
+  TValue *rb = RB(i);
+  (void)k;
+  if (GETARG_C(i) ? l_isfalse(rb) : !l_isfalse(rb))
+    return jittest(L, ci, 1);
+  setobjs2s(L, RA(i), rb);
+  return jittest(L, ci, 0);
+}
+
+
+static int j_call (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  int b = GETARG_B(i);
+  int nresults = GETARG_C(i) - 1;
+  (void)k;
+  if (b != 0) L->top = ra+b;  /* else previous instruction set top */
+  if (luaD_precall(L, ra, nresults)) {  /* C function? */
+    if (nresults >= 0)
+      L->top = ci->top;  /* adjust results */
+    jitnext(L);
+  }
+  else  /* Lua function */
+    return JIT_CALL;  /* let the interpreter run it */
+}
+
+
+static int j_return (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  int b = GETARG_B(i);
+  (void)k;
+  if (cl->p->sizep > 0) luaF_close(L, base);
+  b = luaD_poscall(L, ci, ra, (b != 0 ? b - 1 : cast_int(L->top - ra)));
+  if (b && !(ci->callstatus & CIST_FRESH))  /* returning to Lua code? */
+    L->top = L->ci->top;
+  return JIT_RETURN;
+}
+
+
+static int j_forloop (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  (void)k;
+  if (ttisinteger(ra)) {  /* integer loop? */
+    lua_Integer step = ivalue(ra + 2);
+    lua_Integer idx = intop(+, ivalue(ra), step); /* increment index */
+    lua_Integer limit = ivalue(ra + 1);
+    if ((0 < step) ? (idx <= limit) : (limit <= idx)) {
+      ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+      chgivalue(ra, idx);  /* update internal index... */
+      setivalue(ra + 3, idx);  /* ...and external index */
+      jitjump(L);
+    }
+  }
+  else {  /* floating loop */
+    lua_Number step = fltvalue(ra + 2);
+    lua_Number idx = luai_numadd(L, fltvalue(ra), step); /* inc. index */
+    lua_Number limit = fltvalue(ra + 1);
+    if (luai_numlt(0, step) ? luai_numle(idx, limit)
+                            : luai_numle(limit, idx)) {
+      ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+      chgfltvalue(ra, idx);  /* update internal index... */
+      setfltvalue(ra + 3, idx);  /* ...and external index */
+      jitjump(L);
+    }
+  }
+  jitnext(L);
+}
+
+
+static int j_forprep (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  (void)k;
+  if (ttisinteger(ra) && ttisinteger(ra + 2)) {
+    lua_Integer ilimit;
+    int stopnow;
+    if (luaV_forlimit(ra + 1, &ilimit, ivalue(ra + 2), &stopnow)) {
+      /* all values are integer */
+      lua_Integer initv = (stopnow ? 0 : ivalue(ra));
+      setivalue(ra + 1, ilimit);
+      setivalue(ra, intop(-, initv, ivalue(ra + 2)));
+      ci->u.l.savedpc += GETARG_sBx(i);
+      jitjump(L);
+    }
+  }
+  {  /* try making all values floats */
+    lua_Number ninit; lua_Number nlimit; lua_Number nstep;
+    if (!tonumber(ra + 1, &nlimit))
+      luaG_runerror(L, "'for' limit must be a number");
+    setfltvalue(ra + 1, nlimit);
+    if (!tonumber(ra + 2, &nstep))
+      luaG_runerror(L, "'for' step must be a number");
+    setfltvalue(ra + 2, nstep);
+    if (!tonumber(ra, &ninit))
+      luaG_runerror(L, "'for' initial value must be a number");
+    setfltvalue(ra, luai_numsub(L, ninit, nstep));
+  }
+  ci->u.l.savedpc += GETARG_sBx(i);
+  jitjump(L);
+}
+
+
+static int j_tforcall (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  StkId cb = ra + 3;  /* call base */
+  (void)k;
+  setobjs2s(L, cb+2, ra+2);
+  setobjs2s(L, cb+1, ra+1);
+  setobjs2s(L, cb, ra);
+  L->top = cb + 3;  /* func. + 2 args (state and index) */
+  luaD_call(L, cb, GETARG_C(i));
+  L->top = ci->top;
+  lua_assert(GET_OPCODE(*ci->u.l.savedpc) == OP_TFORLOOP);
+  jitnext(L);
+}
+
+
+static int j_tforloop (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  (void)k;
+  if (!ttisnil(ra + 1)) {  /* continue loop? */
+    setobjs2s(L, ra, ra + 1);  /* save control variable */
+    ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+    jitjump(L);
+  }
+  jitnext(L);
+}
+
+
+static int j_setlist (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  int n = GETARG_B(i);
+  int c = GETARG_C(i);
+  unsigned int last;
+  Table *h;
+  (void)k;
+  if (n == 0) n = cast_int(L->top - ra) - 1;
+  if (c == 0) {
+    lua_assert(GET_OPCODE(*ci->u.l.savedpc) == OP_EXTRAARG);
+    c = GETARG_Ax(*ci->u.l.savedpc++);
+  }
+  h = hvalue(ra);
+  last = ((c-1)*LFIELDS_PER_FLUSH) + n;
+  if (last > h->sizearray)  /* needs more space? */
+    luaH_resizearray(L, h, last);  /* preallocate it at once */
+  for (; n > 0; n--) {
+    TValue *val = ra+n;
+    luaH_setint(L, h, last--, val);
+    luaC_barrierback(L, h, val);
+  }
+  L->top = ci->top;  /* correct top (in case of previous open call) */
+  jitnext(L);
+}
+
+
+static int j_vararg (lua_State *L, Instruction i) {
+  jitframe(L);
+  StkId ra = RA(i);
+  int b = GETARG_B(i) - 1;  /* required results */
+  int j;
+  int n = cast_int(base - ci->func) - cl->p->numparams - 1;
+  (void)k;
+  if (n < 0)  /* less arguments than parameters? */
+    n = 0;  /* no vararg arguments */
+  if (b < 0) {  /* B == 0? */
+    b = n;  /* get all var. arguments */
+    Protect(luaD_checkstack(L, n));
+    ra = RA(i);  /* previous call may change the stack */
+    L->top = ra + n;
+  }
+  for (j = 0; j < b && j < n; j++)
+    setobjs2s(L, ra + j, base - n + j);
+  for (; j < b; j++)  /* complete required results with nil */
+    setnilvalue(ra + j);
+  jitnext(L);
+}
+
+
+/*
+** helper for each opcode; NULL means that compiled code goes back to
+** the interpreter to run that opcode
+*/
+static JitHelper gethelper (OpCode op) {
+  switch (op) {
+    case OP_LOADKX: return j_loadkx;
+    case OP_GETUPVAL: return j_getupval;
+    case OP_GETTABUP: return j_gettabup;
+    case OP_GETTABLE: return j_gettable;
+    case OP_SETTABUP: return j_settabup;
+    case OP_SETUPVAL: return j_setupval;
+    case OP_SETTABLE: return j_settable;
+    case OP_NEWTABLE: return j_newtable;
+    case OP_SELF: return j_self;
+    case OP_ADD: return j_add;
+    case OP_SUB: return j_sub;
+    case OP_MUL: return j_mul;
+    case OP_MOD: return j_mod;
+    case OP_POW: return j_pow;
+    case OP_DIV: return j_div;
+    case OP_IDIV: return j_idiv;
+    case OP_BAND: return j_band;
+    case OP_BOR: return j_bor;
+    case OP_BXOR: return j_bxor;
+    case OP_SHL: return j_shl;
+    case OP_SHR: return j_shr;
+    case OP_UNM: return j_unm;
+    case OP_BNOT: return j_bnot;
+    case OP_NOT: return j_not;
+    case OP_LEN: return j_len;
+    case OP_CONCAT: return j_concat;
+    case OP_JMP: return j_jmp;
+    case OP_EQ: return j_eq;
+    case OP_LT: return j_lt;
+    case OP_LE: return j_le;
+    case OP_TEST: return j_test;
+    case OP_TESTSET: return j_testset;
+    case OP_CALL: return j_call;
+    case OP_RETURN: return j_return;
+    case OP_FORLOOP: return j_forloop;
+    case OP_FORPREP: return j_forprep;
+    case OP_TFORCALL: return j_tforcall;
+    case OP_TFORLOOP: return j_tforloop;
+    case OP_SETLIST: return j_setlist;
+    case OP_VARARG: return j_vararg;
+    default: return NULL;
+  }
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** x86-64 code emission
+** =======================================================
+*/
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+       R8, R9, R10, R11, R12, R13, R14, R15 };
+
+/* registers kept by compiled code (all callee-saved) */
+#define RL	RBX	/* lua_State */
+#define RCI	R12	/* CallInfo of the running function */
+#define RBASE	R13	/* its 'base' */
+
+/* condition codes */
+#define CC_E	0x4
+#define CC_NE	0x5
+#define CC_L	0xC
+#define CC_GE	0xD
+#define CC_LE	0xE
+#define CC_G	0xF
+#define CC_ALWAYS	(-1)
+
+#define OFF_BASE	cast_int(offsetof(CallInfo, u.l.base))
+#define OFF_SAVEDPC	cast_int(offsetof(CallInfo, u.l.savedpc))
+#define OFF_HOOKMASK	cast_int(offsetof(lua_State, hookmask))
+#define OFF_TT		cast_int(offsetof(TValue, tt_))
+
+/* offset of register 'r' from 'base' */
+#define regoff(r)	(cast_int(r) * cast_int(sizeof(TValue)))
+
+
+typedef struct JitState {
+  Proto *p;
+  lu_byte *code;  /* code being generated */
+  int pc;  /* position in 'code' */
+  JitCode *jc;
+  int *fix;  /* pending jumps to instructions: (position, target) */
+  int nfix;
+  int exitpos;  /* position of the epilogue */
+} JitState;
+
+
+static void b1 (JitState *J, int b) {
+  J->code[J->pc++] = cast_byte(b);
+}
+
+
+static void b4 (JitState *J, int v) {
+  unsigned int u = cast(unsigned int, v);
+  memcpy(J->code + J->pc, &u, 4);
+  J->pc += 4;
+}
+
+
+static void b8 (JitState *J, const void *p) {
+  size_t u = cast(size_t, p);
+  memcpy(J->code + J->pc, &u, 8);
+  J->pc += 8;
+}
+
+
+static void rex (JitState *J, int w, int reg, int rm) {
+  int r = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+  if (r != 0x40) b1(J, r);
+}
+
+
+/* instruction 'op' with operands 'reg' and [base + disp] */
+static void opmem (JitState *J, int w, int op, int reg, int base, int disp) {
+  rex(J, w, reg, base);
+  if (op > 0xff) b1(J, op >> 8);
+  b1(J, op & 0xff);
+  b1(J, 0x80 | ((reg & 7) << 3) | (base & 7));  /* mod 10: disp32 */
+  if ((base & 7) == RSP) b1(J, 0x24);  /* rsp/r12 need a SIB byte */
+  b4(J, disp);
+}
+
+#define load64(J,r,b,d)		opmem(J, 1, 0x8B, r, b, d)
+#define store64(J,r,b,d)	opmem(J, 1, 0x89, r, b, d)
+#define load32(J,r,b,d)		opmem(J, 0, 0x8B, r, b, d)
+#define store32(J,r,b,d)	opmem(J, 0, 0x89, r, b, d)
+#define lea(J,r,b,d)		opmem(J, 1, 0x8D, r, b, d)
+#define add64(J,r,b,d)		opmem(J, 1, 0x03, r, b, d)
+#define sub64(J,r,b,d)		opmem(J, 1, 0x2B, r, b, d)
+#define imul64(J,r,b,d)		opmem(J, 1, 0x0FAF, r, b, d)
+#define cmp64(J,r,b,d)		opmem(J, 1, 0x3B, r, b, d)
+
+
+/* mov dword [base + disp], imm */
+static void storeimm32 (JitState *J, int base, int disp, int imm) {
+  opmem(J, 0, 0xC7, 0, base, disp);
+  b4(J, imm);
+}
+
+
+/* cmp dword [base + disp], imm */
+static void cmpimm32 (JitState *J, int base, int disp, int imm) {
+  opmem(J, 0, 0x81, 7, base, disp);
+  b4(J, imm);
+}
+
+
+/* mov r64, imm64 */
+static void movimm64 (JitState *J, int r, const void *p) {
+  rex(J, 1, 0, r);
+  b1(J, 0xB8 + (r & 7));
+  b8(J, p);
+}
+
+
+/* mov r32, imm32 */
+static void movimm32 (JitState *J, int r, int imm) {
+  rex(J, 0, 0, r);
+  b1(J, 0xB8 + (r & 7));
+  b4(J, imm);
+}
+
+
+/* mov r64 'dst', r64 'src' */
+static void movreg (JitState *J, int dst, int src) {
+  rex(J, 1, src, dst);
+  b1(J, 0x89);
+  b1(J, 0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+
+static void pushreg (JitState *J, int r) {
+  rex(J, 0, 0, r);
+  b1(J, 0x50 + (r & 7));
+}
+
+
+static void popreg (JitState *J, int r) {
+  rex(J, 0, 0, r);
+  b1(J, 0x58 + (r & 7));
+}
+
+
+/* jmp/jcc rel32 with a zero offset; returns position of the offset */
+static int jump (JitState *J, int cc) {
+  if (cc == CC_ALWAYS)
+    b1(J, 0xE9);
+  else {
+    b1(J, 0x0F);
+    b1(J, 0x80 + cc);
+  }
+  b4(J, 0);
+  return J->pc - 4;
+}
+
+
+/* patch jump at 'pos' to jump to 'target' */
+static void patch (JitState *J, int pos, int target) {
+  int rel = target - (pos + 4);
+  memcpy(J->code + pos, &rel, 4);
+}
+
+
+/* patch jump at 'pos' to jump to the current position */
+#define here(J,pos)	patch(J, pos, (J)->pc)
+
+
+/* jump to the code of instruction 'target' */
+static void jumpto (JitState *J, int cc, int target) {
+  int pos = jump(J, cc);
+  lua_assert(J->nfix < J->jc->sizecode * MAXOPFIX);
+  J->fix[2 * J->nfix] = pos;
+  J->fix[2 * J->nfix + 1] = target;
+  J->nfix++;
+}
+
+
+/* leave compiled code with the status in 'eax' */
+#define jumpexit(J,cc)	patch(J, jump(J, cc), (J)->exitpos)
+
+
+/* ci->u.l.savedpc = &code[pc] */
+static void savepc (JitState *J, int pc) {
+  movimm64(J, RAX, J->p->code + pc);
+  store64(J, RAX, RCI, OFF_SAVEDPC);
+}
+
+
+/* go back to the interpreter at instruction 'pc' */
+static void exitat (JitState *J, int pc) {
+  savepc(J, pc);
+  movimm32(J, RAX, JIT_EXIT);
+  jumpexit(J, CC_ALWAYS);
+}
+
+
+/*
+** jump from instruction 'from' to instruction 'target' (if condition
+** 'cc' holds); backward jumps check whether a hook was set, to keep
+** loops from running without it
+*/
+static void branch (JitState *J, int cc, int target, int from) {
+  if (target > from)
+    jumpto(J, cc, target);
+  else {
+    int skip = (cc == CC_ALWAYS) ? -1 : jump(J, cc ^ 1);
+    cmpimm32(J, RL, OFF_HOOKMASK, 0);
+    jumpto(J, CC_E, target);
+    exitat(J, target);
+    if (skip >= 0) here(J, skip);
+  }
+}
+
+
+/* call the helper of instruction 'i' at 'pc'; status ends in 'eax' */
+static void callhelper (JitState *J, int pc, Instruction i) {
+  JitHelper f = gethelper(GET_OPCODE(i));
+  savepc(J, pc + 1);
+  movreg(J, RDI, RL);
+  movimm32(J, RSI, cast_int(i));
+  movimm64(J, RAX, cast(void *, f));
+  b1(J, 0xFF); b1(J, 0xD0);  /* call rax */
+  load64(J, RBASE, RCI, OFF_BASE);  /* stack may have been reallocated */
+}
+
+
+/*
+** call the helper of instruction 'i' at 'pc' and go to the instruction
+** 'next' or (if it asks for a jump) 'target'
+*/
+static void dohelper (JitState *J, int pc, Instruction i, int next,
+                      int target) {
+  callhelper(J, pc, i);
+  b1(J, 0x85); b1(J, 0xC0);  /* test eax, eax */
+  if (target < 0) {  /* no jumps? */
+    jumpexit(J, CC_NE);
+    if (next != pc + 1)
+      jumpto(J, CC_ALWAYS, next);
+  }
+  else {
+    jumpto(J, CC_E, next);
+    b1(J, 0x83); b1(J, 0xF8); b1(J, JIT_JUMP);  /* cmp eax, JIT_JUMP */
+    jumpexit(J, CC_NE);
+    branch(J, CC_ALWAYS, target, pc);
+  }
+}
+
+
+/* load address of RK(x) into register 'r' */
+static void rkaddr (JitState *J, int r, int x) {
+  if (ISK(x))
+    movimm64(J, r, J->p->k + INDEXK(x));
+  else
+    lea(J, r, RBASE, regoff(x));
+}
+
+
+/* is RK(x) a constant that is not an integer? */
+#define nonintK(J,x)	(ISK(x) && !ttisinteger((J)->p->k + INDEXK(x)))
+
+/* does RK(x) need a run-time check for being an integer? */
+#define needcheck(J,x)	(!ISK(x))
+
+
+/*
+** load RK(B) and RK(C) into 'rsi' and 'rdi' and check that both are
+** integers; returns position of the jump for the failure case (or -1
+** if the operands are never both integers)
+*/
+static int intoperands (JitState *J, Instruction i, int *fail2) {
+  int b = GETARG_B(i), c = GETARG_C(i);
+  int fail1 = -1;
+  *fail2 = -1;
+  if (nonintK(J, b) || nonintK(J, c))
+    return -2;
+  rkaddr(J, RSI, b);
+  rkaddr(J, RDI, c);
+  if (needcheck(J, b)) {
+    cmpimm32(J, RSI, OFF_TT, LUA_TNUMINT);
+    fail1 = jump(J, CC_NE);
+  }
+  if (needcheck(J, c)) {
+    cmpimm32(J, RDI, OFF_TT, LUA_TNUMINT);
+    *fail2 = jump(J, CC_NE);
+  }
+  return fail1;
+}
+
+
+/* integer add/sub/mul inline; other types go through the helper */
+static void emitarith (JitState *J, int pc, Instruction i) {
+  int fail2;
+  int fail1 = intoperands(J, i, &fail2);
+  if (fail1 != -2) {
+    int done;
+    int a = GETARG_A(i);
+    load64(J, RAX, RSI, 0);
+    switch (GET_OPCODE(i)) {
+      case OP_ADD: add64(J, RAX, RDI, 0); break;
+      case OP_SUB: sub64(J, RAX, RDI, 0); break;
+      default: lua_assert(GET_OPCODE(i) == OP_MUL); imul64(J, RAX, RDI, 0);
+    }
+    store64(J, RAX, RBASE, regoff(a));
+    storeimm32(J, RBASE, regoff(a) + OFF_TT, LUA_TNUMINT);
+    done = jump(J, CC_ALWAYS);
+    if (fail1 >= 0) here(J, fail1);
+    if (fail2 >= 0) here(J, fail2);
+    dohelper(J, pc, i, pc + 1, -1);
+    here(J, done);
+  }
+  else
+    dohelper(J, pc, i, pc + 1, -1);
+}
+
+
+/* integer comparisons inline; other types go through the helper */
+static void emitcompare (JitState *J, int pc, Instruction i) {
+  Instruction jmp = J->p->code[pc + 1];
+  int target = pc + 2 + GETARG_sBx(jmp);
+  int fail2 = -1;
+  int fail1 = (GETARG_A(jmp) != 0) ? -2 : intoperands(J, i, &fail2);
+  if (fail1 != -2) {
+    int cc;
+    load64(J, RAX, RSI, 0);
+    cmp64(J, RAX, RDI, 0);
+    switch (GET_OPCODE(i)) {
+      case OP_EQ: cc = CC_E; break;
+      case OP_LT: cc = CC_L; break;
+      default: lua_assert(GET_OPCODE(i) == OP_LE); cc = CC_LE;
+    }
+    if (!GETARG_A(i)) cc ^= 1;  /* jump when comparison is false */
+    branch(J, cc, target, pc);
+    jumpto(J, CC_ALWAYS, pc + 2);
+    if (fail1 >= 0) here(J, fail1);
+    if (fail2 >= 0) here(J, fail2);
+  }
+  dohelper(J, pc, i, pc + 2, target);
+}
+
+
+/* integer 'for' loop inline; float loops go through the helper */
+static void emitforloop (JitState *J, int pc, Instruction i) {
+  int ra = regoff(GETARG_A(i));
+  int target = pc + 1 + GETARG_sBx(i);
+  int fail, neg, exit1, exit2, cont;
+  cmpimm32(J, RBASE, ra + OFF_TT, LUA_TNUMINT);
+  fail = jump(J, CC_NE);
+  load64(J, RAX, RBASE, ra);  /* index */
+  load64(J, RCX, RBASE, ra + regoff(2));  /* step */
+  load64(J, RDX, RBASE, ra + regoff(1));  /* limit */
+  b1(J, 0x48); b1(J, 0x01); b1(J, 0xC8);  /* add rax, rcx */
+  b1(J, 0x48); b1(J, 0x85); b1(J, 0xC9);  /* test rcx, rcx */
+  neg = jump(J, CC_LE);
+  b1(J, 0x48); b1(J, 0x39); b1(J, 0xD0);  /* cmp rax, rdx */
+  exit1 = jump(J, CC_G);  /* idx > limit: loop ends */
+  cont = jump(J, CC_ALWAYS);
+  here(J, neg);
+  b1(J, 0x48); b1(J, 0x39); b1(J, 0xD0);  /* cmp rax, rdx */
+  exit2 = jump(J, CC_L);  /* idx < limit: loop ends */
+  here(J, cont);
+  store64(J, RAX, RBASE, ra);  /* update internal index... */
+  store64(J, RAX, RBASE, ra + regoff(3));  /* ...and external index */
+  storeimm32(J, RBASE, ra + regoff(3) + OFF_TT, LUA_TNUMINT);
+  branch(J, CC_ALWAYS, target, pc);
+  here(J, fail);
+  dohelper(J, pc, i, pc + 1, target);
+  here(J, exit1);
+  here(J, exit2);
+}
+
+
+/* copy register (or constant at address in 'rsi') to register 'a' */
+static void emitmove (JitState *J, int a, int src, int off) {
+  load64(J, RAX, src, off);
+  store64(J, RAX, RBASE, regoff(a));
+  load32(J, RAX, src, off + OFF_TT);
+  store32(J, RAX, RBASE, regoff(a) + OFF_TT);
+}
+
+
+static void emitop (JitState *J, int pc) {
+  Instruction i = J->p->code[pc];
+  OpCode op = luaP_generic(GET_OPCODE(i));
+  SET_OPCODE(i, op);  /* helpers only see generic opcodes */
+  switch (op) {
+    case OP_MOVE: {
+      emitmove(J, GETARG_A(i), RBASE, regoff(GETARG_B(i)));
+      break;
+    }
+    case OP_LOADK: {
+      movimm64(J, RSI, J->p->k + GETARG_Bx(i));
+      emitmove(J, GETARG_A(i), RSI, 0);
+      break;
+    }
+    case OP_LOADBOOL: {
+      int a = regoff(GETARG_A(i));
+      storeimm32(J, RBASE, a, GETARG_B(i) != 0);
+      storeimm32(J, RBASE, a + OFF_TT, LUA_TBOOLEAN);
+      if (GETARG_C(i))  /* skip next instruction? */
+        jumpto(J, CC_ALWAYS, pc + 2);
+      break;
+    }
+    case OP_LOADNIL: {
+      int a = GETARG_A(i), b = GETARG_B(i);
+      do {
+        storeimm32(J, RBASE, regoff(a++) + OFF_TT, LUA_TNIL);
+      } while (b--);
+      break;
+    }
+    case OP_ADD: case OP_SUB: case OP_MUL: {
+      emitarith(J, pc, i);
+      break;
+    }
+    case OP_EQ: case OP_LT: case OP_LE: {
+      emitcompare(J, pc, i);
+      break;
+    }
+    case OP_JMP: {
+      int target = pc + 1 + GETARG_sBx(i);
+      if (GETARG_A(i) == 0)  /* no upvalues to close? */
+        branch(J, CC_ALWAYS, target, pc);
+      else
+        dohelper(J, pc, i, pc + 1, target);
+      break;
+    }
+    case OP_TEST: case OP_TESTSET: {
+      dohelper(J, pc, i, pc + 2, pc + 2 + GETARG_sBx(J->p->code[pc + 1]));
+      break;
+    }
+    case OP_FORLOOP: {
+      emitforloop(J, pc, i);
+      break;
+    }
+    case OP_FORPREP: case OP_TFORLOOP: {
+      dohelper(J, pc, i, pc + 1, pc + 1 + GETARG_sBx(i));
+      break;
+    }
+    case OP_LOADKX: {
+      dohelper(J, pc, i, pc + 2, -1);
+      break;
+    }
+    case OP_SETLIST: {
+      dohelper(J, pc, i, (GETARG_C(i) == 0) ? pc + 2 : pc + 1, -1);
+      break;
+    }
+    case OP_RETURN: {
+      callhelper(J, pc, i);
+      jumpexit(J, CC_ALWAYS);
+      break;
+    }
+    case OP_EXTRAARG: {
+      b1(J, 0x0F); b1(J, 0x0B);  /* ud2 (never executed) */
+      break;
+    }
+    default: {
+      if (gethelper(op) != NULL)
+        dohelper(J, pc, i, pc + 1, -1);
+      else  /* let the interpreter run this instruction */
+        exitat(J, pc);
+      break;
+    }
+  }
+}
+
+
+/*
+** entry code: save callee-saved registers (five pushes keep the stack
+** aligned for calls), load 'L', 'ci' and 'base', and jump to the
+** instruction given as third argument; followed by the epilogue
+*/
+static void emitentry (JitState *J) {
+  pushreg(J, RBX); pushreg(J, RBP); pushreg(J, R12);
+  pushreg(J, R13); pushreg(J, R14);
+  movreg(J, RL, RDI);
+  movreg(J, RCI, RSI);
+  load64(J, RBASE, RCI, OFF_BASE);
+  b1(J, 0xFF); b1(J, 0xE2);  /* jmp rdx */
+  J->exitpos = J->pc;
+  popreg(J, R14); popreg(J, R13); popreg(J, R12);
+  popreg(J, RBP); popreg(J, RBX);
+  b1(J, 0xC3);  /* ret */
+}
+
+/* }====================================================== */
+
+
+void luaJ_compile (lua_State *L, Proto *p) {
+  JitState J;
+  JitCode *jc;
+  size_t size, pagesize, used;
+  void *mem;
+  int pc;
+  lua_assert(p->jit == NULL);
+  if (sizeof(TValue) != 16 || p->sizecode == 0)
+    return;  /* layout not supported */
+  jc = cast(JitCode *, luaM_malloc(L, jitsize(p->sizecode)));
+  size = 64 + cast(size_t, p->sizecode) * MAXOPCODE;
+  mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    luaM_freemem(L, jc, jitsize(p->sizecode));
+    return;  /* keep interpreting this function */
+  }
+  jc->sizecode = p->sizecode;
+  jc->labels = cast(int *, jc + 1);
+  J.p = p;
+  J.code = cast(lu_byte *, mem);
+  J.pc = 0;
+  J.jc = jc;
+  J.fix = jc->labels + p->sizecode;
+  J.nfix = 0;
+  emitentry(&J);
+  for (pc = 0; pc < p->sizecode; pc++) {
+    jc->labels[pc] = J.pc;
+    emitop(&J, pc);
+    lua_assert(J.pc - jc->labels[pc] <= MAXOPCODE);
+  }
+  for (pc = 0; pc < J.nfix; pc++)  /* resolve jumps between instructions */
+    patch(&J, J.fix[2 * pc], jc->labels[J.fix[2 * pc + 1]]);
+  pagesize = cast(size_t, sysconf(_SC_PAGESIZE));
+  used = (cast(size_t, J.pc) + pagesize - 1) & ~(pagesize - 1);
+  if (used < size) {  /* release unused pages */
+    munmap(J.code + used, size - used);
+    size = used;
+  }
+  mprotect(mem, size, PROT_READ | PROT_EXEC);
+  jc->mem = J.code;
+  jc->size = size;
+  /* keep only the labels */
+  jc = cast(JitCode *, luaM_realloc_(L, jc, jitsize(p->sizecode),
+                         sizeof(JitCode) + p->sizecode * sizeof(int)));
+  jc->labels = cast(int *, jc + 1);
+  p->jit = jc;
+}
+
+
+/*
+** run compiled code of the function of 'ci' from its 'savedpc'
+*/
+int luaJ_run (lua_State *L, CallInfo *ci) {
+  Proto *p = clLvalue(ci->func)->p;
+  JitCode *jc = p->jit;
+  JitEnter enter;
+  int pc = cast_int(ci->u.l.savedpc - p->code);
+  lua_assert(L->ci == ci && !L->hookmask && pc < jc->sizecode);
+  memcpy(&enter, &jc->mem, sizeof(enter));  /* entry code is at offset 0 */
+  return enter(L, ci, jc->mem + jc->labels[pc]);
+}
+
+
+void luaJ_free (lua_State *L, Proto *p) {
+  JitCode *jc = p->jit;
+  munmap(jc->mem, jc->size);
+  luaM_freemem(L, jc, sizeof(JitCode) + jc->sizecode * sizeof(int));
+}
+
+#endif
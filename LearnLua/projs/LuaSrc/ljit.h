@@ -0,0 +1,59 @@
+/*
+** $Id: ljit.h $
+** Baseline compiler from Lua bytecode to x86-64 machine code
+** See Copyright Notice in lua.h
+*/
+
+#ifndef ljit_h
+#define ljit_h
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** The compiler is optional: build with LUA_USE_JIT (only available on
+** x86-64 with POSIX 'mmap', and it needs the default 16-byte TValue and
+** 'longjmp'-based error handling).
+*/
+#if defined(LUA_USE_JIT)
+#if !defined(__x86_64__) || !defined(LUA_USE_POSIX) || defined(__cplusplus)
+#error "LUA_USE_JIT needs x86-64, LUA_USE_POSIX and a C compiler"
+#endif
+#if defined(LUA_NANBOX)
+#error "LUA_USE_JIT cannot be used with LUA_NANBOX"
+#endif
+#endif
+
+
+/* number of calls after which a function is compiled */
+#if !defined(LUAI_JITCALLS)
+#define LUAI_JITCALLS	50
+#endif
+
+
+/* results of 'luaJ_run' */
+#define LUAJ_EXIT	2	/* continue in the interpreter at 'savedpc' */
+#define LUAJ_CALL	3	/* a Lua function was called: run 'L->ci' */
+#define LUAJ_RETURN	4	/* the function returned */
+
+
+#if defined(LUA_USE_JIT)
+
+/* count a call to 'p' and compile it when it gets hot */
+#define luaJ_oncall(L,p)  \
+	{ if ((p)->ncalls < LUAI_JITCALLS && ++(p)->ncalls == LUAI_JITCALLS) \
+	    luaJ_compile(L, p); }
+
+LUAI_FUNC void luaJ_compile (lua_State *L, Proto *p);
+LUAI_FUNC int luaJ_run (lua_State *L, CallInfo *ci);
+LUAI_FUNC void luaJ_free (lua_State *L, Proto *p);
+
+#else
+
+#define luaJ_oncall(L,p)	((void)0)
+#define luaJ_free(L,p)		((void)0)
+
+#endif
+
+#endif
@@ -17,7 +17,9 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lgc.h"
+#include "lgcfree.h"
 #include "lmem.h"
+#include "lmemprof.h"
 #include "lobject.h"
 #include "lstate.h"
 
@@ -71,6 +73,21 @@ l_noret luaM_toobig (lua_State *L) {
 
 
 
+/*
+** Allocation of 'inc' more bytes would cross the memory limit: try an
+** emergency collection, and raise an error if it does not free enough.
+** (Nothing can be done while the state is being built or collected.)
+*/
+static void checklimit (lua_State *L, size_t inc) {
+  global_State *g = G(L);
+  if (g->version == NULL || g->gcemergency)
+    return;
+  luaC_fullgc(L, 1);
+  if (gettotalbytes(g) + inc > g->memlimit)
+    luaD_throw(L, LUA_ERRMEM);
+}
+
+
 /*
 ** generic allocation routine.
 */
@@ -79,15 +96,24 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   global_State *g = G(L);
   size_t realosize = (block) ? osize : 0;
   lua_assert((realosize == 0) == (block == NULL));
+  if (nsize > realosize && luaM_sampling(g, nsize - realosize))
+    luaM_sample(L, (block) ? 0 : cast_int(osize));  /* 'osize' is the tag */
+  if (nsize > realosize && g->memlimit > 0 &&
+      gettotalbytes(g) + (nsize - realosize) > g->memlimit)
+    checklimit(L, nsize - realosize);
 #if defined(HARDMEMTESTS)
   if (nsize > realosize && g->gcrunning)
     luaC_fullgc(L, 1);  /* force a GC whenever possible */
 #endif
-  newblock = (*g->frealloc)(g->ud, block, osize, nsize);
+  if (nsize == 0 && block != NULL && luaC_bgfree(g, block, osize))
+    newblock = NULL;  /* will be freed by a helper thread */
+  else
+    newblock = (*g->frealloc)(g->ud, block, osize, nsize);
   if (newblock == NULL && nsize > 0) {
     lua_assert(nsize > realosize);  /* cannot fail when shrinking a block */
     if (g->version) {  /* is state fully built? */
       luaC_fullgc(L, 1);  /* try to free some memory... */
+      luaC_bgsync(g);  /* ...for real */
       newblock = (*g->frealloc)(g->ud, block, osize, nsize);  /* try again */
     }
     if (newblock == NULL)
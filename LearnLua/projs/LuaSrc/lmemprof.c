@@ -0,0 +1,295 @@
+/*
+** $Id: lmemprof.c $
+** Sampling allocation profiler
+** See Copyright Notice in lua.h
+*/
+
+#define lmemprof_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "ldebug.h"
+#include "ldo.h"
+#include "lmemprof.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "lstring.h"
+#include "ltm.h"
+
+
+/*
+** Roughly one allocation every 'rate' bytes is sampled: the gap to the
+** next sample is drawn uniformly from [rate/2, 3*rate/2], so that
+** periodic allocation patterns do not always hit the same site. Each
+** sample stands for all bytes allocated since the previous one and is
+** accumulated under its folded stack ("f1;f2;...;[type]", outermost
+** frame first), so that hot sites add up regardless of the gaps.
+**
+** The profiler memory is taken directly from the allocation function:
+** it is not counted by the collector and it cannot reenter
+** 'luaM_realloc_'.
+*/
+
+
+#define MINSAMPLES	64
+
+/* room left in the buffer for the type of the sample */
+#define FRAMESMAX	(LUAI_SAMPLEBUFFER - 16)
+
+/* maximum length of one frame */
+#define FRAMEMAX	(LUA_IDSIZE + 2 * LUAI_MAXSHORTLEN)
+
+
+#define rawalloc(g,b,os,ns)	((*(g)->frealloc)((g)->ud, b, os, ns))
+
+
+typedef struct Sample {
+  struct Sample *next;
+  unsigned int hash;
+  size_t len;  /* length of the folded stack, stored after the struct */
+  lu_mem bytes;  /* bytes allocated by this stack (estimated) */
+} Sample;
+
+#define samplestack(s)	cast(char *, (s) + 1)
+#define samplesize(l)	(sizeof(Sample) + (l))
+
+
+typedef struct MemProf {
+  lu_mem rate;  /* mean gap between samples (0 if sampling is off) */
+  lu_mem gap;  /* gap drawn for the current sample */
+  unsigned int rand;  /* state of the random generator */
+  int size;  /* size of 'hash' */
+  int nuse;  /* number of entries in 'hash' */
+  Sample **hash;
+} MemProf;
+
+
+static void nextgap (global_State *g, MemProf *mp) {
+  unsigned int x = mp->rand;
+  x ^= x << 13; x ^= x >> 17; x ^= x << 5;  /* xorshift */
+  mp->rand = x;
+  if (mp->rate == 0)
+    g->samplegap = MAX_LMEM;
+  else {
+    mp->gap = mp->rate / 2 + x % (mp->rate + 1);
+    if (mp->gap > cast(lu_mem, MAX_LMEM))
+      mp->gap = cast(lu_mem, MAX_LMEM);
+    else if (mp->gap == 0)
+      mp->gap = 1;
+    g->samplegap = cast(l_mem, mp->gap);
+  }
+}
+
+
+static void resize (global_State *g, MemProf *mp, int newsize) {
+  Sample **newhash = cast(Sample **,
+                          rawalloc(g, NULL, 0, newsize * sizeof(Sample *)));
+  int i;
+  if (newhash == NULL)
+    return;  /* keep the old (crowded) table */
+  for (i = 0; i < newsize; i++)
+    newhash[i] = NULL;
+  for (i = 0; i < mp->size; i++) {
+    Sample *s = mp->hash[i];
+    while (s) {
+      Sample *next = s->next;
+      unsigned int h = lmod(s->hash, newsize);
+      s->next = newhash[h];
+      newhash[h] = s;
+      s = next;
+    }
+  }
+  if (mp->hash != NULL)
+    rawalloc(g, mp->hash, mp->size * sizeof(Sample *), 0);
+  mp->hash = newhash;
+  mp->size = newsize;
+}
+
+
+static void addsample (global_State *g, MemProf *mp, const char *stack,
+                       size_t l, lu_mem bytes) {
+  unsigned int h = luaS_hash(stack, l, g->seed);
+  Sample **list;
+  Sample *s;
+  if (mp->nuse >= mp->size)
+    resize(g, mp, (mp->size == 0) ? MINSAMPLES : mp->size * 2);
+  if (mp->size == 0)
+    return;  /* no memory for the table */
+  list = &mp->hash[lmod(h, mp->size)];
+  for (s = *list; s != NULL; s = s->next) {
+    if (s->hash == h && s->len == l && memcmp(samplestack(s), stack, l) == 0) {
+      s->bytes += bytes;  /* known stack */
+      return;
+    }
+  }
+  s = cast(Sample *, rawalloc(g, NULL, 0, samplesize(l)));
+  if (s == NULL)
+    return;  /* drop the sample */
+  s->hash = h;
+  s->len = l;
+  s->bytes = bytes;
+  memcpy(samplestack(s), stack, l);
+  s->next = *list;
+  *list = s;
+  mp->nuse++;
+}
+
+
+static void freesamples (global_State *g, MemProf *mp) {
+  int i;
+  for (i = 0; i < mp->size; i++) {
+    Sample *s = mp->hash[i];
+    while (s) {
+      Sample *next = s->next;
+      rawalloc(g, s, samplesize(s->len), 0);
+      s = next;
+    }
+    mp->hash[i] = NULL;
+  }
+  mp->nuse = 0;
+}
+
+
+/*
+** Folds the stack of 'L' into 'buff': its frames, outermost first,
+** followed by the type of the object being allocated ('tt' is 0 for
+** blocks that are not objects). Frames are written backwards from the
+** innermost one, so that a deep stack loses its outer frames.
+*/
+static size_t foldstack (lua_State *L, int tt, char *buff) {
+  const char *tname = (tt == 0) ? "memory" : ttypename(novariant(tt));
+  size_t pos = FRAMESMAX;  /* frames go in 'buff[pos..FRAMESMAX)' */
+  size_t n;
+  int depth = 0;
+  CallInfo *ci;
+  for (ci = L->ci; ci != &L->base_ci; ci = ci->previous) {
+    char frame[FRAMEMAX];
+    size_t l;
+    if (depth++ == LUAI_SAMPLEDEPTH)
+      break;
+    l = luaG_framename(L, ci, frame, sizeof(frame));
+    if (l + 1 > pos - 4)  /* no room (keeping 4 bytes for "...;")? */
+      break;
+    pos -= l + 1;
+    memcpy(buff + pos, frame, l);
+    buff[pos + l] = ';';
+  }
+  if (ci != &L->base_ci) {  /* missing outer frames? */
+    pos -= 4;
+    memcpy(buff + pos, "...;", 4);
+  }
+  n = FRAMESMAX - pos;
+  memmove(buff, buff + pos, n);
+  buff[n++] = '[';
+  memcpy(buff + n, tname, strlen(tname));
+  n += strlen(tname);
+  buff[n++] = ']';
+  return n;
+}
+
+
+/*
+** Called by 'luaM_realloc_' (before the allocation, while the stack is
+** still consistent) when 'g->samplegap' runs out.
+*/
+void luaM_sample (lua_State *L, int tt) {
+  global_State *g = G(L);
+  MemProf *mp = g->memprof;
+  char buff[LUAI_SAMPLEBUFFER];
+  lu_mem bytes;
+  if (mp == NULL || mp->rate == 0) {  /* sampling is off? */
+    g->samplegap = MAX_LMEM;
+    return;
+  }
+  bytes = mp->gap + cast(lu_mem, -g->samplegap);  /* since last sample */
+  nextgap(g, mp);
+  addsample(g, mp, buff, foldstack(L, tt, buff), bytes);
+}
+
+
+void luaM_freesamples (global_State *g) {
+  MemProf *mp = g->memprof;
+  if (mp != NULL) {
+    freesamples(g, mp);
+    if (mp->hash != NULL)
+      rawalloc(g, mp->hash, mp->size * sizeof(Sample *), 0);
+    rawalloc(g, mp, sizeof(MemProf), 0);
+    g->memprof = NULL;
+  }
+  g->samplegap = MAX_LMEM;
+}
+
+
+/*
+** Sets the mean number of bytes allocated between samples (0 stops
+** sampling, keeping the samples taken so far) and returns the previous
+** value.
+*/
+LUA_API size_t lua_setallocsampling (lua_State *L, size_t rate) {
+  global_State *g;
+  MemProf *mp;
+  size_t old = 0;
+  lua_lock(L);
+  g = G(L);
+  mp = g->memprof;
+  if (mp == NULL && rate > 0) {
+    mp = cast(MemProf *, rawalloc(g, NULL, 0, sizeof(MemProf)));
+    if (mp == NULL)
+      luaD_throw(L, LUA_ERRMEM);
+    mp->rate = mp->gap = 0;
+    mp->rand = g->seed | 1;  /* xorshift state cannot be 0 */
+    mp->size = mp->nuse = 0;
+    mp->hash = NULL;
+    g->memprof = mp;
+  }
+  if (mp != NULL) {
+    old = cast(size_t, mp->rate);
+    mp->rate = rate;
+    nextgap(g, mp);
+  }
+  lua_unlock(L);
+  return old;
+}
+
+
+/*
+** Writes the samples as folded stacks, one per line followed by the
+** number of bytes they account for (the input format of flame graph
+** tools). If 'reset' is true, the samples are discarded afterwards.
+** 'w' must not allocate memory with the state. Returns the error code
+** of the last call to 'w'.
+*/
+LUA_API int lua_dumpallocsamples (lua_State *L, lua_Writer w, void *data,
+                                  int reset) {
+  MemProf *mp;
+  int status = 0;
+  int i;
+  lua_lock(L);
+  mp = G(L)->memprof;
+  if (mp != NULL) {
+    for (i = 0; i < mp->size && status == 0; i++) {
+      Sample *s;
+      for (s = mp->hash[i]; s != NULL && status == 0; s = s->next) {
+        char line[LUAI_SAMPLEBUFFER + LUAI_MAXSHORTLEN];
+        size_t n = s->len;
+        memcpy(line, samplestack(s), n);
+        n += l_sprintf(line + n, LUAI_MAXSHORTLEN, " " LUA_INTEGER_FMT "\n",
+                       cast(LUAI_UACINT, s->bytes));
+        lua_unlock(L);
+        status = (*w)(L, line, n, data);
+        lua_lock(L);
+      }
+    }
+    if (reset)
+      freesamples(G(L), mp);
+  }
+  lua_unlock(L);
+  return status;
+}
@@ -0,0 +1,36 @@
+/*
+** $Id: lmemprof.h $
+** Sampling allocation profiler
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lmemprof_h
+#define lmemprof_h
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/* maximum number of frames recorded in a sample (innermost ones) */
+#if !defined(LUAI_SAMPLEDEPTH)
+#define LUAI_SAMPLEDEPTH	64
+#endif
+
+/* maximum length of a folded stack */
+#if !defined(LUAI_SAMPLEBUFFER)
+#define LUAI_SAMPLEBUFFER	1024
+#endif
+
+
+/*
+** 'g->samplegap' counts down the bytes allocated until the next
+** sample; it stays at MAX_LMEM while sampling is off.
+*/
+#define luaM_sampling(g,n)	(((g)->samplegap -= cast(l_mem, n)) <= 0)
+
+
+LUAI_FUNC void luaM_sample (lua_State *L, int tt);
+LUAI_FUNC void luaM_freesamples (global_State *g);
+
+
+#endif
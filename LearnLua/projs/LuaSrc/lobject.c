@@ -32,6 +32,15 @@
 
 LUAI_DDEF const TValue luaO_nilobject_ = {NILCONSTANT};
 
+#if defined(LUA_NANBOX)
+LUAI_DDEF const lu_byte luaO_nbtag_[16] = {
+  LUA_TNUMFLT, LUA_TNIL, LUA_TBOOLEAN, LUA_TLIGHTUSERDATA, LUA_TLCF,
+  LUA_TNUMINT, LUA_TDEADKEY, ctb(LUA_TSHRSTR), ctb(LUA_TLNGSTR),
+  ctb(LUA_TTABLE), ctb(LUA_TLCL), ctb(LUA_TCCL), ctb(LUA_TUSERDATA),
+  ctb(LUA_TTHREAD), ctb(LUA_TPROTO)
+};
+#endif
+
 
 /*
 ** converts an integer to a "floating point byte", represented as
@@ -249,11 +258,6 @@ static lua_Number lua_strx2number (const char *s, char **endptr) {
 /* }====================================================== */
 
 
-/* maximum length of a numeral */
-#if !defined (L_MAXLENNUM)
-#define L_MAXLENNUM	200
-#endif
-
 static const char *l_str2dloc (const char *s, lua_Number *result, int mode) {
   char *endptr;
   *result = (mode == 'x') ? lua_strx2number(s, &endptr)  /* try to convert */
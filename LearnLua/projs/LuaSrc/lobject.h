@@ -99,10 +99,17 @@ struct GCObject {
 ** an actual value plus a tag with its type.
 */
 
+#if defined(LUA_NANBOX)
+typedef unsigned long long lu_nbox;  /* a whole NaN-boxed value */
+#endif
+
 /*
 ** Union of all Lua values
 */
 typedef union Value {
+#if defined(LUA_NANBOX)
+  lu_nbox nb;      /* tag and value together (see 'NaN boxing' below) */
+#endif
   GCObject *gc;    /* collectable objects */
   void *p;         /* light userdata */
   int b;           /* booleans */
@@ -112,7 +119,11 @@ typedef union Value {
 } Value;
 
 
+#if !defined(LUA_NANBOX)
 #define TValuefields	Value value_; int tt_
+#else
+#define TValuefields	Value value_
+#endif
 
 
 typedef struct lua_TValue {
@@ -408,6 +419,196 @@ typedef struct lua_TValue {
 
 
 
+/*
+** {======================================================
+** NaN boxing
+** =======================================================
+*/
+
+#if defined(LUA_NANBOX)	/* { */
+
+/*
+** A value is a single 64-bit word. A float is stored as itself (with
+** NaNs made positive); any other value is a negative NaN, with a code
+** for its tag in bits 48-51 and its pointer, boolean or integer in bits
+** 0-47. So every word below NB_TAGGED (which includes -inf) is a float.
+*/
+
+#if LUA_FLOAT_TYPE != LUA_FLOAT_DOUBLE || LUA_INT_TYPE != LUA_INT_INT
+#error "LUA_NANBOX needs 'double' floats and 'int' integers"
+#endif
+
+/* codes of the tags (collectable ones last) */
+#define NB_NIL		1
+#define NB_BOOLEAN	2
+#define NB_LIGHTUD	3
+#define NB_LCF		4
+#define NB_INT		5
+#define NB_DEADKEY	6
+#define NB_SHRSTR	7
+#define NB_LNGSTR	8
+#define NB_TABLE	9
+#define NB_LCL		10
+#define NB_CCL		11
+#define NB_UDATA	12
+#define NB_THREAD	13
+#define NB_PROTO	14
+
+/* code of tag 't' (folded to a constant when 't' is one) */
+#define nbcode(t) \
+	((t) == LUA_TNIL ? NB_NIL : (t) == LUA_TBOOLEAN ? NB_BOOLEAN : \
+	 (t) == LUA_TLIGHTUSERDATA ? NB_LIGHTUD : (t) == LUA_TLCF ? NB_LCF : \
+	 (t) == LUA_TNUMINT ? NB_INT : (t) == LUA_TDEADKEY ? NB_DEADKEY : \
+	 (t) == ctb(LUA_TSHRSTR) ? NB_SHRSTR : \
+	 (t) == ctb(LUA_TLNGSTR) ? NB_LNGSTR : \
+	 (t) == ctb(LUA_TTABLE) ? NB_TABLE : (t) == ctb(LUA_TLCL) ? NB_LCL : \
+	 (t) == ctb(LUA_TCCL) ? NB_CCL : \
+	 (t) == ctb(LUA_TUSERDATA) ? NB_UDATA : \
+	 (t) == ctb(LUA_TTHREAD) ? NB_THREAD : NB_PROTO)
+
+/* tag of each code (in lobject.c) */
+LUAI_DDEC const lu_byte luaO_nbtag_[16];
+
+#define NB_WORD(c)	(cast(lu_nbox, 0xFFF0 + (c)) << 48)
+#define NB_TAGGED	NB_WORD(1)
+#define NB_PAYLOAD	((cast(lu_nbox, 1) << 48) - 1)
+#define NB_NAN		(cast(lu_nbox, 0x7FF8) << 48)
+
+#define nb_(o)		(val_(o).nb)
+#define nbptr_(o)	cast(size_t, nb_(o) & NB_PAYLOAD)
+#define nbset_(io,c,x)	(nb_(io) = NB_WORD(c) | (x))
+#define nbsetp_(io,c,p)	nbset_(io, c, cast(size_t, (p)) & NB_PAYLOAD)
+
+
+#undef NILCONSTANT
+#define NILCONSTANT	{NB_WORD(NB_NIL)}
+
+#undef rttype
+#define rttype(o)  \
+	(nb_(o) < NB_TAGGED ? LUA_TNUMFLT : luaO_nbtag_[(nb_(o) >> 48) & 0xF])
+
+#undef checktag
+#define checktag(o,t)  \
+	((t) == LUA_TNUMFLT ? nb_(o) < NB_TAGGED : \
+	                      (nb_(o) >> 48) == 0xFFF0 + nbcode(t))
+
+#undef iscollectable
+#define iscollectable(o)	(nb_(o) >= NB_WORD(NB_SHRSTR))
+
+
+#undef ivalue
+#undef gcvalue
+#undef pvalue
+#undef tsvalue
+#undef uvalue
+#undef clvalue
+#undef clLvalue
+#undef clCvalue
+#undef fvalue
+#undef hvalue
+#undef bvalue
+#undef thvalue
+#undef deadvalue
+
+#define ivalue(o)  \
+	check_exp(ttisinteger(o), l_castU2S(cast(lua_Unsigned, nb_(o))))
+#define gcvalue(o)	check_exp(iscollectable(o), cast(GCObject *, nbptr_(o)))
+#define pvalue(o)	check_exp(ttislightuserdata(o), cast(void *, nbptr_(o)))
+#define tsvalue(o)	check_exp(ttisstring(o), gco2ts(gcvalue(o)))
+#define uvalue(o)	check_exp(ttisfulluserdata(o), gco2u(gcvalue(o)))
+#define clvalue(o)	check_exp(ttisclosure(o), gco2cl(gcvalue(o)))
+#define clLvalue(o)	check_exp(ttisLclosure(o), gco2lcl(gcvalue(o)))
+#define clCvalue(o)	check_exp(ttisCclosure(o), gco2ccl(gcvalue(o)))
+#define fvalue(o)	check_exp(ttislcf(o), cast(lua_CFunction, nbptr_(o)))
+#define hvalue(o)	check_exp(ttistable(o), gco2t(gcvalue(o)))
+#define bvalue(o)  \
+	check_exp(ttisboolean(o), cast_int(cast(unsigned int, nb_(o))))
+#define thvalue(o)	check_exp(ttisthread(o), gco2th(gcvalue(o)))
+#define deadvalue(o)	check_exp(ttisdeadkey(o), cast(void *, nbptr_(o)))
+
+
+/* there is no separate tag to set */
+#undef settt_
+
+#undef setfltvalue
+#undef chgfltvalue
+#undef setivalue
+#undef chgivalue
+#undef setnilvalue
+#undef setfvalue
+#undef setpvalue
+#undef setbvalue
+#undef setgcovalue
+#undef setsvalue
+#undef setuvalue
+#undef setthvalue
+#undef setclLvalue
+#undef setclCvalue
+#undef sethvalue
+#undef setdeadvalue
+
+#define setfltvalue(obj,x) \
+  { TValue *io=(obj); lua_Number n_=(x); \
+    if (luai_numisnan(n_)) nb_(io) = NB_NAN; else val_(io).n = n_; }
+
+#define chgfltvalue(obj,x) \
+  { lua_assert(ttisfloat(obj)); setfltvalue(obj,x); }
+
+#define setivalue(obj,x) \
+  { TValue *io=(obj); nbset_(io, NB_INT, cast(lua_Unsigned, (x))); }
+
+#define chgivalue(obj,x) \
+  { lua_assert(ttisinteger(obj)); setivalue(obj,x); }
+
+#define setnilvalue(obj)	(nb_(obj) = NB_WORD(NB_NIL))
+
+#define setfvalue(obj,x) \
+  { TValue *io=(obj); nbsetp_(io, NB_LCF, (x)); }
+
+#define setpvalue(obj,x) \
+  { TValue *io=(obj); nbsetp_(io, NB_LIGHTUD, (x)); }
+
+#define setbvalue(obj,x) \
+  { TValue *io=(obj); nbset_(io, NB_BOOLEAN, cast(unsigned int, (x))); }
+
+#define setgcovalue(L,obj,x) \
+  { TValue *io = (obj); GCObject *i_g=(x); \
+    nbsetp_(io, nbcode(ctb(i_g->tt)), i_g); }
+
+#define setsvalue(L,obj,x) \
+  { TValue *io = (obj); TString *x_ = (x); \
+    nbsetp_(io, x_->tt == LUA_TSHRSTR ? NB_SHRSTR : NB_LNGSTR, x_); \
+    checkliveness(L,io); }
+
+#define setuvalue(L,obj,x) \
+  { TValue *io = (obj); Udata *x_ = (x); \
+    nbsetp_(io, NB_UDATA, x_); checkliveness(L,io); }
+
+#define setthvalue(L,obj,x) \
+  { TValue *io = (obj); lua_State *x_ = (x); \
+    nbsetp_(io, NB_THREAD, x_); checkliveness(L,io); }
+
+#define setclLvalue(L,obj,x) \
+  { TValue *io = (obj); LClosure *x_ = (x); \
+    nbsetp_(io, NB_LCL, x_); checkliveness(L,io); }
+
+#define setclCvalue(L,obj,x) \
+  { TValue *io = (obj); CClosure *x_ = (x); \
+    nbsetp_(io, NB_CCL, x_); checkliveness(L,io); }
+
+#define sethvalue(L,obj,x) \
+  { TValue *io = (obj); Table *x_ = (x); \
+    nbsetp_(io, NB_TABLE, x_); checkliveness(L,io); }
+
+/* keeps the pointer of the dead key */
+#define setdeadvalue(obj)	nbset_(obj, NB_DEADKEY, nb_(obj) & NB_PAYLOAD)
+
+#endif				/* } */
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** types and prototypes
@@ -428,7 +629,7 @@ typedef TValue *StkId;  /* index to stack elements */
 typedef struct TString {
   CommonHeader;
   lu_byte extra;  /* reserved words for short strings; "has hash" for longs, 短字符串时 >0表示对应的保留字index, ==0表示一般的短字符串;长字符串时:值为1表示hash值已计算,为0表示还未计算 */
-  lu_byte shrlen;  /* length for short strings */
+  lu_byte shrlen;  /* length for short strings; "is a view" for longs */
   unsigned int hash;//长字符串时,该值的初始值为G->seed{参见luaS_newlstr()},此时extra=0表示还未计算hash值; 短字符串时,如果不是保留字,则在创建的时候就会赋值hash
   union {
     size_t lnglen;  /* length for long strings */
@@ -453,7 +654,29 @@ typedef union UTString {
 * 返回ts(类型为TString*)中存储字符串的首字符地址(类型为char*),
 */
 #define getstr(ts)  \
-  check_exp(sizeof((ts)->extra), cast(char *, (ts)) + sizeof(UTString))
+  check_exp(sizeof((ts)->extra), \
+            isstrview(ts) ? strview(ts)->data \
+                          : cast(char *, (ts)) + sizeof(UTString))
+
+
+/*
+** A long string with 'shrlen' set (unused otherwise by long strings)
+** is a view: its contents are a slice of 'parent', a plain long string
+** kept alive by the view, and have no ending zero. 'cstr' is a copy
+** with the ending zero, made when first needed ('luaS_cstr'); the
+** slice stays valid too, for the C code that already holds it.
+*/
+typedef struct StrView {
+  char *data;  /* contents, inside 'parent' */
+  struct TString *parent;
+  char *cstr;  /* zero-terminated copy of the contents, or NULL */
+} StrView;
+
+#define isstrview(ts)	((ts)->tt == LUA_TLNGSTR && (ts)->shrlen != 0)
+
+#define strview(ts)  \
+  check_exp(isstrview(ts), \
+            cast(StrView *, cast(char *, (ts)) + sizeof(UTString)))
 
 
 /* get the actual string (array of bytes) from a Lua value
@@ -514,10 +737,17 @@ typedef union UUdata {
 /*
  * 将U(类型为Udata*)的Value值赋给O(类型为TValue*),并赋值tag
  */
+#if !defined(LUA_NANBOX)
 #define getuservalue(L,u,o) \
 	{ TValue *io=(o); const Udata *iu = (u); \
 	  io->value_ = iu->user_; settt_(io, iu->ttuv_); \
 	  checkliveness(L,io); }
+#else
+#define getuservalue(L,u,o) \
+	{ TValue *io=(o); const Udata *iu = (u); \
+	  io->value_ = iu->user_; (void)iu->ttuv_; \
+	  checkliveness(L,io); }
+#endif
 
 
 /*
@@ -541,6 +771,18 @@ typedef struct LocVar {
 } LocVar;
 
 
+/*
+** Inline cache for a field access with a constant short-string key:
+** the position of the key in the node vector of the table seen last
+** time. Tables built the same way keep their keys at the same
+** positions, so one slot serves all of them. (Slots of backward jumps
+** use 'idx' to count loop iterations; see ltrace.c.)
+*/
+typedef struct FieldCache {
+  unsigned int idx;  /* position of the key in the node vector */
+} FieldCache;
+
+
 /*
 ** Function Prototypes
 */
@@ -549,6 +791,7 @@ typedef struct Proto {
   lu_byte numparams;  /* number of fixed parameters */
   lu_byte is_vararg;
   lu_byte maxstacksize;  /* number of registers needed by this function */
+  lu_byte traced;  /* true if some loop of it has a trace (ltrace.c) */
   int sizeupvalues;  /* size of 'upvalues' */
   int sizek;  /* size of 'k' */
   int sizecode;
@@ -564,6 +807,9 @@ typedef struct Proto {
   LocVar *locvars;  /* information about local variables (debug information) */
   Upvaldesc *upvalues;  /* upvalue information */
   struct LClosure *cache;  /* last-created closure with this prototype */
+  FieldCache *ic;  /* inline caches for field accesses (one per opcode) */
+  struct JitCode *jit;  /* compiled code (NULL if none) */
+  int ncalls;  /* number of calls (up to LUAI_JITCALLS) */
   TString  *source;  /* used for debug information */
   GCObject *gclist;
 } Proto;
@@ -626,10 +872,17 @@ typedef union TKey {
 /* copy a value into a key without messing up field 'next'
  * 将obj(类型为TValue*)的值赋给key(类型为TKey)
  */
+#if !defined(LUA_NANBOX)
 #define setnodekey(L,key,obj) \
 	{ TKey *k_=(key); const TValue *io_=(obj); \
 	  k_->nk.value_ = io_->value_; k_->nk.tt_ = io_->tt_; \
 	  (void)L; checkliveness(L,io_); }
+#else
+#define setnodekey(L,key,obj) \
+	{ TKey *k_=(key); const TValue *io_=(obj); \
+	  k_->nk.value_ = io_->value_; \
+	  (void)L; checkliveness(L,io_); }
+#endif
 
 
 typedef struct Node {
@@ -646,14 +899,71 @@ typedef struct Table {
   
   lu_byte lsizenode;  /* log2 of size of 'node' array */
   unsigned int sizearray;  /* size of 'array' array */
+  unsigned int lenhint;  /* last border found by 'luaH_getn' */
   TValue *array;  /* array part */
   Node *node;
   Node *lastfree;  /* any free position is before this position, 新建了node数组之后,该值为&node[nodesize]，见setnodevector, 注意这是个越界值,取用的使用从lastfree--开始 */
   struct Table *metatable;
   GCObject *gclist;
+#if defined(LUA_USE_SHAPES)
+  struct Shape *shape;  /* keys of 'fields' (NULL when not a record) */
+  TValue *fields;  /* values of the keys in 'shape' */
+  unsigned int sizefields;  /* size of 'fields' */
+#endif
+#if defined(LUA_USE_SWISSTABLE)
+  lu_byte *ctrl;  /* control bytes of 'node' (see ltable.c) */
+  unsigned int growthleft;  /* keys 'node' can still take */
+#endif
+#if defined(LUA_USE_INCREHASH)
+  struct Rehash *rh;  /* key counts of a large hash part (or NULL) */
+#endif
 } Table;
 
 
+#if defined(LUA_USE_INCREHASH)
+/*
+** Bookkeeping of a large hash part (see ltable.c). 'nkeys' and 'nums'
+** estimate its keys (in total and the integer ones in each slice
+** (2^(i - 1), 2^i]): they are counted as keys are inserted, and
+** recounted by a pass over a few nodes per insertion, which drops the
+** keys deleted since. When the part is full, a new one is sized from
+** them, and the entries of the old one ('old', a table used only for
+** its hash part) are migrated a few at a time by later insertions.
+*/
+typedef struct Rehash {
+  Table old;  /* hash part being migrated ('old.node' NULL if none) */
+  int pending;  /* nodes of 'old' not migrated yet: [0, pending) */
+  int step;  /* nodes of 'old' migrated per insertion */
+  unsigned int nkeys;
+  unsigned int nums[sizeof(int) * CHAR_BIT];
+  unsigned int cursor;  /* nodes [0, cursor) seen by the counting pass */
+  unsigned int ckeys;  /* keys found by the counting pass */
+  unsigned int cnums[sizeof(int) * CHAR_BIT];
+} Rehash;
+#endif
+
+
+#if defined(LUA_USE_SHAPES)
+/*
+** Shape of a record: the (short-string) keys of a table, in the order
+** they were added, shared by all tables built the same way. Shapes
+** are immutable and form a tree rooted at 'g->shaperoot': adding a key
+** moves the table to a child ("transition"). They are not collectable
+** objects: 'refs' counts the tables and children using them; the keys
+** are marked from the tree. A record has no hash part (only fields and
+** the array part); a deleted field stays as a nil hole.
+*/
+typedef struct Shape {
+  struct Shape *parent;  /* shape without the last key */
+  struct Shape *kids;  /* transitions from this shape */
+  struct Shape *sibling;  /* next transition from 'parent' */
+  int refs;
+  unsigned int nkeys;
+  struct TString *keys[1];  /* keys ('keys[nkeys - 1]' is the last one) */
+} Shape;
+#endif
+
+
 
 /*
 ** 'module' operation for hashing (size is always a power of 2)
@@ -681,6 +991,11 @@ LUAI_DDEC const TValue luaO_nilobject_;
 /* size of buffer for 'luaO_utf8esc' function */
 #define UTF8BUFFSZ	8
 
+/* maximum length of a numeral (for locale retries in 'luaO_str2num') */
+#if !defined (L_MAXLENNUM)
+#define L_MAXLENNUM	200
+#endif
+
 LUAI_FUNC int luaO_int2fb (unsigned int x);
 LUAI_FUNC int luaO_fb2int (int x);
 LUAI_FUNC int luaO_utf8esc (char *buff, unsigned long x);
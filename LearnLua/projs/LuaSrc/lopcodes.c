@@ -65,6 +65,22 @@ LUAI_DDEF const char *const luaP_opnames[NUM_OPCODES+1] = {
   "CLOSURE",
   "VARARG",
   "EXTRAARG",
+  "ADDII",
+  "ADDFF",
+  "SUBII",
+  "SUBFF",
+  "MULII",
+  "MULFF",
+  "EQII",
+  "EQFF",
+  "LTII",
+  "LTFF",
+  "LEII",
+  "LEFF",
+  "EQK",
+  "LOADK2",
+  "GETTABUP2",
+  "GETTABLE2",
   NULL
 };
 
@@ -120,5 +136,42 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, OpArgU, OpArgN, iABx)		/* OP_CLOSURE */
  ,opmode(0, 1, OpArgU, OpArgN, iABC)		/* OP_VARARG */
  ,opmode(0, 0, OpArgU, OpArgU, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDFF */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SUBII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SUBFF */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_MULII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_MULFF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_EQII */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_EQFF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LTII */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LTFF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LEII */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LEFF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_EQK */
+ ,opmode(0, 1, OpArgK, OpArgN, iABx)		/* OP_LOADK2 */
+ ,opmode(0, 1, OpArgU, OpArgK, iABC)		/* OP_GETTABUP2 */
+ ,opmode(0, 1, OpArgR, OpArgK, iABC)		/* OP_GETTABLE2 */
 };
 
+
+/*
+** generic opcode of a quickened opcode or a superinstruction (identity
+** for the others)
+*/
+OpCode luaP_generic (OpCode o) {
+  switch (o) {
+    case OP_ADDII: case OP_ADDFF: return OP_ADD;
+    case OP_SUBII: case OP_SUBFF: return OP_SUB;
+    case OP_MULII: case OP_MULFF: return OP_MUL;
+    case OP_EQII: case OP_EQFF: return OP_EQ;
+    case OP_LTII: case OP_LTFF: return OP_LT;
+    case OP_LEII: case OP_LEFF: return OP_LE;
+    case OP_EQK: return OP_EQ;
+    case OP_LOADK2: return OP_LOADK;
+    case OP_GETTABUP2: return OP_GETTABUP;
+    case OP_GETTABLE2: return OP_GETTABLE;
+    default: return o;
+  }
+}
+
@@ -230,11 +230,37 @@ OP_CLOSURE,/*	A Bx	R(A) := closure(KPROTO[Bx])			*/
 
 OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-2) = vararg		*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+/* quickened opcodes (see note) */
+OP_ADDII,/*	A B C	R(A) := RK(B) + RK(C)	(integers)		*/
+OP_ADDFF,/*	A B C	R(A) := RK(B) + RK(C)	(floats)		*/
+OP_SUBII,/*	A B C	R(A) := RK(B) - RK(C)	(integers)		*/
+OP_SUBFF,/*	A B C	R(A) := RK(B) - RK(C)	(floats)		*/
+OP_MULII,/*	A B C	R(A) := RK(B) * RK(C)	(integers)		*/
+OP_MULFF,/*	A B C	R(A) := RK(B) * RK(C)	(floats)		*/
+OP_EQII,/*	A B C	if ((RK(B) == RK(C)) ~= A) then pc++	(integers)	*/
+OP_EQFF,/*	A B C	if ((RK(B) == RK(C)) ~= A) then pc++	(floats)	*/
+OP_LTII,/*	A B C	if ((RK(B) <  RK(C)) ~= A) then pc++	(integers)	*/
+OP_LTFF,/*	A B C	if ((RK(B) <  RK(C)) ~= A) then pc++	(floats)	*/
+OP_LEII,/*	A B C	if ((RK(B) <= RK(C)) ~= A) then pc++	(integers)	*/
+OP_LEFF,/*	A B C	if ((RK(B) <= RK(C)) ~= A) then pc++	(floats)	*/
+
+/* superinstructions (see note) */
+OP_EQK,/*	A B C	if ((RK(B) == K(C)) ~= A) then pc++	(raw K(C))	*/
+OP_LOADK2,/*	A Bx	R(A) := Kst(Bx); then next OP_LOADK		*/
+OP_GETTABUP2,/*	A B C	R(A) := UpValue[B][RK(C)]; then next OP_GETTABLE */
+OP_GETTABLE2/*	A B C	R(A) := R(B)[RK(C)]; then next OP_GETTABLE	*/
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_EXTRAARG) + 1)
+#define NUM_OPCODES	(cast(int, OP_GETTABLE2) + 1)
+
+/* true for opcodes that only appear after quickening */
+#define isquickened(o)	((o) >= OP_ADDII && (o) <= OP_LEFF)
+
+/* true for opcodes that can appear in precompiled chunks */
+#define isgeneric(o)	((o) <= OP_EXTRAARG)
 
 
 
@@ -259,6 +285,22 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
 
   (*) All 'skips' (pc++) assume that next instruction is a jump.
 
+  (*) The code generator never emits quickened opcodes. The first time
+  OP_ADD, OP_SUB, OP_MUL, OP_EQ, OP_LT or OP_LE runs with two integers
+  (or two floats), the interpreter rewrites it in place to the matching
+  specialized form, which only checks the operand tags. When that check
+  fails, the instruction goes back to its generic form. Dumps always
+  contain the generic forms (see 'luaP_generic').
+
+  (*) Superinstructions are produced by 'luaK_fuse' when a function is
+  closed or loaded, and also never appear in dumps. OP_EQK is OP_EQ
+  with a nil, boolean or short-string constant K(C), which needs no
+  metamethods or coercions. The other ones run their own generic form
+  and then, in the same dispatch (unless a hook is set), the next
+  instruction, which is left unchanged: OP_LOADK2 is followed by an
+  OP_LOADK, OP_GETTABUP2 and OP_GETTABLE2 by an OP_GETTABLE indexing
+  the register they set (as in 'math.floor' or 'a.b.c').
+
 ===========================================================================*/
 
 
@@ -289,6 +331,8 @@ LUAI_DDEC const lu_byte luaP_opmodes[NUM_OPCODES];
 
 LUAI_DDEC const char *const luaP_opnames[NUM_OPCODES+1];  /* opcode names */
 
+LUAI_FUNC OpCode luaP_generic (OpCode o);
+
 
 /* number of list items to accumulate before a SETLIST instruction */
 #define LFIELDS_PER_FLUSH	50
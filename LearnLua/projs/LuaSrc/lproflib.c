@@ -0,0 +1,491 @@
+/*
+** $Id: lproflib.c $
+** Statistical CPU profiler
+** See Copyright Notice in lua.h
+*/
+
+#define lproflib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/*
+** The profiler is driven by a POSIX interval timer (ITIMER_PROF, which
+** counts CPU time). The signal handler only sets a count hook with
+** count 1 ('lua_sethook' is safe in a signal handler, as used by
+** 'lua.c'), so the hook fires at the next instruction: it puts back the
+** hook that was there before and takes the sample. Between samples
+** the profiled code runs with its usual hooks.
+**
+** Only one state can be profiled at a time, and samples come from the
+** thread that called 'start', which is kept alive until 'stop'. Time spent in coroutines or in C
+** functions is charged to the Lua code running right after them. A
+** count hook set on that thread restarts its count at each sample.
+*/
+
+
+/* number of innermost frames kept in a sample */
+#if !defined(LUAI_PROFDEPTH)
+#define LUAI_PROFDEPTH		64
+#endif
+
+/* default sampling interval, in microseconds */
+#define PROFINTERVAL		1000
+
+/* default maximum number of samples kept in the timeline */
+#define PROFMAXEVENTS		1000000
+
+
+/* key, in the registry, for the profiler of a state */
+static const int PROFKEY = 0;
+
+/* key, in the registry, for the thread being profiled (keeps it alive) */
+static const int PROFTHREAD = 0;
+
+
+/* indices of the tables in the uservalue of a profiler */
+#define STACKS		1	/* folded stack -> id */
+#define NAMES		2	/* id -> folded stack */
+#define COUNTS		3	/* id -> number of samples */
+#define EVSTACK		4	/* timeline: i -> id */
+#define EVTIME		5	/* timeline: i -> time (microseconds) */
+#define NTABLES		5
+
+
+typedef struct Profiler {
+  lua_State *L;  /* thread being profiled (NULL if stopped) */
+  lua_Hook oldhook;  /* hook of 'L' before the pending sample */
+  int oldmask;
+  int oldcount;
+  lua_Integer interval;  /* sampling interval (microseconds) */
+  lua_Integer maxevents;  /* maximum size of the timeline */
+  lua_Integer nsamples;
+  lua_Integer nstacks;  /* number of different stacks */
+  lua_Integer nevents;  /* number of samples in the timeline */
+  lua_Integer start;  /* time profiling started */
+} Profiler;
+
+
+static Profiler *getprofiler (lua_State *L) {
+  Profiler *P;
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &PROFKEY);
+  P = (Profiler *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return P;
+}
+
+
+/* push table 'i' of the profiler */
+static void gettable (lua_State *L, int i) {
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &PROFKEY);
+  lua_getuservalue(L, -1);
+  lua_rawgeti(L, -1, i);
+  lua_replace(L, -3);
+  lua_pop(L, 1);
+}
+
+
+static void addname (luaL_Buffer *b, const char *s) {
+  for (; *s != '\0'; s++)
+    luaL_addchar(b, (*s == ';') ? ',' : *s);  /* ';' separates frames */
+}
+
+
+/*
+** Pushes the folded stack of 'L': its frames, outermost first, as
+** "name@source:line" separated by ';'.
+*/
+static void foldstack (lua_State *L) {
+  lua_Debug ar;
+  luaL_Buffer b;
+  int depth = 0;
+  luaL_buffinit(L, &b);
+  if (lua_getstack(L, LUAI_PROFDEPTH, &ar)) {  /* too deep? */
+    luaL_addstring(&b, "...;");
+    depth = LUAI_PROFDEPTH;
+  }
+  else {
+    while (lua_getstack(L, depth, &ar))
+      depth++;
+  }
+  while (depth-- > 0) {
+    char line[32];
+    lua_getstack(L, depth, &ar);
+    lua_getinfo(L, "Sln", &ar);
+    if (ar.name != NULL)
+      addname(&b, ar.name);
+    else
+      luaL_addstring(&b, (*ar.what == 'm') ? "main chunk" : "?");
+    luaL_addchar(&b, '@');
+    if (*ar.what == 'C')
+      luaL_addstring(&b, "[C]");
+    else {
+      addname(&b, ar.short_src);
+      l_sprintf(line, sizeof(line), ":%d", ar.currentline);
+      luaL_addstring(&b, line);
+    }
+    if (depth > 0)
+      luaL_addchar(&b, ';');
+  }
+  luaL_pushresult(&b);
+}
+
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
+
+
+/* the only profiler running (if any) */
+static Profiler *volatile active = NULL;
+
+static struct sigaction oldaction;
+
+
+static lua_Integer now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (lua_Integer)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void sample (lua_State *L, Profiler *P) {
+  lua_Integer id;
+  int top = lua_gettop(L);
+  foldstack(L);
+  gettable(L, STACKS);
+  lua_pushvalue(L, -2);
+  if (lua_rawget(L, -2) == LUA_TNUMBER)  /* known stack? */
+    id = lua_tointeger(L, -1);
+  else {  /* new stack */
+    id = ++P->nstacks;
+    lua_pushvalue(L, top + 1);
+    lua_pushinteger(L, id);
+    lua_rawset(L, top + 2);  /* STACKS[stack] = id */
+    gettable(L, NAMES);
+    lua_pushvalue(L, top + 1);
+    lua_rawseti(L, -2, id);  /* NAMES[id] = stack */
+    lua_pop(L, 1);
+  }
+  gettable(L, COUNTS);
+  lua_pushinteger(L, (lua_rawgeti(L, -1, id) == LUA_TNUMBER)
+                     ? lua_tointeger(L, -1) + 1 : 1);
+  lua_rawseti(L, -3, id);
+  P->nsamples++;
+  if (P->nevents < P->maxevents) {
+    P->nevents++;
+    gettable(L, EVSTACK);
+    lua_pushinteger(L, id);
+    lua_rawseti(L, -2, P->nevents);
+    gettable(L, EVTIME);
+    lua_pushinteger(L, now() - P->start);
+    lua_rawseti(L, -2, P->nevents);
+  }
+  lua_settop(L, top);
+}
+
+
+static void profhook (lua_State *L, lua_Debug *ar) {
+  Profiler *P = getprofiler(L);
+  (void)ar;
+  if (P == NULL || P->L == NULL)  /* left over after 'stop'? */
+    lua_sethook(L, NULL, 0, 0);
+  else {
+    lua_sethook(L, P->oldhook, P->oldmask, P->oldcount);  /* one shot */
+    sample(L, P);
+  }
+}
+
+
+static void profsignal (int i) {
+  Profiler *P = active;
+  (void)i;
+  if (P != NULL && P->L != NULL) {
+    lua_State *L = P->L;
+    if (lua_gethook(L) != profhook) {  /* save the hook in use now */
+      P->oldhook = lua_gethook(L);
+      P->oldmask = lua_gethookmask(L);
+      P->oldcount = lua_gethookcount(L);
+    }
+    lua_sethook(L, profhook, LUA_MASKCOUNT, 1);
+  }
+}
+
+
+static void settimer (lua_Integer us) {
+  struct itimerval it;
+  it.it_interval.tv_sec = (time_t)(us / 1000000);
+  it.it_interval.tv_usec = (suseconds_t)(us % 1000000);
+  it.it_value = it.it_interval;
+  setitimer(ITIMER_PROF, &it, NULL);
+}
+
+
+static int startprofiler (lua_State *L, Profiler *P) {
+  struct sigaction sa;
+  if (active != NULL)
+    return luaL_error(L, "a profiler is already running");
+  lua_pushthread(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &PROFTHREAD);  /* anchor 'L' */
+  P->L = L;
+  P->oldhook = lua_gethook(L);
+  P->oldmask = lua_gethookmask(L);
+  P->oldcount = lua_gethookcount(L);
+  if (P->nsamples == 0)
+    P->start = now();
+  active = P;
+  sa.sa_handler = profsignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGPROF, &sa, &oldaction);
+  settimer(P->interval);
+  return 0;
+}
+
+
+static void stopprofiler (lua_State *L, Profiler *P) {
+  if (P->L != NULL && active == P) {
+    lua_State *PL = P->L;
+    settimer(0);
+    sigaction(SIGPROF, &oldaction, NULL);
+    active = NULL;
+    P->L = NULL;
+    if (lua_gethook(PL) == profhook)  /* signal came after last sample? */
+      lua_sethook(PL, P->oldhook, P->oldmask, P->oldcount);
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &PROFTHREAD);  /* release it */
+  }
+}
+
+#else				/* }{ */
+
+static int startprofiler (lua_State *L, Profiler *P) {
+  (void)P;
+  return luaL_error(L, "profiler not supported on this platform");
+}
+
+#define stopprofiler(L,P)	((void)(L), (void)(P))
+
+#endif				/* } */
+
+
+static void newtables (lua_State *L, int idx) {
+  int i;
+  lua_createtable(L, NTABLES, 0);
+  for (i = 1; i <= NTABLES; i++) {
+    lua_newtable(L);
+    lua_rawseti(L, -2, i);
+  }
+  lua_setuservalue(L, idx);
+}
+
+
+static int prof_start (lua_State *L) {
+  Profiler *P = getprofiler(L);
+  lua_Integer interval = luaL_optinteger(L, 1, PROFINTERVAL);
+  lua_Integer maxevents = luaL_optinteger(L, 2, PROFMAXEVENTS);
+  luaL_argcheck(L, interval > 0, 1, "interval must be positive");
+  luaL_argcheck(L, maxevents >= 0, 2, "negative size");
+  if (P->L != NULL)
+    return luaL_error(L, "profiler already started");
+  P->interval = interval;
+  P->maxevents = maxevents;
+  startprofiler(L, P);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+static int prof_stop (lua_State *L) {
+  Profiler *P = getprofiler(L);
+  stopprofiler(L, P);
+  lua_pushinteger(L, P->nsamples);
+  return 1;
+}
+
+
+static int prof_reset (lua_State *L) {
+  Profiler *P = getprofiler(L);
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &PROFKEY);
+  newtables(L, lua_gettop(L));
+  P->nsamples = P->nstacks = P->nevents = 0;
+#if defined(LUA_USE_POSIX)
+  P->start = now();
+#endif
+  return 0;
+}
+
+
+/*
+** Folded stacks: one line per stack, with its number of samples.
+*/
+static int prof_folded (lua_State *L) {
+  Profiler *P = getprofiler(L);
+  luaL_Buffer b;
+  lua_Integer id;
+  gettable(L, NAMES);
+  gettable(L, COUNTS);
+  luaL_buffinit(L, &b);
+  for (id = 1; id <= P->nstacks; id++) {
+    char line[32];
+    lua_rawgeti(L, 1, id);
+    luaL_addvalue(&b);
+    lua_rawgeti(L, 2, id);
+    l_sprintf(line, sizeof(line), " " LUA_INTEGER_FMT "\n",
+              (LUAI_UACINT)lua_tointeger(L, -1));
+    lua_pop(L, 1);
+    luaL_addstring(&b, line);
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+
+static void addevent (luaL_Buffer *b, const char *frame, size_t l,
+                      int ph, lua_Integer ts) {
+  char buff[64];
+  luaL_addstring(b, "{\"name\":\"");
+  for (; l > 0; frame++, l--) {
+    unsigned char c = (unsigned char)*frame;
+    if (c == '"' || c == '\\') {
+      luaL_addchar(b, '\\');
+      luaL_addchar(b, c);
+    }
+    else if (c < 0x20) {
+      l_sprintf(buff, sizeof(buff), "\\u%04x", c);
+      luaL_addstring(b, buff);
+    }
+    else
+      luaL_addchar(b, c);
+  }
+  l_sprintf(buff, sizeof(buff), "\",\"ph\":\"%c\",\"pid\":1,\"tid\":1,", ph);
+  luaL_addstring(b, buff);
+  l_sprintf(buff, sizeof(buff), "\"ts\":" LUA_INTEGER_FMT "},\n",
+            (LUAI_UACINT)ts);
+  luaL_addstring(b, buff);
+}
+
+
+/* length of the first frame in 's' */
+#define framelen(s)	strcspn(s, ";")
+
+
+/*
+** Emits "E" events for the frames of 'prev' (innermost first) after
+** its first 'keep' frames.
+*/
+static void closeframes (luaL_Buffer *b, const char *prev, int keep,
+                                         lua_Integer ts) {
+  const char *frames[LUAI_PROFDEPTH + 1];
+  int n = 0;
+  while (*prev != '\0' && n <= LUAI_PROFDEPTH) {
+    frames[n++] = prev;
+    prev += framelen(prev);
+    if (*prev == ';') prev++;
+  }
+  while (n-- > keep)
+    addevent(b, frames[n], framelen(frames[n]), 'E', ts);
+}
+
+
+/*
+** Chrome trace (JSON) with the timeline of samples: each sample opens
+** the frames it does not share with the previous one ("B" events) and
+** closes the others ("E" events). A stack lasts until the next sample,
+** or for one interval if no sample comes in twice that time.
+*/
+static int prof_chrome (lua_State *L) {
+  Profiler *P = getprofiler(L);
+  luaL_Buffer b;
+  const char *prev = "";
+  lua_Integer prevts = 0;
+  lua_Integer i;
+  gettable(L, NAMES);
+  gettable(L, EVSTACK);
+  gettable(L, EVTIME);
+  luaL_buffinit(L, &b);
+  luaL_addstring(&b, "{\"traceEvents\":[\n");
+  for (i = 1; i <= P->nevents; i++) {
+    const char *cur, *p, *c;
+    lua_Integer ts;
+    int keep = 0;
+    lua_rawgeti(L, 3, i);
+    ts = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    lua_rawgeti(L, 2, i);
+    lua_rawget(L, 1);  /* NAMES[EVSTACK[i]] */
+    cur = lua_tostring(L, -1);  /* (kept alive by NAMES) */
+    lua_pop(L, 1);
+    if (*prev != '\0' && ts - prevts > 2 * P->interval) {  /* a gap? */
+      closeframes(&b, prev, 0, prevts + P->interval);
+      prev = "";
+    }
+    for (p = prev, c = cur; *p != '\0' && *c != '\0'; keep++) {
+      size_t l = framelen(p);
+      if (l != framelen(c) || memcmp(p, c, l) != 0)
+        break;  /* stacks differ from here on */
+      p += l; c += l;
+      if (*p == ';') p++;
+      if (*c == ';') c++;
+    }
+    closeframes(&b, prev, keep, ts);
+    while (*c != '\0') {
+      size_t l = framelen(c);
+      addevent(&b, c, l, 'B', ts);
+      c += l;
+      if (*c == ';') c++;
+    }
+    prev = cur;
+    prevts = ts;
+  }
+  closeframes(&b, prev, 0, prevts + P->interval);
+  luaL_addstring(&b, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"args\":{\"name\":\"lua\"}}]}\n");
+  luaL_pushresult(&b);
+  return 1;
+}
+
+
+static int prof_gc (lua_State *L) {
+  stopprofiler(L, (Profiler *)lua_touserdata(L, 1));
+  return 0;
+}
+
+
+static const luaL_Reg proflib[] = {
+  {"start", prof_start},
+  {"stop", prof_stop},
+  {"reset", prof_reset},
+  {"folded", prof_folded},
+  {"chrome", prof_chrome},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_profiler (lua_State *L) {
+  Profiler *P = (Profiler *)lua_newuserdata(L, sizeof(Profiler));
+  memset(P, 0, sizeof(Profiler));
+  P->interval = PROFINTERVAL;
+  P->maxevents = PROFMAXEVENTS;
+  newtables(L, -2);
+  lua_createtable(L, 0, 1);
+  lua_pushcfunction(L, prof_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &PROFKEY);
+  luaL_newlib(L, proflib);
+  return 1;
+}
+
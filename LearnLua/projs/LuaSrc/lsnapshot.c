@@ -0,0 +1,222 @@
+/*
+** $Id: lsnapshot.c $
+** Heap snapshots
+** See Copyright Notice in lua.h
+*/
+
+#define lsnapshot_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <string.h>
+
+#include "lua.h"
+
+#include "lgc.h"
+#include "lobject.h"
+#include "lsnapshot.h"
+#include "lstate.h"
+#include "lstring.h"
+
+
+#if !defined(LUAI_SNAPBUFFER)
+#define LUAI_SNAPBUFFER		4096
+#endif
+
+
+typedef struct SnapState {
+  lua_State *L;
+  lua_Writer writer;
+  void *data;
+  int status;
+  size_t nnodes;
+  size_t n;  /* bytes in 'buff' */
+  char buff[LUAI_SNAPBUFFER];
+} SnapState;
+
+
+static void flush (SnapState *S) {
+  if (S->status == 0 && S->n > 0) {
+    lua_unlock(S->L);
+    S->status = (*S->writer)(S->L, S->buff, S->n, S->data);
+    lua_lock(S->L);
+  }
+  S->n = 0;
+}
+
+
+static void putblock (SnapState *S, const void *b, size_t size) {
+  const char *p = (const char *)b;
+  while (size > 0) {
+    size_t n = LUAI_SNAPBUFFER - S->n;
+    if (n == 0) {
+      flush(S);
+      n = LUAI_SNAPBUFFER;
+    }
+    if (n > size) n = size;
+    memcpy(S->buff + S->n, p, n);
+    S->n += n;
+    p += n;
+    size -= n;
+  }
+}
+
+
+static void putbyte (SnapState *S, int b) {
+  if (S->n == LUAI_SNAPBUFFER)
+    flush(S);
+  S->buff[S->n++] = cast(char, b);
+}
+
+
+static void putvarint (SnapState *S, size_t x) {
+  while (x >= 0x80) {
+    putbyte(S, cast_int(x & 0x7f) | 0x80);
+    x >>= 7;
+  }
+  putbyte(S, cast_int(x));
+}
+
+
+#define putid(S,o)	putvarint(S, (size_t)(o))
+
+
+static void putkey (SnapState *S, const TValue *k) {
+  if (k == NULL)
+    putbyte(S, SNAP_KNONE);
+  else if (iscollectable(k)) {
+    putbyte(S, SNAP_KOBJ);
+    putid(S, gcvalue(k));
+  }
+  else if (ttisinteger(k)) {
+    lua_Unsigned u = l_castS2U(ivalue(k));
+    lua_Unsigned sign = (ivalue(k) < 0) ? ~(lua_Unsigned)0 : 0;
+    putbyte(S, SNAP_KINT);
+    putvarint(S, (size_t)((u << 1) ^ sign));  /* zig-zag */
+  }
+  else if (ttisfloat(k)) {
+    double d = cast(double, fltvalue(k));
+    putbyte(S, SNAP_KFLT);
+    putblock(S, &d, sizeof(d));
+  }
+  else if (ttisboolean(k)) {
+    putbyte(S, SNAP_KBOOL);
+    putbyte(S, bvalue(k));
+  }
+  else if (ttislightuserdata(k)) {
+    putbyte(S, SNAP_KPTR);
+    putvarint(S, (size_t)pvalue(k));
+  }
+  else
+    putbyte(S, SNAP_KNONE);
+}
+
+
+static void putedge (SnapState *S, int kind, const TValue *k,
+                                   const GCObject *o) {
+  putbyte(S, SNAP_EDGE);
+  putbyte(S, kind);
+  putkey(S, k);
+  putid(S, o);
+}
+
+
+static void visitor (void *ud, int kind, const TValue *k, GCObject *o) {
+  putedge(cast(SnapState *, ud), kind, k, o);
+}
+
+
+static void putroot (SnapState *S, const char *label, const GCObject *o) {
+  size_t l = strlen(label);
+  putbyte(S, SNAP_EDGE);
+  putbyte(S, SNAP_RROOT);
+  putbyte(S, SNAP_KLABEL);
+  putvarint(S, l);
+  putblock(S, label, l);
+  putid(S, o);
+}
+
+
+static void putnode (SnapState *S, global_State *g, GCObject *o) {
+  putbyte(S, SNAP_NODE);
+  putid(S, o);
+  putbyte(S, o->tt);
+  putvarint(S, luaC_traverserefs(g, o, NULL, NULL));  /* size */
+  switch (o->tt) {
+    case LUA_TSHRSTR: case LUA_TLNGSTR: {
+      size_t l = tsslen(gco2ts(o));
+      putvarint(S, l);
+      putblock(S, getstr(gco2ts(o)), (l < SNAPSTRMAX) ? l : SNAPSTRMAX);
+      break;
+    }
+    case LUA_TPROTO: {
+      Proto *p = gco2p(o);
+      putid(S, p->source);
+      putvarint(S, cast(size_t, p->linedefined));
+      break;
+    }
+    default: break;
+  }
+  luaC_traverserefs(g, o, visitor, S);
+  S->nnodes++;
+}
+
+
+static void putlist (SnapState *S, global_State *g, GCObject *o) {
+  for (; o != NULL && S->status == 0; o = o->next)
+    putnode(S, g, o);
+}
+
+
+/*
+** Writes a snapshot of all objects in the state. It starts with a full
+** collection, so that the lists have no dead objects; then the
+** collector is stopped until the end, and 'w' must not allocate memory
+** with the state. Returns the error code of the last call to 'w'.
+*/
+LUA_API int lua_heapsnapshot (lua_State *L, lua_Writer w, void *data) {
+  global_State *g;
+  lu_byte running;
+  SnapState S;
+  GCObject *o;
+  int i;
+  lua_lock(L);
+  g = G(L);
+  running = g->gcrunning;
+  S.L = L;
+  S.writer = w;
+  S.data = data;
+  S.status = 0;
+  S.nnodes = 0;
+  S.n = 0;
+  luaC_fullgc(L, 0);
+  g->gcrunning = 0;
+  putblock(&S, LUA_SNAPSIGNATURE, sizeof(LUA_SNAPSIGNATURE) - 1);
+  putbyte(&S, LUA_SNAPVERSION);
+  putbyte(&S, SNAP_NODE);  /* root node */
+  putvarint(&S, 0);
+  putbyte(&S, SNAP_TROOT);
+  putvarint(&S, 0);
+  putroot(&S, "registry", gcvalue(&g->l_registry));
+  putroot(&S, "mainthread", obj2gco(g->mainthread));
+  for (i = 0; i < LUA_NUMTAGS; i++) {
+    if (g->mt[i] != NULL)
+      putroot(&S, ttypename(i), obj2gco(g->mt[i]));
+  }
+  for (o = g->tobefnz; o != NULL; o = o->next)
+    putroot(&S, "tobefnz", o);
+  for (o = g->fixedgc; o != NULL; o = o->next)
+    putroot(&S, "fixed", o);
+  putlist(&S, g, g->allgc);
+  putlist(&S, g, g->finobj);
+  putlist(&S, g, g->tobefnz);
+  putlist(&S, g, g->fixedgc);
+  putbyte(&S, SNAP_END);
+  putvarint(&S, S.nnodes);
+  flush(&S);
+  g->gcrunning = running;
+  lua_unlock(L);
+  return S.status;
+}
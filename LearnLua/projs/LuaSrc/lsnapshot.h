@@ -0,0 +1,51 @@
+/*
+** $Id: lsnapshot.h $
+** Heap snapshots
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lsnapshot_h
+#define lsnapshot_h
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** A snapshot is the signature, a version byte and a list of records,
+** each one starting with its tag byte. Numbers are unsigned LEB128
+** ("varints"); object ids are their addresses. Each node is followed
+** by the edges leaving it.
+*/
+#define LUA_SNAPSIGNATURE	"\x1bLHS"
+#define LUA_SNAPVERSION		1
+
+/* records */
+#define SNAP_NODE	'N'	/* id, type byte, size, extra data (below) */
+#define SNAP_EDGE	'E'	/* kind byte, key, target id */
+#define SNAP_END	'Z'	/* number of nodes */
+
+/*
+** Extra data of nodes: strings have their length and up to SNAPSTRMAX
+** bytes of their contents; prototypes have the id of their source
+** (or 0) and their 'linedefined'.
+*/
+#define SNAPSTRMAX	40
+
+/* type of the root node, with id 0 */
+#define SNAP_TROOT	0xFF
+
+/* kind of the edges from the root (other kinds as in 'lgc.h') */
+#define SNAP_RROOT	15
+
+/* keys of edges: a tag byte followed by the value */
+#define SNAP_KNONE	0	/* no key */
+#define SNAP_KOBJ	1	/* id of a collectable key (strings included) */
+#define SNAP_KINT	2	/* integer (zig-zag varint) */
+#define SNAP_KFLT	3	/* float (8 bytes, native order) */
+#define SNAP_KBOOL	4	/* boolean (a byte) */
+#define SNAP_KPTR	5	/* light userdata (varint) */
+#define SNAP_KLABEL	6	/* literal name (length and bytes) */
+
+
+#endif
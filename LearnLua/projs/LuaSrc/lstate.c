@@ -22,10 +22,12 @@
 #include "lgc.h"
 #include "llex.h"
 #include "lmem.h"
+#include "lmemprof.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "ltrace.h"
 
 
 #if !defined(LUAI_GCPAUSE)
@@ -210,6 +212,7 @@ static void f_luaopen (lua_State *L, void *ud) {
   global_State *g = G(L);
   UNUSED(ud);
   stack_init(L, L);  /* init stack */
+  luaH_initshapes(L);
   init_registry(L, g);//初始化 G->l_registry
   luaS_init(L);//初始化G中字符串(S)相关的变量{初始化G->strt(string table)和G->strcache}
   luaT_init(L);//初始化G->tmname[],用来保存"__index"等字符串,
@@ -237,6 +240,7 @@ static void preinit_thread (lua_State *L, global_State *g) {
   L->hookmask = 0;
   L->basehookcount = 0;
   L->allowhook = 1;
+  L->rec = NULL;
   resethookcount(L);
   L->openupval = NULL;
   L->nny = 1;
@@ -248,11 +252,16 @@ static void preinit_thread (lua_State *L, global_State *g) {
 static void close_state (lua_State *L) {
   global_State *g = G(L);
   luaF_close(L, L->stack);  /* close all upvalues for this thread */
+  luaR_abort(L);  /* discard trace being recorded */
   luaC_freeallobjects(L);  /* collect all objects */
   if (g->version)  /* closing a fully built state? */
     luai_userstateclose(L);
   luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+  if (G(L)->strt.oldhash != NULL)  /* closing while resizing? */
+    luaM_freearray(L, G(L)->strt.oldhash, G(L)->strt.oldsize);
+  luaH_freeshapes(L);
   freestack(L);
+  luaM_freesamples(g);
   lua_assert(gettotalbytes(g) == sizeof(LG));
   (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
 }
@@ -274,7 +283,7 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   setthvalue(L, L->top, L1);
   api_incr_top(L);
   preinit_thread(L1, g);
-  L1->hookmask = L->hookmask;
+  L1->hookmask = L->hookmask & ~MASKREC;
   L1->basehookcount = L->basehookcount;
   L1->hook = L->hook;
   resethookcount(L1);
@@ -292,6 +301,7 @@ void luaE_freethread (lua_State *L, lua_State *L1) {
   LX *l = fromstate(L1);
   luaF_close(L1, L1->stack);  /* close all upvalues for this thread */
   lua_assert(L1->openupval == NULL);
+  luaR_abort(L1);  /* discard trace being recorded */
   luai_userstatefree(L, L1);
   freestack(L1);
   luaM_free(L, l);
@@ -317,23 +327,39 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->seed = makeseed(L);
   g->gcrunning = 0;  /* no GC while building state */
   g->GCestimate = 0;
+  g->memlimit = 0;
+  g->samplegap = MAX_LMEM;
   g->strt.size = g->strt.nuse = 0;
   g->strt.hash = NULL;
+  g->strt.oldhash = NULL;
+  g->strt.oldsize = g->strt.oldpos = 0;
   setnilvalue(&g->l_registry);
   g->panic = NULL;
   g->version = NULL;
   g->gcstate = GCSpause;
   g->gckind = KGC_NORMAL;
+  g->gcemergency = 0;
   g->allgc = g->finobj = g->tobefnz = g->fixedgc = NULL;
+  g->survival = g->old1 = g->reallyold = g->firstold1 = NULL;
+  g->finobjsur = g->finobjold1 = g->finobjrold = NULL;
   g->sweepgc = NULL;
   g->gray = g->grayagain = NULL;
+  g->travtable = NULL;
+  g->parmark = NULL;
+  g->bgsweep = NULL;
+  g->memprof = NULL;
+  g->shaperoot = NULL;
+  g->nshapes = 0;
+  g->travpos = 0;
   g->weak = g->ephemeron = g->allweak = NULL;
   g->twups = NULL;
+  g->traces = NULL;
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
   g->gcfinnum = 0;
   g->gcpause = LUAI_GCPAUSE;
   g->gcstepmul = LUAI_GCMUL;
+  g->genminormul = LUAI_GENMINORMUL;
   for (i=0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;//初始化时,每个类型对应的元表为null, 
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {//初始化G->l_registry和一些特殊字符串("__index"和保留字符串等)
     /* memory allocation error: free partial state */
@@ -51,14 +51,17 @@ struct lua_longjmp;  /* defined in ldo.c */
 
 
 /* kinds of Garbage Collection */
-#define KGC_NORMAL	0
-#define KGC_EMERGENCY	1	/* gc was forced by an allocation failure */
+#define KGC_NORMAL	0	/* incremental */
+#define KGC_GEN		1	/* generational */
 
 
 typedef struct stringtable {//短字符串表,
   TString **hash;//一个TString hash表, 每个元素都链接一个链表,给链表中的字符串所计算出来的hash值都一样,
   int nuse;  /* number of elements */
   int size;
+  struct TString **oldhash;  /* array being resized into 'hash' (or NULL) */
+  int oldsize;
+  int oldpos;  /* buckets of 'oldhash' before this one were moved */
 } stringtable;
 
 
@@ -123,6 +126,8 @@ typedef struct global_State {
   l_mem GCdebt;  /* bytes allocated not yet compensated by the collector */
   lu_mem GCmemtrav;  /* memory traversed by the GC */
   lu_mem GCestimate;  /* an estimate of the non-garbage memory in use */
+  lu_mem memlimit;  /* maximum memory in use (0 for no limit) */
+  l_mem samplegap;  /* bytes to allocate before the next sample */
   stringtable strt;  /* hash table for strings, 注意stringtable中只保存短字符串(<40) */
   TValue l_registry;
   unsigned int seed;  /* randomized seed for hashes */
@@ -130,6 +135,8 @@ typedef struct global_State {
   lu_byte gcstate;  /* state of garbage collector */
   lu_byte gckind;  /* kind of GC running */
   lu_byte gcrunning;  /* true if GC is running */
+  lu_byte gcemergency;  /* true if GC was forced by an allocation failure */
+  lu_byte genminormul;  /* control for minor generational collections */
   GCObject *allgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* current position of sweep in list */
   GCObject *finobj;  /* list of collectable objects with finalizers */
@@ -138,9 +145,25 @@ typedef struct global_State {
   GCObject *weak;  /* list of tables with weak values */
   GCObject *ephemeron;  /* list of ephemeron tables (weak keys) */
   GCObject *allweak;  /* list of all-weak tables */
+  struct Table *travtable;  /* table being traversed in chunks (if any) */
+  unsigned int travpos;  /* where to resume traversal of 'travtable' */
   GCObject *tobefnz;  /* list of userdata to be GC */
   GCObject *fixedgc;  /* list of objects not to be collected, 比如保留字符串对应的TString就会放到这里面(见luaX_init()) */
+  /* fields for generational collector */
+  GCObject *survival;  /* start of objects that survived one GC cycle */
+  GCObject *old1;  /* start of old1 objects */
+  GCObject *reallyold;  /* objects more than one cycle old ("really old") */
+  GCObject *firstold1;  /* first OLD1 object in the list (if any) */
+  GCObject *finobjsur;  /* list of survival objects with finalizers */
+  GCObject *finobjold1;  /* list of old1 objects with finalizers */
+  GCObject *finobjrold;  /* list of really old objects with finalizers */
   struct lua_State *twups;  /* list of threads with open upvalues */
+  struct Trace *traces;  /* list of recorded loop traces (ltrace.c) */
+  struct ParMark *parmark;  /* helpers for parallel marking (lgcpar.c) */
+  struct BgSweep *bgsweep;  /* helper for background frees (lgcfree.c) */
+  struct MemProf *memprof;  /* allocation samples (lmemprof.c) */
+  struct Shape *shaperoot;  /* empty shape of records (ltable.c) */
+  unsigned int nshapes;  /* number of shapes */
   unsigned int gcfinnum;  /* number of finalizers to call in each GC step */
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC 'granularity' */
@@ -187,6 +210,7 @@ struct lua_State {
   int hookcount;
   l_signalT hookmask;
   lu_byte allowhook;
+  struct Trace *rec;  /* trace being recorded (if any) */
   
   unsigned short nny;  /* number of non-yieldable calls in stack */
   unsigned short nCcalls;  /* number of nested C calls */
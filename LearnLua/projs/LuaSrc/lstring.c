@@ -16,6 +16,7 @@
 
 #include "ldebug.h"
 #include "ldo.h"
+#include "lhash.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -46,6 +47,7 @@ int luaS_eqlngstr (TString *a, TString *b) {
      (memcmp(getstr(a), getstr(b), len) == 0));  /* equal contents */
 }
 
+#if !defined(LUA_USE_FULLHASH)	/* otherwise, in 'lhash.c' */
 //计算字符串的hash值,
 unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
   unsigned int h = seed ^ cast(unsigned int, l);
@@ -54,6 +56,7 @@ unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
     h ^= ((h<<5) + (h>>2) + cast_byte(str[l - 1]));
   return h;
 }
+#endif
 
 //返回长字符串的hash值{如果还未计算,就先计算一次}
 unsigned int luaS_hashlongstr (TString *ts) {
@@ -67,42 +70,95 @@ unsigned int luaS_hashlongstr (TString *ts) {
 
 
 /*
-** resizes the string table
-* 给g->stringTable(保存的是短字符串)重新设置大小(扩容或者缩容),并更新hash数组各自对应的链表,
+** Resizing is incremental: the current bucket array becomes 'oldhash'
+** and its buckets are moved to the new array a few at a time, by
+** 'luaS_resizestep' (called when strings are created and in GC
+** steps), so that no single call rehashes the whole table. Bucket 'i'
+** of 'oldhash' has not been moved while 'i >= oldpos'; 'strbucket'
+** gives the list where a hash lives, in either array. Sizes are powers
+** of 2, so the strings of old bucket 'i' go to the new buckets 'j' with
+** 'j % oldsize == i' (growing) or to 'i % size' (shrinking): new
+** buckets are cleared when the first old bucket going to them is
+** moved, instead of clearing the whole new array at once.
 */
-void luaS_resize (lua_State *L, int newsize) {
-  int i;
-  stringtable *tb = &G(L)->strt;
-  if (newsize > tb->size) {  /* grow table if needed */
-    luaM_reallocvector(L, tb->hash, tb->size, newsize, TString *);//对hash数组进行重新分配,注意这个realloc会将原内存中的值拷贝到新的内存中,
-    for (i = tb->size; i < newsize; i++)//对新增的数组元素(注意i的起始大小)直接置为null
-      tb->hash[i] = NULL;
+static TString **strbucket (stringtable *tb, unsigned int h) {
+  if (tb->oldhash != NULL) {  /* resizing? */
+    int i = lmod(h, tb->oldsize);
+    if (i >= tb->oldpos)  /* bucket not moved yet? */
+      return &tb->oldhash[i];
   }
+  return &tb->hash[lmod(h, tb->size)];
+}
+
 
-  //重新hash,将hash表格中每个元素对应的链表中的TString重新计算位置并移动过去,
-  for (i = 0; i < tb->size; i++) {  /* rehash */
-    TString *p = tb->hash[i];
-    tb->hash[i] = NULL;
+/*
+** moves up to 'n' buckets of 'oldhash' to the new array, freeing
+** 'oldhash' when it is empty
+*/
+void luaS_resizestep (lua_State *L, int n) {
+  stringtable *tb = &G(L)->strt;
+  lua_assert(tb->oldhash != NULL);
+  for (; n > 0 && tb->oldpos < tb->oldsize; n--) {
+    int i = tb->oldpos++;
+    TString *p = tb->oldhash[i];
+    tb->oldhash[i] = NULL;
+    if (tb->size > tb->oldsize) {  /* growing? */
+      int j;
+      for (j = i; j < tb->size; j += tb->oldsize)
+        tb->hash[j] = NULL;  /* clear new buckets for this one */
+    }
+    else if (i < tb->size)  /* first old bucket going to new bucket 'i'? */
+      tb->hash[i] = NULL;
     while (p) {  /* for each node in the list */
       TString *hnext = p->u.hnext;  /* save next */
-      unsigned int h = lmod(p->hash, newsize);  /* new position, 使用string.hash来计算位置 */
-      
+      unsigned int h = lmod(p->hash, tb->size);  /* new position */
       p->u.hnext = tb->hash[h];  /* chain it */
-      tb->hash[h] = p;//放到链首,
-
+      tb->hash[h] = p;
       p = hnext;
     }
   }
+  if (tb->oldpos == tb->oldsize) {  /* all buckets moved? */
+    luaM_freearray(L, tb->oldhash, tb->oldsize);
+    tb->oldhash = NULL;
+    tb->oldsize = tb->oldpos = 0;
+  }
+}
+
 
-  //xzxtodo?
-  if (newsize < tb->size) {  /* shrink table if needed */
-    /* vanishing slice should be empty */
-    lua_assert(tb->hash[newsize] == NULL && tb->hash[tb->size - 1] == NULL);
-    //有点看不懂这里了,感觉因为要缩容,直接将[tb->size, newSize]之间的hash表中的元素不管了,{解答:没有不管,在上面的for循环中,重新hash后只会分布在[0,newSize)之间,}
-    //不过因为这个只是stringtable,即使不管了,丢弃了,也不会引起什么问题,因为可以再次构建newTString就可以了,
-    //丢弃了的hash表中的元素再之后也会被GC掉,???但还是有问题,对字符串对比的时候是直接对比的指针(eqshrstr)
-    luaM_reallocvector(L, tb->hash, tb->size, newsize, TString *);
+/*
+** resizes the string table
+* 给g->stringTable(保存的是短字符串)重新设置大小(扩容或者缩容),新的hash数组
+* 中的链表由luaS_resizestep逐步迁移,
+* (When shrinking, called by the collector, an allocation failure only
+* keeps the table as it is.)
+*/
+void luaS_resize (lua_State *L, int newsize) {
+  global_State *g = G(L);
+  stringtable *tb = &g->strt;
+  TString **newhash;
+  int i;
+  if (tb->oldhash != NULL)  /* previous resize not finished? */
+    luaS_resizestep(L, tb->oldsize);  /* finish it */
+  if (newsize < tb->size) {  /* shrinking? */
+    size_t sz = newsize * sizeof(TString *);
+    newhash = cast(TString **, (*g->frealloc)(g->ud, NULL, 0, sz));
+    if (newhash == NULL)
+      return;  /* not worth an error */
+    g->GCdebt += sz;
+  }
+  else
+    newhash = luaM_newvector(L, newsize, TString *);
+  lua_assert((newsize & (newsize - 1)) == 0);
+  if (tb->hash != NULL) {  /* move old buckets incrementally */
+    tb->oldhash = tb->hash;
+    tb->oldsize = tb->size;
+    tb->oldpos = 0;
   }
+  else {  /* new table */
+    for (i = 0; i < newsize; i++)
+      newhash[i] = NULL;
+  }
+  tb->hash = newhash;
   tb->size = newsize;
 }
 
@@ -156,6 +212,7 @@ static TString *createstrobj (lua_State *L, size_t l, int tag, unsigned int h) {
   ts = gco2ts(o);
   ts->hash = h;
   ts->extra = 0;
+  ts->shrlen = 0;  /* (for long strings, not a view) */
   getstr(ts)[l] = '\0';  /* ending 0 */
   return ts;
 }
@@ -169,12 +226,59 @@ TString *luaS_createlngstrobj (lua_State *L, size_t l) {
   return ts;
 }
 
+
+/*
+** Creates a string with the 'l' bytes at offset 'i' of 'ts'. Long
+** results are views, sharing the memory of 'ts' (or of its parent, if
+** 'ts' is a view too); short ones are interned, as always.
+*/
+TString *luaS_newsubstr (lua_State *L, TString *ts, size_t i, size_t l) {
+  if (l <= LUAI_MAXSHORTLEN)
+    return luaS_newlstr(L, getstr(ts) + i, l);
+  else if (l == ts->u.lnglen)
+    return ts;  /* the whole string */
+  else {
+    char *data = getstr(ts) + i;
+    TString *parent = isstrview(ts) ? strview(ts)->parent : ts;
+    GCObject *o = luaC_newobj(L, LUA_TLNGSTR,
+                              sizeof(UTString) + sizeof(StrView));
+    TString *v = gco2ts(o);
+    StrView *sv;
+    v->hash = G(L)->seed;
+    v->extra = 0;
+    v->shrlen = 1;  /* a view */
+    v->u.lnglen = l;
+    sv = strview(v);
+    sv->data = data;
+    sv->parent = parent;
+    sv->cstr = NULL;
+    return v;
+  }
+}
+
+
+/*
+** Returns the contents of view 'ts' with an ending zero, copying them
+** on the first call. (The copy is only freed with the view.)
+*/
+char *luaS_materialize (lua_State *L, TString *ts) {
+  StrView *sv = strview(ts);
+  if (sv->cstr == NULL) {
+    size_t l = ts->u.lnglen;
+    char *buff = luaM_newvector(L, l + 1, char);
+    memcpy(buff, sv->data, l * sizeof(char));
+    buff[l] = '\0';
+    sv->cstr = buff;
+  }
+  return sv->cstr;
+}
+
 /*
  * 将字符串ts(短字符串)从G->strt(stringtable)中移除,
  */
 void luaS_remove (lua_State *L, TString *ts) {
   stringtable *tb = &G(L)->strt;
-  TString **p = &tb->hash[lmod(ts->hash, tb->size)];
+  TString **p = strbucket(tb, ts->hash);
   while (*p != ts)  /* find previous element */
     p = &(*p)->u.hnext;
   *p = (*p)->u.hnext;  /* remove element from its list */
@@ -194,7 +298,10 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
 
   //1、先在G->strt(类型为stringtable)中查找,如果找到了则直接返回,
   unsigned int h = luaS_hash(str, l, g->seed);
-  TString **list = &g->strt.hash[lmod(h, g->strt.size)];
+  TString **list;
+  if (g->strt.oldhash != NULL)  /* resizing? */
+    luaS_resizestep(L, STRTMOVE);  /* move a few buckets */
+  list = strbucket(&g->strt, h);
   lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
   for (ts = *list; ts != NULL; ts = ts->u.hnext) {
     if (l == ts->shrlen &&
@@ -209,7 +316,7 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
   //2、在G->strt(类型为stringtable)中查找失败, 因为要新创建一个字符串, 所以check一下stringtable是不是要扩容并更新,
   if (g->strt.nuse >= g->strt.size && g->strt.size <= MAX_INT/2) {
     luaS_resize(L, g->strt.size * 2);
-    list = &g->strt.hash[lmod(h, g->strt.size)];  /* recompute with new size, 重新计算一下在哪个hash链表中 */
+    list = strbucket(&g->strt, h);  /* recompute with new size, 重新计算一下在哪个hash链表中 */
   }
 
   //3、创建新的TString,复制字符串进去,设置tag,hash等值,
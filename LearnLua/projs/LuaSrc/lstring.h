@@ -14,6 +14,15 @@
 //求字符串所占内存空间大小:头部+字符个数(l) + 最后一位'\0'
 #define sizelstring(l)  (sizeof(union UTString) + ((l) + 1) * sizeof(char))
 
+/* size of a long string object (views count their copy, if any) */
+#define sizelngstr(ts)  \
+	(isstrview(ts) ? sizeof(union UTString) + sizeof(StrView) + \
+	                 (strview(ts)->cstr ? (ts)->u.lnglen + 1 : 0) \
+	               : sizelstring((ts)->u.lnglen))
+
+/* contents of 'ts' with an ending zero */
+#define luaS_cstr(L,ts)	(isstrview(ts) ? luaS_materialize(L, ts) : getstr(ts))
+
 //求Udata所占内存空间大小:头部+保存的数据大小(l)
 #define sizeludata(l)	(sizeof(union UUdata) + (l))
 
@@ -38,6 +47,18 @@
 */
 #define eqshrstr(a,b)	check_exp((a)->tt == LUA_TSHRSTR, (a) == (b))
 
+
+/*
+** While the string table is being resized, each string creation moves
+** STRTMOVE buckets to the new array and each GC step STRTGCMOVE. (A
+** growing table is done before it can grow again, as it needs at least
+** one creation per old bucket.)
+*/
+#define STRTMOVE	4
+#define STRTGCMOVE	256
+
+#define luaS_resizing(g)	((g)->strt.oldhash != NULL)
+
 //计算字符串的hash值,
 LUAI_FUNC unsigned int luaS_hash (const char *str, size_t l, unsigned int seed);
 
@@ -49,6 +70,7 @@ LUAI_FUNC int luaS_eqlngstr (TString *a, TString *b);
 
 //给g->stringTable(保存的是短字符串)重新设置大小(扩容或者缩容),并更新hash数组各自对应的链表,
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
+LUAI_FUNC void luaS_resizestep (lua_State *L, int n);
 
 //清除G->strcache中保存的字符串(长或短),需要是白色的(包含两种白),
 LUAI_FUNC void luaS_clearcache (global_State *g);
@@ -70,6 +92,9 @@ LUAI_FUNC TString *luaS_new (lua_State *L, const char *str);
 
 //创建长字符串,默认不会计算hash值,初始hash值为G->seed
 LUAI_FUNC TString *luaS_createlngstrobj (lua_State *L, size_t l);
+LUAI_FUNC TString *luaS_newsubstr (lua_State *L, TString *ts, size_t i,
+                                                              size_t l);
+LUAI_FUNC char *luaS_materialize (lua_State *L, TString *ts);
 
 
 #endif
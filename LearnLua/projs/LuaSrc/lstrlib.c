@@ -51,9 +51,21 @@
 
 
 
+/*
+** Like 'luaL_checklstring', but the result may be a view (with no
+** ending zero), for functions that only use the first 'l' bytes.
+*/
+static const char *checkbytes (lua_State *L, int arg, size_t *l) {
+  const char *s = lua_tolstringview(L, arg, l);
+  if (s == NULL)
+    luaL_checktype(L, arg, LUA_TSTRING);  /* raise the error */
+  return s;
+}
+
+
 static int str_len (lua_State *L) {
   size_t l;
-  luaL_checklstring(L, 1, &l);
+  checkbytes(L, 1, &l);
   lua_pushinteger(L, (lua_Integer)l);
   return 1;
 }
@@ -69,13 +81,14 @@ static lua_Integer posrelat (lua_Integer pos, size_t len) {
 
 static int str_sub (lua_State *L) {
   size_t l;
-  const char *s = luaL_checklstring(L, 1, &l);
-  lua_Integer start = posrelat(luaL_checkinteger(L, 2), l);
-  lua_Integer end = posrelat(luaL_optinteger(L, 3, -1), l);
+  lua_Integer start, end;
+  checkbytes(L, 1, &l);
+  start = posrelat(luaL_checkinteger(L, 2), l);
+  end = posrelat(luaL_optinteger(L, 3, -1), l);
   if (start < 1) start = 1;
   if (end > (lua_Integer)l) end = l;
   if (start <= end)
-    lua_pushlstring(L, s + start - 1, (size_t)(end - start) + 1);
+    lua_pushsubstring(L, 1, (size_t)start - 1, (size_t)(end - start) + 1);
   else lua_pushliteral(L, "");
   return 1;
 }
@@ -84,7 +97,7 @@ static int str_sub (lua_State *L) {
 static int str_reverse (lua_State *L) {
   size_t l, i;
   luaL_Buffer b;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = checkbytes(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
   for (i = 0; i < l; i++)
     p[i] = s[l - i - 1];
@@ -97,7 +110,7 @@ static int str_lower (lua_State *L) {
   size_t l;
   size_t i;
   luaL_Buffer b;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = checkbytes(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
   for (i=0; i<l; i++)
     p[i] = tolower(uchar(s[i]));
@@ -110,7 +123,7 @@ static int str_upper (lua_State *L) {
   size_t l;
   size_t i;
   luaL_Buffer b;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = checkbytes(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
   for (i=0; i<l; i++)
     p[i] = toupper(uchar(s[i]));
@@ -121,7 +134,7 @@ static int str_upper (lua_State *L) {
 
 static int str_rep (lua_State *L) {
   size_t l, lsep;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = checkbytes(L, 1, &l);
   lua_Integer n = luaL_checkinteger(L, 2);
   const char *sep = luaL_optlstring(L, 3, "", &lsep);
   if (n <= 0) lua_pushliteral(L, "");
@@ -147,7 +160,7 @@ static int str_rep (lua_State *L) {
 
 static int str_byte (lua_State *L) {
   size_t l;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = checkbytes(L, 1, &l);
   lua_Integer posi = posrelat(luaL_optinteger(L, 2, 1), l);
   lua_Integer pose = posrelat(luaL_optinteger(L, 3, posi), l);
   int n, i;
@@ -213,7 +226,8 @@ static int str_dump (lua_State *L) {
 
 typedef struct MatchState {
   const char *src_init;  /* init of source string */
-  const char *src_end;  /* end ('\0') of source string */
+  const char *src_end;  /* end of source string (maybe a view, no '\0') */
+  int src;  /* stack index of source string */
   const char *p_end;  /* end ('\0') of pattern */
   lua_State *L;
   int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
@@ -455,14 +469,15 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
             break;
           }
           case 'f': {  /* frontier? */
-            const char *ep; char previous;
+            const char *ep; char previous, current;
             p += 2;
             if (*p != '[')
               luaL_error(ms->L, "missing '[' after '%%f' in pattern");
             ep = classend(ms, p);  /* points to what is next */
             previous = (s == ms->src_init) ? '\0' : *(s - 1);
+            current = (s < ms->src_end) ? *s : '\0';  /* (views) */
             if (!matchbracketclass(uchar(previous), p, ep - 1) &&
-               matchbracketclass(uchar(*s), p, ep - 1)) {
+               matchbracketclass(uchar(current), p, ep - 1)) {
               p = ep; goto init;  /* return match(ms, s, ep); */
             }
             s = NULL;  /* match failed */
@@ -551,7 +566,7 @@ static void push_onecapture (MatchState *ms, int i, const char *s,
                                                     const char *e) {
   if (i >= ms->level) {
     if (i == 0)  /* ms->level == 0, too */
-      lua_pushlstring(ms->L, s, e - s);  /* add whole match */
+      lua_pushsubstring(ms->L, ms->src, s - ms->src_init, e - s);
     else
       luaL_error(ms->L, "invalid capture index %%%d", i + 1);
   }
@@ -561,7 +576,8 @@ static void push_onecapture (MatchState *ms, int i, const char *s,
     if (l == CAP_POSITION)
       lua_pushinteger(ms->L, (ms->capture[i].init - ms->src_init) + 1);
     else
-      lua_pushlstring(ms->L, ms->capture[i].init, l);
+      lua_pushsubstring(ms->L, ms->src, ms->capture[i].init - ms->src_init,
+                        (size_t)l);
   }
 }
 
@@ -592,6 +608,7 @@ static void prepstate (MatchState *ms, lua_State *L,
                        const char *s, size_t ls, const char *p, size_t lp) {
   ms->L = L;
   ms->matchdepth = MAXCCALLS;
+  ms->src = 1;
   ms->src_init = s;
   ms->src_end = s + ls;
   ms->p_end = p + lp;
@@ -606,7 +623,7 @@ static void reprepstate (MatchState *ms) {
 
 static int str_find_aux (lua_State *L, int find) {
   size_t ls, lp;
-  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *s = checkbytes(L, 1, &ls);
   const char *p = luaL_checklstring(L, 2, &lp);
   lua_Integer init = posrelat(luaL_optinteger(L, 3, 1), ls);
   if (init < 1) init = 1;
@@ -688,12 +705,13 @@ static int gmatch_aux (lua_State *L) {
 
 static int gmatch (lua_State *L) {
   size_t ls, lp;
-  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *s = checkbytes(L, 1, &ls);
   const char *p = luaL_checklstring(L, 2, &lp);
   GMatchState *gm;
   lua_settop(L, 2);  /* keep them on closure to avoid being collected */
   gm = (GMatchState *)lua_newuserdata(L, sizeof(GMatchState));
   prepstate(&gm->ms, L, s, ls, p, lp);
+  gm->ms.src = lua_upvalueindex(1);  /* (in 'gmatch_aux') */
   gm->src = s; gm->p = p; gm->lastmatch = NULL;
   lua_pushcclosure(L, gmatch_aux, 3);
   return 1;
@@ -761,7 +779,7 @@ static void add_value (MatchState *ms, luaL_Buffer *b, const char *s,
 
 static int str_gsub (lua_State *L) {
   size_t srcl, lp;
-  const char *src = luaL_checklstring(L, 1, &srcl);  /* subject */
+  const char *src = checkbytes(L, 1, &srcl);  /* subject */
   const char *p = luaL_checklstring(L, 2, &lp);  /* pattern */
   const char *lastmatch = NULL;  /* end of last match */
   int tr = lua_type(L, 3);  /* replacement type */
@@ -1013,22 +1031,23 @@ static void addlenmod (char *form, const char *lenmod) {
 }
 
 
-static int str_format (lua_State *L) {
+/*
+** Adds to 'b' the formatting of the arguments after 'arg' by the
+** format at 'arg'.
+*/
+static void addformat (lua_State *L, luaL_Buffer *b, int arg) {
   int top = lua_gettop(L);
-  int arg = 1;
   size_t sfl;
   const char *strfrmt = luaL_checklstring(L, arg, &sfl);
   const char *strfrmt_end = strfrmt+sfl;
-  luaL_Buffer b;
-  luaL_buffinit(L, &b);
   while (strfrmt < strfrmt_end) {
     if (*strfrmt != L_ESC)
-      luaL_addchar(&b, *strfrmt++);
+      luaL_addchar(b, *strfrmt++);
     else if (*++strfrmt == L_ESC)
-      luaL_addchar(&b, *strfrmt++);  /* %% */
+      luaL_addchar(b, *strfrmt++);  /* %% */
     else { /* format item */
       char form[MAX_FORMAT];  /* to store the format ('%...') */
-      char *buff = luaL_prepbuffsize(&b, MAX_ITEM);  /* to put formatted item */
+      char *buff = luaL_prepbuffsize(b, MAX_ITEM);  /* to put formatted item */
       int nb = 0;  /* number of bytes in added item */
       if (++arg > top)
         luaL_argerror(L, arg, "no value");
@@ -1058,19 +1077,19 @@ static int str_format (lua_State *L) {
           break;
         }
         case 'q': {
-          addliteral(L, &b, arg);
+          addliteral(L, b, arg);
           break;
         }
         case 's': {
           size_t l;
           const char *s = luaL_tolstring(L, arg, &l);
           if (form[2] == '\0')  /* no modifiers? */
-            luaL_addvalue(&b);  /* keep entire string */
+            luaL_addvalue(b);  /* keep entire string */
           else {
             luaL_argcheck(L, l == strlen(s), arg, "string contains zeros");
             if (!strchr(form, '.') && l >= 100) {
               /* no precision and string is too long to be formatted */
-              luaL_addvalue(&b);  /* keep entire string */
+              luaL_addvalue(b);  /* keep entire string */
             }
             else {  /* format the string into 'buff' */
               nb = l_sprintf(buff, MAX_ITEM, form, s);
@@ -1080,14 +1099,22 @@ static int str_format (lua_State *L) {
           break;
         }
         default: {  /* also treat cases 'pnLlh' */
-          return luaL_error(L, "invalid option '%%%c' to 'format'",
-                               *(strfrmt - 1));
+          luaL_error(L, "invalid option '%%%c' to 'format'",
+                        *(strfrmt - 1));
+          return;
         }
       }
       lua_assert(nb < MAX_ITEM);
-      luaL_addsize(&b, nb);
+      luaL_addsize(b, nb);
     }
   }
+}
+
+
+static int str_format (lua_State *L) {
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  addformat(L, &b, 1);
   luaL_pushresult(&b);
   return 1;
 }
@@ -1539,7 +1566,210 @@ static int str_unpack (lua_State *L) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** STRING BUFFERS
+** =======================================================
+*/
+
+
+#define STRBUF		"string.buffer"
+
+/*
+** a string buffer: its contents are bytes 'r' up to 'n' of 'b'. The
+** storage is a full userdata kept as the buffer's user value, so the
+** collector accounts for it and frees it with the buffer.
+*/
+typedef struct StrBuf {
+  char *b;  /* storage (NULL if 'size' is 0) */
+  size_t size;  /* size of 'b' */
+  size_t n;  /* end of the contents */
+  size_t r;  /* start of the contents (moved by 'get') */
+} StrBuf;
+
+
+/* buffer methods get the buffer at stack index 1 */
+#define tobuf(L)	((StrBuf *)luaL_checkudata(L, 1, STRBUF))
+
+
+/*
+** Returns room for 'l' more bytes at the end of the contents of the
+** buffer at index 1. Space freed by 'get' is reused (when that moves
+** fewer bytes than it frees, or before growing); the storage grows by
+** doubling and is never shrunk.
+*/
+static char *prepbuf (lua_State *L, StrBuf *sb, size_t l) {
+  if (sb->size - sb->n < l) {  /* not enough space after the contents? */
+    size_t used = sb->n - sb->r;
+    if (sb->r > 0 && (sb->r >= used || sb->size - used < l)) {
+      memmove(sb->b, sb->b + sb->r, used);
+      sb->n = used;
+      sb->r = 0;
+    }
+    if (sb->size - sb->n < l) {  /* must grow? */
+      size_t newsize = (sb->size < LUAL_BUFFERSIZE) ? LUAL_BUFFERSIZE
+                                                    : sb->size;
+      char *newb;
+      if (l > MAX_SIZET - sb->n)
+        luaL_error(L, "buffer too large");
+      while (newsize - sb->n < l)
+        newsize = (newsize <= MAX_SIZET / 2) ? newsize * 2 : sb->n + l;
+      newb = (char *)lua_newuserdata(L, newsize * sizeof(char));
+      if (used > 0)  /* ('b' may be NULL otherwise) */
+        memcpy(newb, sb->b + sb->r, used * sizeof(char));
+      lua_setuservalue(L, 1);  /* old storage is now garbage */
+      sb->b = newb;
+      sb->size = newsize;
+      sb->n = used;
+      sb->r = 0;
+    }
+  }
+  return sb->b + sb->n;
+}
+
+
+static void addbuf (lua_State *L, StrBuf *sb, const char *s, size_t l) {
+  if (l > 0) {  /* ('s' may be NULL otherwise) */
+    memcpy(prepbuf(L, sb, l), s, l * sizeof(char));
+    sb->n += l;
+  }
+}
+
+
+/*
+** Appends the value at 'arg': a string, a number, another buffer or
+** a value with a '__tostring' metamethod.
+*/
+static void addbufvalue (lua_State *L, StrBuf *sb, int arg) {
+  size_t l;
+  const char *s;
+  StrBuf *other;
+  if (lua_type(L, arg) == LUA_TSTRING || lua_type(L, arg) == LUA_TNUMBER) {
+    s = lua_tolstringview(L, arg, &l);  /* (no ending zero needed) */
+    addbuf(L, sb, s, l);
+  }
+  else if ((other = (StrBuf *)luaL_testudata(L, arg, STRBUF)) != NULL) {
+    l = other->n - other->r;
+    prepbuf(L, sb, l);  /* first, as it may move 'other' if it is 'sb' */
+    addbuf(L, sb, other->b + other->r, l);
+  }
+  else if (luaL_getmetafield(L, arg, "__tostring") != LUA_TNIL) {
+    lua_pop(L, 1);  /* remove metamethod */
+    s = luaL_tolstring(L, arg, &l);
+    addbuf(L, sb, s, l);
+    lua_pop(L, 1);  /* remove result from 'luaL_tolstring' */
+  }
+  else {
+    const char *msg = lua_pushfstring(L, "string expected, got %s",
+                                         luaL_typename(L, arg));
+    luaL_argerror(L, arg, msg);
+  }
+}
+
+
+static int str_buffer (lua_State *L) {
+  lua_Integer size = luaL_optinteger(L, 1, 0);
+  StrBuf *sb;
+  lua_settop(L, 0);
+  sb = (StrBuf *)lua_newuserdata(L, sizeof(StrBuf));  /* at index 1 */
+  sb->b = NULL;
+  sb->size = sb->n = sb->r = 0;
+  luaL_setmetatable(L, STRBUF);
+  if (size > 0)  /* preallocate */
+    prepbuf(L, sb, (size_t)size);
+  return 1;
+}
+
+
+static int buf_put (lua_State *L) {
+  StrBuf *sb = tobuf(L);
+  int top = lua_gettop(L);
+  int arg;
+  for (arg = 2; arg <= top; arg++)
+    addbufvalue(L, sb, arg);
+  lua_settop(L, 1);
+  return 1;  /* the buffer itself */
+}
+
+
+static int buf_putf (lua_State *L) {
+  StrBuf *sb = tobuf(L);
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  addformat(L, &b, 2);
+  addbuf(L, sb, b.b, b.n);  /* (result is not pushed as a string) */
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+/*
+** Removes and returns the first 'n' bytes of the contents (or all
+** of them, with no 'n').
+*/
+static int buf_get (lua_State *L) {
+  StrBuf *sb = tobuf(L);
+  size_t l = sb->n - sb->r;
+  if (!lua_isnoneornil(L, 2)) {
+    lua_Integer n = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, n >= 0, 2, "negative length");
+    if ((lua_Unsigned)n < l) l = (size_t)n;
+  }
+  lua_pushlstring(L, sb->b + sb->r, l);
+  sb->r += l;
+  if (sb->r == sb->n)  /* empty? */
+    sb->r = sb->n = 0;  /* restart at the beginning of the storage */
+  return 1;
+}
+
+
+static int buf_reset (lua_State *L) {
+  StrBuf *sb = tobuf(L);
+  sb->r = sb->n = 0;  /* (keeps the storage) */
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+static int buf_tostring (lua_State *L) {
+  StrBuf *sb = tobuf(L);
+  lua_pushlstring(L, sb->b + sb->r, sb->n - sb->r);
+  return 1;
+}
+
+
+static int buf_len (lua_State *L) {
+  StrBuf *sb = tobuf(L);
+  lua_pushinteger(L, (lua_Integer)(sb->n - sb->r));
+  return 1;
+}
+
+
+static const luaL_Reg buflib[] = {
+  {"put", buf_put},
+  {"putf", buf_putf},
+  {"get", buf_get},
+  {"reset", buf_reset},
+  {"tostring", buf_tostring},
+  {"__tostring", buf_tostring},
+  {"__len", buf_len},
+  {NULL, NULL}
+};
+
+
+static void createbufmeta (lua_State *L) {
+  luaL_newmetatable(L, STRBUF);  /* create metatable for buffers */
+  lua_pushvalue(L, -1);  /* push metatable */
+  lua_setfield(L, -2, "__index");  /* metatable.__index = metatable */
+  luaL_setfuncs(L, buflib, 0);  /* add buffer methods to new metatable */
+  lua_pop(L, 1);  /* pop new metatable */
+}
+
+/* }====================================================== */
+
+
 static const luaL_Reg strlib[] = {
+  {"buffer", str_buffer},
   {"byte", str_byte},
   {"char", str_char},
   {"dump", str_dump},
@@ -1584,6 +1814,7 @@ static void createmetatable (lua_State *L) {
 LUAMOD_API int luaopen_string (lua_State *L) {
   luaL_newlib(L, strlib);
   createmetatable(L);
+  createbufmeta(L);
   return 1;
 }
 
@@ -116,6 +116,7 @@ static int l_hashfloat (lua_Number n) {
 #endif
 
 
+#if !defined(LUA_USE_SWISSTABLE)
 /*
 ** returns the 'main' position of an element in a table (that is, the index
 ** of its hash value)
@@ -142,6 +143,7 @@ static Node *mainposition (const Table *t, const TValue *key) {
       return hashpointer(t, gcvalue(key));
   }
 }
+#endif
 
 
 /*
@@ -159,10 +161,409 @@ static unsigned int arrayindex (const TValue *key) {
 }
 
 
+#if defined(LUA_USE_SWISSTABLE)
+
+/*
+** {=============================================================
+** Swiss tables
+** The hash part is probed by open addressing, in groups of GROUPSIZE
+** slots. A vector of control bytes, one per slot and allocated after
+** the nodes, holds CTRL_EMPTY or 7 bits of the hash of the slot's key;
+** a probe compares the bytes of a whole group at once and only looks
+** at the keys whose bytes match. A slot is never emptied: an entry
+** whose value becomes nil keeps it (as a dead key in the chained
+** layout does) until the next rehash, so a probe can stop at the
+** first group with an empty slot.
+** ==============================================================
+*/
+
+#define GROUPSIZE	16
+#define CTRL_EMPTY	0x80
+
+/* size of the control bytes of 'size' slots (at least one group) */
+#define ctrlsize(size)	((size) < GROUPSIZE ? GROUPSIZE : (size))
+#define nodeblocksize(size)  (sizeof(Node) * (size) + ctrlsize(size))
+
+/* keys that 'size' slots can take: up to a 7/8 load, except when all
+   of them fit in one group (bytes past them are always empty) */
+#define maxload(size)	((size) <= GROUPSIZE / 2 ? (size) : (size) - (size) / 8)
+
+/* number of groups of 't' minus one */
+#define groupmask(t)	((sizenode(t) + GROUPSIZE - 1) / GROUPSIZE - 1)
+
+/* the two halves of a mixed hash: group and control byte */
+#define h1(h)		((h) >> 7)
+#define h2(h)		cast(lu_byte, (h) & 0x7f)
+
+static const lu_byte dummyctrl[GROUPSIZE] = {
+  CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY,
+  CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY,
+  CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY,
+  CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY
+};
+
+
+#if defined(__SSE2__) && !defined(LUAI_SWISSSCALAR)
+
+#include <emmintrin.h>
+
+/* bit 'i' is set iff control byte 'i' of group 'g' is 'b' */
+static unsigned int matchgroup (const lu_byte *g, lu_byte b) {
+  __m128i c = _mm_loadu_si128((const __m128i *)g);
+  return cast(unsigned int,
+              _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(cast(char, b)))));
+}
+
+#else
+
+static unsigned int matchgroup (const lu_byte *g, lu_byte b) {
+  unsigned int m = 0;
+  int i;
+  for (i = 0; i < GROUPSIZE; i++) {
+    if (g[i] == b)
+      m |= 1u << i;
+  }
+  return m;
+}
+
+#endif
+
+
+#if defined(__GNUC__)
+#define firstbit(m)	__builtin_ctz(m)
+#else
+static int firstbit (unsigned int m) {
+  int i = 0;
+  while (!(m & 1u)) { m >>= 1; i++; }
+  return i;
+}
+#endif
+
+
+/*
+** Mixes a raw hash so that both its high bits (group) and its low
+** bits (control byte) depend on all of it: integers, pointers and
+** float hashes have few useful bits.
+*/
+static unsigned int mixhash (unsigned int h) {
+  h *= 0x9e3779b1u;
+  return h ^ (h >> 16);
+}
+
+
+static unsigned int inthash (lua_Integer i) {
+  lua_Unsigned u = l_castS2U(i);
+  return mixhash(cast(unsigned int, u ^ (u >> 16 >> 16)));
+}
+
+
+static unsigned int keyhash (const TValue *key) {
+  switch (ttype(key)) {
+    case LUA_TNUMINT:
+      return inthash(ivalue(key));
+    case LUA_TNUMFLT:
+      return mixhash(cast(unsigned int, l_hashfloat(fltvalue(key))));
+    case LUA_TSHRSTR:
+      return mixhash(tsvalue(key)->hash);
+    case LUA_TLNGSTR:
+      return mixhash(luaS_hashlongstr(tsvalue(key)));
+    case LUA_TBOOLEAN:
+      return mixhash(cast(unsigned int, bvalue(key)));
+    case LUA_TLIGHTUSERDATA:
+      return mixhash(point2uint(pvalue(key)));
+    case LUA_TLCF:
+      return mixhash(point2uint(fvalue(key)));
+    default:
+      lua_assert(!ttisdeadkey(key));
+      return mixhash(point2uint(gcvalue(key)));
+  }
+}
+
+
+/*
+** Runs 'body' for each node 'n' of 't' whose control byte matches
+** hash 'h', along the probe sequence of 'h': groups at triangular
+** steps from 'h1(h)', which visit all groups. The search ends at a
+** group with an empty slot, or after all groups.
+*/
+#define forcandidates(t,h,n,body) { \
+  unsigned int gm_ = groupmask(t); \
+  unsigned int g_ = h1(h) & gm_; \
+  unsigned int step_ = 0; \
+  for (;;) { \
+    const lu_byte *grp_ = (t)->ctrl + g_ * GROUPSIZE; \
+    unsigned int m_ = matchgroup(grp_, h2(h)); \
+    while (m_ != 0) { \
+      Node *n = gnode(t, g_ * GROUPSIZE + firstbit(m_)); \
+      body \
+      m_ &= m_ - 1; \
+    } \
+    if (matchgroup(grp_, CTRL_EMPTY) != 0 || step_ == gm_) break; \
+    g_ = (g_ + ++step_) & gm_; \
+  } }
+
+
+/*
+** Takes a slot for new key 'key' with hash 'h': the first empty slot in
+** its probe sequence. But an entry the collector left for the same
+** object (a dead key, which 'next' matches by address) comes before
+** it, and must be reused, as the chained layout does; otherwise 'next'
+** could resume from the stale entry. (The caller ensures there is
+** room: 'growthleft' > 0.)
+*/
+static Node *takeslot (Table *t, const TValue *key, unsigned int h) {
+  unsigned int gm = groupmask(t);
+  unsigned int g = h1(h) & gm;
+  unsigned int step = 0;
+  unsigned int valid = (sizenode(t) < GROUPSIZE)
+                     ? (1u << sizenode(t)) - 1  /* slots of a small table */
+                     : ~0u;
+  lua_assert(t->growthleft > 0);
+  for (;;) {
+    const lu_byte *grp = t->ctrl + g * GROUPSIZE;
+    unsigned int m;
+    if (iscollectable(key)) {
+      for (m = matchgroup(grp, h2(h)); m != 0; m &= m - 1) {
+        Node *n = gnode(t, g * GROUPSIZE + firstbit(m));
+        if (ttisdeadkey(gkey(n)) && deadvalue(gkey(n)) == gcvalue(key))
+          return n;
+      }
+    }
+    m = matchgroup(grp, CTRL_EMPTY) & valid;
+    if (m != 0) {
+      unsigned int i = g * GROUPSIZE + firstbit(m);
+      t->ctrl[i] = h2(h);
+      t->growthleft--;
+      return gnode(t, i);
+    }
+    g = (g + ++step) & gm;
+  }
+}
+
+/* }============================================================= */
+
+#define freenodes(L,n,size)	luaM_freemem(L, n, nodeblocksize(size))
+
+#else
+
+#define freenodes(L,n,size)	luaM_freearray(L, n, size)
+
+#endif
+
+
+/*
+** result of a search that missed the hash part of 't': with an
+** incremental rehash going on, 'e' searches the part being migrated
+*/
+#define notfound(t,e)	(oldpart(t) ? (e) : luaO_nilobject)
+
+
+#if defined(LUA_USE_SHAPES)
+
+/*
+** {=============================================================
+** Shapes
+** ==============================================================
+*/
+
+/* maximum number of fields in a record */
+#if !defined(LUAI_SHAPEMAX)
+#define LUAI_SHAPEMAX	16
+#endif
+
+/* maximum number of shapes in a state */
+#if !defined(LUAI_MAXSHAPES)
+#define LUAI_MAXSHAPES	4096
+#endif
+
+#define sizeshape(n)	(offsetof(Shape, keys) + sizeof(TString *) * (n))
+
+
+static void resize (lua_State *L, Table *t, unsigned int nasize,
+                                         unsigned int nhsize);
+
+
+/* index of 'key' in shape 's', or -1 if absent */
+static int shapeindex (const Shape *s, const TString *key) {
+  int i;
+  for (i = 0; i < cast_int(s->nkeys); i++) {
+    if (s->keys[i] == key)
+      return i;
+  }
+  return -1;
+}
+
+
+/*
+** Creates the shape that adds 'key' to 'parent' (or the root shape,
+** when 'parent' is NULL). It is linked into the tree only when
+** complete, as an emergency collection may walk the tree.
+*/
+static Shape *newshape (lua_State *L, Shape *parent, TString *key) {
+  unsigned int n = (parent == NULL) ? 0 : parent->nkeys + 1;
+  Shape *s = cast(Shape *, luaM_newobject(L, 0, sizeshape(n)));
+  unsigned int i;
+  s->parent = parent;
+  s->kids = NULL;
+  s->refs = 0;
+  s->nkeys = n;
+  if (parent != NULL) {
+    for (i = 0; i < parent->nkeys; i++)
+      s->keys[i] = parent->keys[i];
+    s->keys[n - 1] = key;
+    s->sibling = parent->kids;
+    parent->kids = s;
+    parent->refs++;
+  }
+  else
+    s->sibling = NULL;
+  G(L)->nshapes++;
+  return s;
+}
+
+
+/*
+** Drops a reference to 's', freeing it (and then its ancestors) when
+** no table and no other shape use it. The root is never freed here.
+*/
+static void unrefshape (lua_State *L, Shape *s) {
+  global_State *g = G(L);
+  while (--s->refs == 0 && s != g->shaperoot) {
+    Shape *p = s->parent;
+    Shape **k = &p->kids;
+    while (*k != s)
+      k = &(*k)->sibling;
+    *k = s->sibling;  /* unlink it */
+    luaM_freemem(L, s, sizeshape(s->nkeys));
+    g->nshapes--;
+    s = p;
+  }
+}
+
+
+static void setfieldsize (lua_State *L, Table *t, unsigned int size) {
+  unsigned int i;
+  luaC_movebarrier(L, t);  /* fields will move */
+  luaM_reallocvector(L, t->fields, t->sizefields, size, TValue);
+  for (i = t->sizefields; i < size; i++)
+    setnilvalue(&t->fields[i]);
+  t->sizefields = size;
+}
+
+
+/*
+** Adds 'key' to record 't', moving it to the child shape with that
+** key (created if needed), and returns its (empty) field. Returns NULL
+** if the record cannot grow: it is full, it has holes left by deleted
+** fields (which only a rehash can squeeze out), or there are too many
+** shapes.
+*/
+static TValue *addfield (lua_State *L, Table *t, TString *key) {
+  Shape *s = t->shape;
+  Shape *ns;
+  unsigned int n = s->nkeys;
+  unsigned int i;
+  if (n >= LUAI_SHAPEMAX)
+    return NULL;
+  for (i = 0; i < n; i++) {
+    if (ttisnil(&t->fields[i]))
+      return NULL;
+  }
+  for (ns = s->kids; ns != NULL; ns = ns->sibling) {
+    if (ns->keys[n] == key)
+      break;
+  }
+  if (ns == NULL && G(L)->nshapes >= LUAI_MAXSHAPES)
+    return NULL;
+  if (n == t->sizefields)  /* grow fields before changing the shape */
+    setfieldsize(L, t, (n == 0) ? 4 : (2 * n < LUAI_SHAPEMAX) ? 2 * n
+                                                         : LUAI_SHAPEMAX);
+  if (ns == NULL)
+    ns = newshape(L, s, key);
+  luaC_movebarrier(L, t);  /* entries after the fields are renumbered */
+  ns->refs++;
+  t->shape = ns;
+  unrefshape(L, s);
+  return &t->fields[n];
+}
+
+
+/*
+** Turns record 't' into a regular table, with room in the hash part
+** for its fields plus a new key. The resize keeps the fields reachable;
+** the moves after it do not allocate (so no collection can see the
+** detached fields).
+*/
+static void unshape (lua_State *L, Table *t) {
+  Shape *s = t->shape;
+  TValue *fields;
+  unsigned int size;
+  unsigned int i;
+  lua_assert(isdummy(t));  /* records have no hash part */
+  if (s->nkeys > 0)
+    resize(L, t, t->sizearray, s->nkeys + 1);
+  fields = t->fields;
+  size = t->sizefields;
+  t->shape = NULL;
+  t->fields = NULL;
+  t->sizefields = 0;
+  for (i = 0; i < s->nkeys; i++) {
+    if (!ttisnil(&fields[i])) {
+      TValue k;
+      setsvalue(L, &k, s->keys[i]);
+      setobjt2t(L, luaH_set(L, t, &k), &fields[i]);
+    }
+  }
+  luaM_freearray(L, fields, size);
+  unrefshape(L, s);
+}
+
+
+void luaH_initshapes (lua_State *L) {
+  Shape *root = newshape(L, NULL, NULL);
+  G(L)->shaperoot = root;
+}
+
+
+void luaH_freeshapes (lua_State *L) {
+  global_State *g = G(L);
+  if (g->shaperoot != NULL) {
+    lua_assert(g->shaperoot->kids == NULL && g->nshapes == 1);
+    luaM_freemem(L, g->shaperoot, sizeshape(0));
+    g->shaperoot = NULL;
+    g->nshapes = 0;
+  }
+}
+
+/* }============================================================= */
+
+#endif
+
+
+#if defined(LUA_USE_INCREHASH)
+
+static unsigned int findindex (lua_State *L, Table *t, StkId key);
+
+/* index of a key not in the hash part: entries of the part being
+   migrated are numbered after those of the hash part */
+static unsigned int findold (lua_State *L, Table *t, StkId key) {
+  if (oldpart(t) == NULL)
+    luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+  return findindex(L, oldpart(t), key) + sizenode(t) + t->sizearray +
+         nfields(t);
+}
+
+#else
+#define findold(L,t,key)	(luaG_runerror(L, "invalid key to 'next'"), 0)
+#endif
+
+
 /*
 ** returns the index of a 'key' for table traversals. First goes all
-** elements in the array part, then elements in the hash part. The
-** beginning of a traversal is signaled by 0.
+** elements in the array part, then the fields of a record, then
+** elements in the hash part (and then those of a part being migrated,
+** see 'Rehash'). The beginning of a traversal is signaled
+** by 0.
 * 返回key在table中对应的位置下标:
 * key为数字 且  0 < key <= table.sizearray，则返回对应的int值
 * key不为数字则在table的hash node中查找,找到了返回 (table.sizearray + hash node下标 + 1)
@@ -173,6 +574,27 @@ static unsigned int findindex (lua_State *L, Table *t, StkId key) {
   i = arrayindex(key);
   if (i != 0 && i <= t->sizearray)  /* is 'key' inside array part?, key是个整数,根据值大小判断是否在table的数组部分 */
     return i;  /* yes; that's the index */
+#if defined(LUA_USE_SHAPES)
+  else if (t->shape != NULL && ttisshrstring(key)) {  /* a field? */
+    int f = shapeindex(t->shape, tsvalue(key));
+    if (f < 0)
+      luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+    return (f + 1) + t->sizearray;
+  }
+#endif
+#if defined(LUA_USE_SWISSTABLE)
+  else {
+    unsigned int h = keyhash(key);
+    forcandidates(t, h, n,
+      /* key may be dead already, but it is ok to use it in 'next' */
+      if (luaV_rawequalobj(gkey(n), key) ||
+            (ttisdeadkey(gkey(n)) && iscollectable(key) &&
+             deadvalue(gkey(n)) == gcvalue(key)))
+        return (cast_int(n - gnode(t, 0)) + 1) + t->sizearray + nfields(t);
+    )
+    return findold(L, t, key);
+  }
+#else
   else {
     int nx;
     Node *n = mainposition(t, key);
@@ -183,15 +605,16 @@ static unsigned int findindex (lua_State *L, Table *t, StkId key) {
              deadvalue(gkey(n)) == gcvalue(key)))
       {
         i = cast_int(n - gnode(t, 0));  /* key index in hash table */
-        /* hash elements are numbered after array ones */
-        return (i + 1) + t->sizearray;//数组个数 + hash node下标 + 1
+        /* hash elements are numbered after array ones (and fields) */
+        return (i + 1) + t->sizearray + nfields(t);//数组个数 + hash node下标 + 1
       }
       nx = gnext(n);
       if (nx == 0)
-        luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+        return findold(L, t, key);
       else n += nx;
     }
   }
+#endif
 }
 
 /*
@@ -212,14 +635,38 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
     }
   }
 
+  i -= t->sizearray;
+#if defined(LUA_USE_SHAPES)
+  for (; i < nfields(t); i++) {  /* record fields */
+    if (!ttisnil(gfield(t, i))) {
+      setsvalue2s(L, key, gfieldkey(t, i));
+      setobj2s(L, key+1, gfield(t, i));
+      return 1;
+    }
+  }
+  i -= nfields(t);
+#endif
+
   //hash node部分,
-  for (i -= t->sizearray; cast_int(i) < sizenode(t); i++) {  /* hash part */
+  for (; cast_int(i) < sizenode(t); i++) {  /* hash part */
     if (!ttisnil(gval(gnode(t, i)))) {  /* a non-nil value? */
       setobj2s(L, key, gkey(gnode(t, i)));//当前key所在位置对应的next hash node,将改node.key赋值到key(TValue*)中,
       setobj2s(L, key+1, gval(gnode(t, i)));
       return 1;
     }
   }
+#if defined(LUA_USE_INCREHASH)
+  if (oldpart(t) != NULL) {  /* part being migrated */
+    Table *old = oldpart(t);
+    for (i -= sizenode(t); cast_int(i) < sizenode(old); i++) {
+      if (!ttisnil(gval(gnode(old, i)))) {
+        setobj2s(L, key, gkey(gnode(old, i)));
+        setobj2s(L, key+1, gval(gnode(old, i)));
+        return 1;
+      }
+    }
+  }
+#endif
   return 0;  /* no more elements */
 }
 
@@ -343,14 +790,30 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
     t->node = cast(Node *, dummynode);  /* use common 'dummynode' */
     t->lsizenode = 0;
     t->lastfree = NULL;  /* signal that it is using dummy node */
+#if defined(LUA_USE_SWISSTABLE)
+    t->ctrl = cast(lu_byte *, dummyctrl);
+    t->growthleft = 0;
+#endif
   }
   else {
     int i;
     int lsize = luaO_ceillog2(size);
+#if defined(LUA_USE_SWISSTABLE)
+    if (maxload(cast(unsigned int, twoto(lsize))) < size)
+      lsize++;  /* keep the load under 7/8 */
+#endif
     if (lsize > MAXHBITS)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);//求间隔最近的2^n值,
+#if defined(LUA_USE_SWISSTABLE)
+    t->node = cast(Node *, luaM_malloc(L, nodeblocksize(size)));
+    t->ctrl = cast(lu_byte *, t->node + size);
+    for (i = 0; i < cast_int(ctrlsize(size)); i++)
+      t->ctrl[i] = CTRL_EMPTY;
+    t->growthleft = maxload(size);
+#else
     t->node = luaM_newvector(L, size, Node);
+#endif
     
     for (i = 0; i < (int)size; i++) {
       Node *n = gnode(t, i);
@@ -363,23 +826,303 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
   }
 }
 
+#if defined(LUA_USE_INCREHASH)
+
+/*
+** Incremental rehash (see 'Rehash'). Hash parts with at least
+** LUAI_REHASHMIN nodes keep running counts of their keys; the counting
+** pass visits LUAI_COUNTSTEP nodes per insertion.
+*/
+#if !defined(LUAI_REHASHMIN)
+#define LUAI_REHASHMIN	4096
+#endif
+
+#if !defined(LUAI_COUNTSTEP)
+#define LUAI_COUNTSTEP	4
+#endif
+
+
+static Node *freeslot (lua_State *L, Table *t, const TValue *key);
+
+
+static void resetcounts (Rehash *rh) {
+  int i;
+  rh->nkeys = rh->ckeys = rh->cursor = 0;
+  for (i = 0; i <= MAXABITS; i++)
+    rh->nums[i] = rh->cnums[i] = 0;
+}
+
+
+static Rehash *newrehash (lua_State *L) {
+  Rehash *rh = luaM_new(L, Rehash);
+  Table *old = &rh->old;  /* only its hash part is ever used */
+  old->node = NULL;
+  old->array = NULL;
+  old->sizearray = 0;
+  old->rh = NULL;
+#if defined(LUA_USE_SHAPES)
+  old->shape = NULL;
+#endif
+  rh->pending = rh->step = 0;
+  resetcounts(rh);
+  return rh;
+}
+
+
+static void freeold (lua_State *L, Rehash *rh) {
+  freenodes(L, rh->old.node, cast(size_t, sizenode(&rh->old)));
+  rh->old.node = NULL;
+  rh->pending = 0;
+}
+
+
+/*
+** Counts new key 'key', put in node 'n' of the hash part (by the
+** counting pass too, if it is past 'n').
+*/
+static void notekey (Table *t, Node *n, const TValue *key) {
+  Rehash *rh = t->rh;
+  if (rh != NULL) {
+    rh->nkeys++;
+    countint(key, rh->nums);
+    if (cast(unsigned int, n - t->node) < rh->cursor) {
+      rh->ckeys++;
+      countint(key, rh->cnums);
+    }
+  }
+}
+
+
+#if !defined(LUA_USE_SWISSTABLE)
+/*
+** Live node 'from' moved to 'to': it may have crossed the counting pass
+** (to be counted twice or not at all).
+*/
+static void notemove (Table *t, Node *from, Node *to) {
+  Rehash *rh = t->rh;
+  if (rh != NULL) {
+    int before = (cast(unsigned int, from - t->node) < rh->cursor);
+    if (before != (cast(unsigned int, to - t->node) < rh->cursor)) {
+      unsigned int k = arrayindex(gkey(to));
+      if (before) {  /* will be counted again */
+        rh->ckeys--;
+        if (k != 0) rh->cnums[luaO_ceillog2(k)]--;
+      }
+      else {  /* will not be visited */
+        rh->ckeys++;
+        if (k != 0) rh->cnums[luaO_ceillog2(k)]++;
+      }
+    }
+  }
+}
+#endif
+
+
+/*
+** One step of the counting pass. When the pass is done, its counts
+** (the keys alive when their nodes were visited, plus the ones added
+** behind it) replace the estimates.
+*/
+static void countstep (Table *t) {
+  Rehash *rh = t->rh;
+  unsigned int size = cast(unsigned int, sizenode(t));
+  unsigned int lim = rh->cursor + LUAI_COUNTSTEP;
+  int i;
+  for (; rh->cursor < lim && rh->cursor < size; rh->cursor++) {
+    Node *n = gnode(t, rh->cursor);
+    if (!ttisnil(gval(n))) {
+      rh->ckeys++;
+      countint(gkey(n), rh->cnums);
+    }
+  }
+  if (rh->cursor == size) {  /* pass done? */
+    rh->nkeys = rh->ckeys;
+    for (i = 0; i <= MAXABITS; i++) {
+      rh->nums[i] = rh->cnums[i];
+      rh->cnums[i] = 0;
+    }
+    rh->ckeys = rh->cursor = 0;  /* start a new one */
+  }
+}
+
+
+/*
+** Moves up to 'n' nodes of the part being migrated (the last ones
+** first) to the hash part, leaving them empty and without keys, so
+** that searches do not find them there again. Stops if the hash part
+** is full; the next rehash then takes both parts.
+*/
+static void migrate (lua_State *L, Table *t, int n) {
+  Rehash *rh = t->rh;
+  Table *old = &rh->old;
+  luaC_movebarrier(L, t);  /* entries move to the hash part */
+  for (; n > 0 && rh->pending > 0; n--) {
+    Node *o = gnode(old, rh->pending - 1);
+    if (!ttisnil(gval(o))) {
+      Node *mp = freeslot(L, t, gkey(o));
+      if (mp == NULL)
+        return;  /* no room */
+      setnodekey(L, &mp->i_key, gkey(o));
+      setobjt2t(L, gval(mp), gval(o));
+      notekey(t, mp, gkey(o));
+      setnilvalue(gval(o));
+    }
+    setnilvalue(wgkey(o));
+    rh->pending--;
+  }
+  if (rh->pending == 0)  /* migration done? */
+    freeold(L, rh);
+}
+
+
+/* the work of an incremental rehash done by each insertion */
+static void rehashstep (lua_State *L, Table *t) {
+  if (t->rh != NULL) {
+    if (t->rh->old.node != NULL)
+      migrate(L, t, t->rh->step);
+    else
+      countstep(t);
+  }
+}
+
+
+/*
+** Adds to 'nums' the keys of the array part of 't' as if it were full;
+** returns their number.
+*/
+static unsigned int fullarray (const Table *t, unsigned int *nums) {
+  int lg;
+  unsigned int ttlg;  /* 2^lg */
+  unsigned int i = 1;  /* first key of slice 'lg' */
+  for (lg = 0, ttlg = 1; i <= t->sizearray; lg++, ttlg *= 2) {
+    unsigned int lim = (ttlg < t->sizearray) ? ttlg : t->sizearray;
+    nums[lg] += lim - i + 1;
+    i = ttlg + 1;
+  }
+  return t->sizearray;
+}
+
+
+/*
+** Starts an incremental rehash of full table 't', which is getting new
+** key 'ek': gives it a new hash part sized from the running counts,
+** and keeps the current one to be migrated, with a pace that ends the
+** migration before half of the new room is used. Returns 0 if integer
+** keys might have to move to the array part (taking it as full gives
+** an upper bound); that needs the exact counts of a full rehash. (So
+** an incremental rehash never shrinks the array part.)
+*/
+static int startrehash (lua_State *L, Table *t, const TValue *ek) {
+  Rehash *rh = t->rh;
+  Table *old = &rh->old;
+  Node *node = t->node;
+  lu_byte lsize = t->lsizenode;
+  Node *lastfree = t->lastfree;
+#if defined(LUA_USE_SWISSTABLE)
+  lu_byte *ctrl = t->ctrl;
+#endif
+  unsigned int nums[MAXABITS + 1];
+  unsigned int na = 0;
+  unsigned int room;
+  int i;
+  lua_assert(old->node == NULL && !isdummy(t));
+  for (i = 0; i <= MAXABITS; i++)
+    na += (nums[i] = rh->nums[i]);
+  na += countint(ek, nums);
+  if (na > 0) {
+    na += fullarray(t, nums);
+    if (computesizes(nums, &na) > t->sizearray)
+      return 0;
+  }
+  luaC_movebarrier(L, t);  /* entries will move */
+  setnodevector(L, t, rh->nkeys + 1);
+  old->node = node;
+  old->lsizenode = lsize;
+  old->lastfree = lastfree;
+#if defined(LUA_USE_SWISSTABLE)
+  old->ctrl = ctrl;
+  old->growthleft = 0;
+  room = t->growthleft;
+#else
+  room = cast(unsigned int, sizenode(t));
+#endif
+  room = (room > rh->nkeys) ? room - rh->nkeys : 0;
+  rh->pending = sizenode(old);
+  rh->step = cast_int(cast(unsigned int, rh->pending) / (room / 2 + 1)) + 1;
+  resetcounts(rh);  /* the migration counts the keys again */
+  return 1;
+}
+
+#else
+
+#define notekey(t,n,key)	((void)0)
+#define notemove(t,from,to)	((void)0)
+#define rehashstep(L,t)		((void)0)
+
+#endif
+
+
+/*
+** Re-inserts into 't' the entries of the 'size' nodes at 'nold'. (They
+** do not need barriers or to invalidate the TM cache, as they were
+** already present in the table.)
+*/
+static void reinsert (lua_State *L, Table *t, Node *nold, int size) {
+  int j;
+  for (j = size - 1; j >= 0; j--) {
+    Node *old = nold + j;
+    if (!ttisnil(gval(old))) {
+#if defined(LUA_USE_SWISSTABLE)
+      if (arrayindex(gkey(old)) - 1 >= t->sizearray && t->growthleft > 0) {
+        /* a key for the hash part; keys are distinct, so no search */
+        Node *n = takeslot(t, gkey(old), keyhash(gkey(old)));
+        setnodekey(L, &n->i_key, gkey(old));
+        setobjt2t(L, gval(n), gval(old));
+        notekey(t, n, gkey(old));
+        continue;
+      }
+#endif
+      setobjt2t(L, luaH_set(L, t, gkey(old)), gval(old));
+    }
+  }
+}
+
 /* 更新table的大小(array和node hash), 并将原array和node hash的值插入到新的array和node hash中,
  * nasize: new array size
  * nhsize: new hash node size
  */
-void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
-                                          unsigned int nhsize) {
+static void resize (lua_State *L, Table *t, unsigned int nasize,
+                                         unsigned int nhsize) {
   unsigned int i;
-  int j;
   unsigned int oldasize = t->sizearray;
   int oldhsize = allocsizenode(t);
   Node *nold = t->node;  /* save old hash ... 注意这里保存了老node hash的首地址 */
-  
-  if (nasize > oldasize)  /* array part must grow? 数组扩容 */
+#if defined(LUA_USE_INCREHASH)
+  Node *mold = NULL;  /* part being migrated */
+  int moldsize = 0;
+  if (t->rh == NULL && nhsize >= LUAI_REHASHMIN)
+    t->rh = newrehash(L);  /* large hash part: keep counts */
+#endif
+  luaC_movebarrier(L, t);  /* entries will move */
+  if (nasize > oldasize) {  /* array part must grow? 数组扩容 */
+    if (t->lenhint < oldasize && !ttisnil(&t->array[oldasize - 1]))
+      t->lenhint = oldasize;  /* sequence reaches at least the old end */
     setarrayvector(L, t, nasize);//设置table.array的大小为size,并更新array中的元素值,
+  }
 
   /* create new hash part with appropriate size */
   setnodevector(L, t, nhsize);//设置table.node的大小为size,并将node中的所有元素信息清除,
+#if defined(LUA_USE_INCREHASH)
+  if (t->rh != NULL) {
+    if (t->rh->old.node != NULL) {  /* migration going on? take it over */
+      mold = t->rh->old.node;
+      moldsize = sizenode(&t->rh->old);
+      t->rh->old.node = NULL;
+      t->rh->pending = 0;
+    }
+    resetcounts(t->rh);  /* re-insertions count the keys again */
+  }
+#endif
   
   if (nasize < oldasize) {  /* array part must shrink?数组缩容 */
     t->sizearray = nasize;
@@ -393,23 +1136,53 @@ void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
   }
   
   /* re-insert elements from hash part */
-  for (j = oldhsize - 1; j >= 0; j--) {//将old node hash中的key-value插入到新的table中(插入到新的array或新的node hash中)
-    Node *old = nold + j;
-    if (!ttisnil(gval(old))) {
-      /* doesn't need barrier/invalidate cache, as entry was
-         already present in the table */
-      setobjt2t(L, luaH_set(L, t, gkey(old)), gval(old));
+  reinsert(L, t, nold, oldhsize);//将old node hash中的key-value插入到新的table中(插入到新的array或新的node hash中)
+  if (oldhsize > 0)  /* not the dummy node? 释放旧的node hash */
+    freenodes(L, nold, cast(size_t, oldhsize)); /* free old hash */
+#if defined(LUA_USE_INCREHASH)
+  if (mold != NULL) {
+    reinsert(L, t, mold, moldsize);
+    freenodes(L, mold, cast(size_t, moldsize));
+  }
+  if (t->rh != NULL && allocsizenode(t) < LUAI_REHASHMIN) {
+    luaM_free(L, t->rh);  /* small again */
+    t->rh = NULL;
+  }
+#endif
+}
+
+
+/*
+** Resize with sizes given by the user (table constructors and
+** 'lua_createtable'). With shapes, the expected hash entries of an empty
+** record are taken as string keys to be, and go to its fields, unless
+** too many for a record.
+*/
+void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
+                                          unsigned int nhsize) {
+#if defined(LUA_USE_SHAPES)
+  if (t->shape != NULL && nhsize > 0) {  /* records have no hash part */
+    if (t->shape->nkeys == 0 && nhsize <= LUAI_SHAPEMAX) {
+      if (nhsize > t->sizefields)
+        setfieldsize(L, t, nhsize);
+      nhsize = 0;
     }
+    else
+      unshape(L, t);
   }
-  if (oldhsize > 0)  /* not the dummy node? 释放旧的node hash */
-    luaM_freearray(L, nold, cast(size_t, oldhsize)); /* free old hash */
+#endif
+  resize(L, t, nasize, nhsize);
 }
 
 //更新table的数组大小(nasize:new array size), node hash的大小不变,
 //注意,table中的数组和node内容不变,key-value放的位置可能需要更新,
 void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize) {
   int nsize = allocsizenode(t);
-  luaH_resize(L, t, nasize, nsize);
+#if defined(LUA_USE_INCREHASH)
+  if (t->rh != NULL)
+    nsize += t->rh->pending;  /* room for the part being migrated */
+#endif
+  resize(L, t, nasize, nsize);
 }
 
 /*
@@ -423,10 +1196,16 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   unsigned int nums[MAXABITS + 1];
   int i;
   int totaluse;
+#if defined(LUA_USE_INCREHASH)
+  if (t->rh != NULL && t->rh->old.node == NULL && startrehash(L, t, ek))
+    return;  /* large table: rehash it incrementally */
+#endif
   for (i = 0; i <= MAXABITS; i++) nums[i] = 0;  /* reset counts */
   na = numusearray(t, nums);  /* count keys in array part */
   totaluse = na;  /* all those keys are integer keys */
   totaluse += numusehash(t, nums, &na);  /* count keys in hash part */
+  if (oldpart(t) != NULL)  /* count keys not migrated yet */
+    totaluse += numusehash(oldpart(t), nums, &na);
   /* count extra key ,判断extral key中保存的是不是整数 */
   na += countint(ek, nums);
   totaluse++;
@@ -434,7 +1213,7 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   /* compute new size for array part */
   asize = computesizes(nums, &na);
   /* resize the table to new computed sizes */
-  luaH_resize(L, t, asize, totaluse - na);
+  resize(L, t, asize, totaluse - na);
 }
 
 
@@ -453,6 +1232,16 @@ Table *luaH_new (lua_State *L) {
   t->flags = cast_byte(~0);//默认bits全为1, 表示node中不含"__index"等键值对,
   t->array = NULL;
   t->sizearray = 0;
+  t->lenhint = 0;
+#if defined(LUA_USE_INCREHASH)
+  t->rh = NULL;
+#endif
+#if defined(LUA_USE_SHAPES)
+  t->shape = G(L)->shaperoot;
+  t->shape->refs++;
+  t->fields = NULL;
+  t->sizefields = 0;
+#endif
   setnodevector(L, t, 0);
   return t;
 }
@@ -462,11 +1251,73 @@ Table *luaH_new (lua_State *L) {
  */
 void luaH_free (lua_State *L, Table *t) {
   if (!isdummy(t))
-    luaM_freearray(L, t->node, cast(size_t, sizenode(t)));
+    freenodes(L, t->node, cast(size_t, sizenode(t)));
   luaM_freearray(L, t->array, t->sizearray);
+#if defined(LUA_USE_SHAPES)
+  if (t->shape != NULL) {
+    luaM_freearray(L, t->fields, t->sizefields);
+    unrefshape(L, t->shape);
+  }
+#endif
+#if defined(LUA_USE_INCREHASH)
+  if (t->rh != NULL) {
+    if (t->rh->old.node != NULL)
+      freeold(L, t->rh);
+    luaM_free(L, t->rh);
+  }
+#endif
   luaM_free(L, t);
 }
 
+
+/*
+** Removes all entries of 't' but keeps the sizes of its parts, so that
+** it can be refilled without allocations. (A record keeps its fields
+** vector and goes back to the empty shape.)
+*/
+void luaH_clear (lua_State *L, Table *t) {
+  unsigned int i;
+  luaC_movebarrier(L, t);  /* entries vanish */
+  t->lenhint = 0;
+  for (i = 0; i < t->sizearray; i++)
+    setnilvalue(&t->array[i]);
+  if (!isdummy(t)) {
+    int j;
+    int size = sizenode(t);
+    for (j = 0; j < size; j++) {
+      Node *n = gnode(t, j);
+      gnext(n) = 0;
+      setnilvalue(wgkey(n));
+      setnilvalue(gval(n));
+    }
+    t->lastfree = gnode(t, size);  /* all positions are free */
+#if defined(LUA_USE_SWISSTABLE)
+    for (j = 0; j < cast_int(ctrlsize(size)); j++)
+      t->ctrl[j] = CTRL_EMPTY;
+    t->growthleft = maxload(cast(unsigned int, size));
+#endif
+  }
+#if defined(LUA_USE_INCREHASH)
+  if (t->rh != NULL) {
+    if (t->rh->old.node != NULL)
+      freeold(L, t->rh);
+    resetcounts(t->rh);
+  }
+#endif
+#if defined(LUA_USE_SHAPES)
+  if (t->shape != NULL && t->shape != G(L)->shaperoot) {
+    Shape *s = t->shape;
+    for (i = 0; i < s->nkeys; i++)
+      setnilvalue(gfield(t, i));
+    t->shape = G(L)->shaperoot;
+    t->shape->refs++;
+    unrefshape(L, s);
+  }
+#endif
+  invalidateTMcache(t);
+}
+
+#if !defined(LUA_USE_SWISSTABLE)
 //从(lastfree--)开始,查找到第一个空闲node(key为nil,并更新 lastfree )并返回,
 static Node *getfreepos (Table *t) {
   if (!isdummy(t)) {
@@ -478,43 +1329,29 @@ static Node *getfreepos (Table *t) {
   }
   return NULL;  /* could not find a free place */
 }
+#endif
 
 
 
 /*
-** inserts a new key into a hash table; first, check whether key's main
-** position is free. If not, check whether colliding node is in its main
-** position or not: if it is not, move colliding node to an empty place and
-** put new key in its main position; otherwise (colliding node is in its main
-** position), new key goes to an empty position.
-*
-* 将新的key(TValue*)插入到table的hash node(检测是否需要扩容,并检测是否冲突)中,并返回node.i_val(类型为TValue*,注意该node已填充好了key)
-* 
+** Finds a node for new key 'key' in the hash part of 't' (in the
+** chained layout, moving a colliding node out of the key's main
+** position if needed). Returns NULL if the hash part is full.
 */
-TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
-  Node *mp;
-  TValue aux;
-  if (ttisnil(key)) luaG_runerror(L, "table index is nil");
-  else if (ttisfloat(key)) {//如果是float则需要转成整数,保存到aux中,最终将整数保存回key中,
-    lua_Integer k;
-    if (luaV_tointeger(key, &k, 0)) {  /* does index fit in an integer? */
-      setivalue(&aux, k);
-      key = &aux;  /* insert it as an integer */
-    }
-    else if (luai_numisnan(fltvalue(key)))
-      luaG_runerror(L, "table index is NaN");
-  }
-  
-  mp = mainposition(t, key);//先求出位置:对应的Table.node(hash部分)数组元素的地址,
+static Node *freeslot (lua_State *L, Table *t, const TValue *key) {
+#if defined(LUA_USE_SWISSTABLE)
+  UNUSED(L);
+  if (t->growthleft == 0)
+    return NULL;
+  return takeslot(t, key, keyhash(key));
+#else
+  Node *mp = mainposition(t, key);//先求出位置:对应的Table.node(hash部分)数组元素的地址,
   
   if (!ttisnil(gval(mp)) || isdummy(t)) {  /* 该node中已被占用, main position is taken? */
     Node *othern;
     Node *f = getfreepos(t);  /* get a free place */
-    if (f == NULL) {  /* cannot find a free place? 没有空间了,则扩容 */
-      rehash(L, t, key);  /* grow table, 注意这里面会考虑等待新插入的key */
-      /* whatever called 'newkey' takes care of TM cache */
-      return luaH_set(L, t, key);  /* insert key into grown table */
-    }
+    if (f == NULL)  /* cannot find a free place? */
+      return NULL;
     
     lua_assert(!isdummy(t));
     othern = mainposition(t, gkey(mp));//冲突元素实际的位置,
@@ -531,7 +1368,9 @@ TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
       //此刻othern冲突元素为mainpositoin(被占用的node)的前一个node,
       //修改othern冲突元素的next偏移值,使它指向f(freePos)
       gnext(othern) = cast_int(f - othern);  /* rechain to point to 'f',1.修改冲突node前一个元素的next偏移值 */
+      luaC_movebarrier(L, t);  /* colliding node moves to 'f' */
       *f = *mp;  /* copy colliding node into free pos. (mp->next also goes),2.将冲突node移动到freePos */
+      notemove(t, mp, f);
       if (gnext(mp) != 0) {
         gnext(f) += cast_int(mp - f);  /* correct 'next' ,3.更新冲突node.next偏移值,注意这里是"+="而不是"="*/
         gnext(mp) = 0;  /* now 'mp' is free, mainPosition位置的node*/
@@ -552,9 +1391,58 @@ TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
       mp = f;
     }
   }
+  return mp;
+#endif
+}
+
+
+/*
+** inserts a new key into a hash table; first, check whether key's main
+** position is free. If not, check whether colliding node is in its main
+** position or not: if it is not, move colliding node to an empty place and
+** put new key in its main position; otherwise (colliding node is in its main
+** position), new key goes to an empty position.
+*
+* 将新的key(TValue*)插入到table的hash node(检测是否需要扩容,并检测是否冲突)中,并返回node.i_val(类型为TValue*,注意该node已填充好了key)
+* 
+*/
+TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
+  Node *mp;
+  TValue aux;
+  if (ttisnil(key)) luaG_runerror(L, "table index is nil");
+  else if (ttisfloat(key)) {//如果是float则需要转成整数,保存到aux中,最终将整数保存回key中,
+    lua_Integer k;
+    if (luaV_tointeger(key, &k, 0)) {  /* does index fit in an integer? */
+      setivalue(&aux, k);
+      key = &aux;  /* insert it as an integer */
+    }
+    else if (luai_numisnan(fltvalue(key)))
+      luaG_runerror(L, "table index is NaN");
+  }
+#if defined(LUA_USE_SHAPES)
+  if (t->shape != NULL) {  /* a record? */
+    if (ttisshrstring(key)) {
+      TValue *f = addfield(L, t, tsvalue(key));
+      if (f != NULL)
+        return f;
+    }
+    unshape(L, t);  /* no longer a record */
+  }
+#endif
+  rehashstep(L, t);
+  mp = freeslot(L, t, key);
+  if (mp == NULL) {  /* no room for a new key? 没有空间了,则扩容 */
+    rehash(L, t, key);  /* grow table, 注意这里面会考虑等待新插入的key */
+    /* whatever called 'newkey' takes care of TM cache */
+    return luaH_set(L, t, key);  /* insert key into grown table */
+  }
   
   setnodekey(L, &mp->i_key, key);//将key赋值给Node.i_key
   luaC_barrierback(L, t, key);
+  notekey(t, mp, key);
+  if (ttisinteger(key) && t->lenhint < cast(unsigned int, MAX_INT) &&
+      l_castS2U(ivalue(key)) == cast(lua_Unsigned, t->lenhint) + 1)
+    t->lenhint++;  /* appending past the array part */
   lua_assert(ttisnil(gval(mp)));
   return gval(mp);//返回node.i_val(类型为TValue*), 注意该node已填充好了key 
 }
@@ -570,6 +1458,16 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
   /* (1 <= key && key <= t->sizearray) */
   if (l_castS2U(key) - 1 < t->sizearray)//这里其实有个问题,在表格resize的时候,原来在hash表中的node.key>srcSize但node.key<dstSize的节点,会不会搬到新table的array中,
     return &t->array[key - 1];
+#if defined(LUA_USE_SWISSTABLE)
+  else {
+    unsigned int h = inthash(key);
+    forcandidates(t, h, n,
+      if (ttisinteger(gkey(n)) && ivalue(gkey(n)) == key)
+        return gval(n);
+    )
+    return notfound(t, luaH_getint(oldpart(t), key));
+  }
+#else
   else {//到 hash表中查询,
     Node *n = hashint(t, key);
     for (;;) {  /* check whether 'key' is somewhere in the chain */
@@ -581,8 +1479,9 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
         n += nx;
       }
     }
-    return luaO_nilobject;
+    return notfound(t, luaH_getint(oldpart(t), key));
   }
+#endif
 }
 
 
@@ -592,8 +1491,27 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
 * 不会调用元方法,
 */
 const TValue *luaH_getshortstr (Table *t, TString *key) {
-  Node *n = hashstr(t, key);
+#if !defined(LUA_USE_SWISSTABLE)
+  Node *n;
+#endif
   lua_assert(key->tt == LUA_TSHRSTR);
+#if defined(LUA_USE_SHAPES)
+  if (t->shape != NULL) {  /* a record keeps all its short-string keys */
+    int i = shapeindex(t->shape, key);
+    return (i < 0) ? luaO_nilobject : gfield(t, i);
+  }
+#endif
+#if defined(LUA_USE_SWISSTABLE)
+  {
+    unsigned int h = mixhash(key->hash);
+    forcandidates(t, h, n,
+      if (ttisshrstring(gkey(n)) && eqshrstr(tsvalue(gkey(n)), key))
+        return gval(n);
+    )
+    return notfound(t, luaH_getshortstr(oldpart(t), key));
+  }
+#else
+  n = hashstr(t, key);
 
   //根据node和node.next,一直查找到最后一个元素, 查找key是否已存在,
   for (;;) {  /* check whether 'key' is somewhere in the chain */
@@ -603,10 +1521,69 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
     else {
       int nx = gnext(n);
       if (nx == 0)
-        return luaO_nilobject;  /* not found */
+        return notfound(t, luaH_getshortstr(oldpart(t), key));  /* not found */
+      n += nx;
+    }
+  }
+#endif
+}
+
+
+/*
+** search function for short strings through an inline cache: a single
+** key comparison at the position where 'key' was last found confirms
+** the hit, for this table or any other with the same layout. On a
+** miss, does a regular search and updates the cache.
+*/
+const TValue *luaH_getshortstrcached (Table *t, TString *key,
+                                      FieldCache *fc) {
+  Node *n;
+  lua_assert(key->tt == LUA_TSHRSTR);
+#if defined(LUA_USE_SHAPES)
+  if (t->shape != NULL) {  /* records cache the field index */
+    Shape *s = t->shape;
+    int i;
+    if (fc->idx < s->nkeys && s->keys[fc->idx] == key)
+      return gfield(t, fc->idx);  /* cache hit */
+    i = shapeindex(s, key);
+    if (i < 0)
+      return luaO_nilobject;
+    fc->idx = cast(unsigned int, i);
+    return gfield(t, i);
+  }
+#endif
+  if (fc->idx < cast(unsigned int, sizenode(t))) {
+    n = gnode(t, fc->idx);
+    if (ttisshrstring(gkey(n)) && eqshrstr(tsvalue(gkey(n)), key))
+      return gval(n);  /* cache hit */
+  }
+#if defined(LUA_USE_SWISSTABLE)
+  {
+    unsigned int h = mixhash(key->hash);
+    forcandidates(t, h, m,
+      if (ttisshrstring(gkey(m)) && eqshrstr(tsvalue(gkey(m)), key)) {
+        fc->idx = cast(unsigned int, m - t->node);  /* remember where */
+        return gval(m);
+      }
+    )
+    return notfound(t, luaH_getshortstr(oldpart(t), key));
+  }
+#else
+  n = hashstr(t, key);
+  for (;;) {  /* check whether 'key' is somewhere in the chain */
+    const TValue *k = gkey(n);
+    if (ttisshrstring(k) && eqshrstr(tsvalue(k), key)) {
+      fc->idx = cast(unsigned int, n - t->node);  /* remember where */
+      return gval(n);
+    }
+    else {
+      int nx = gnext(n);
+      if (nx == 0)
+        return notfound(t, luaH_getshortstr(oldpart(t), key));  /* not found */
       n += nx;
     }
   }
+#endif
 }
 
 
@@ -616,6 +1593,14 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
 *  返回t[key],是在table.node中查找(没有触发元方法), 所以key不能为整数或可转成整数的浮点数,
 */
 static const TValue *getgeneric (Table *t, const TValue *key) {
+#if defined(LUA_USE_SWISSTABLE)
+  unsigned int h = keyhash(key);
+  forcandidates(t, h, n,
+    if (luaV_rawequalobj(gkey(n), key))
+      return gval(n);
+  )
+  return notfound(t, getgeneric(oldpart(t), key));
+#else
   Node *n = mainposition(t, key);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     if (luaV_rawequalobj(gkey(n), key))//简单对比key(指针),并不会触发元方法,
@@ -623,10 +1608,11 @@ static const TValue *getgeneric (Table *t, const TValue *key) {
     else {
       int nx = gnext(n);
       if (nx == 0)
-        return luaO_nilobject;  /* not found */
+        return notfound(t, getgeneric(oldpart(t), key));  /* not found */
       n += nx;
     }
   }
+#endif
 }
 
 /*简单查找 t[key], key为string(不会触发元方法)
@@ -692,6 +1678,12 @@ void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
     cell = luaH_newkey(L, t, &k);
   }
   setobj2t(L, cell, value);
+  if (key == cast(lua_Integer, t->lenhint) + 1) {  /* appending? */
+    if (!ttisnil(value) && t->lenhint < cast(unsigned int, MAX_INT))
+      t->lenhint++;
+  }
+  else if (key == cast(lua_Integer, t->lenhint) && key > 0 && ttisnil(value))
+    t->lenhint--;  /* removing the last element */
 }
 
 /*
@@ -732,8 +1724,23 @@ static int unbound_search (Table *t, unsigned int j) {
 * 先数组部分找,找不到则在node中找, 所返回的i值并不能认为就是table中有效值的个数,比如数组中 {1,2,3,nil,5,6,7,nil},返回的就是3,会把5,6,7忽略的,
 */
 int luaH_getn (Table *t) {
-  //检查数组部分,
+  unsigned int h = t->lenhint;
   unsigned int j = t->sizearray;
+  if (j > 0 && !ttisnil(&t->array[j - 1]) &&
+      (isdummy(t) || ttisnil(luaH_getint(t, j + 1))))
+    return t->lenhint = j;  /* full array part ends the sequence */
+  /* appends and removals at the end of a sequence move its border by
+     one, so try the last border found and its neighbours first */
+  if (ttisnil(luaH_getint(t, h + 1))) {
+    if (h == 0 || !ttisnil(luaH_getint(t, h)))
+      return h;  /* hint is still a border */
+    if (h == 1 || !ttisnil(luaH_getint(t, h - 1)))
+      return t->lenhint = h - 1;  /* last element removed */
+  }
+  else if (h < cast(unsigned int, MAX_INT) - 1 &&
+           ttisnil(luaH_getint(t, h + 2)))
+    return t->lenhint = h + 1;  /* one element appended */
+  //检查数组部分,
   if (j > 0 && ttisnil(&t->array[j - 1])) {//数组里面最后一格元素是nil,
     /* there is a boundary in the array part: (binary) search for it, 二分法 */
     unsigned int i = 0;
@@ -744,12 +1751,12 @@ int luaH_getn (Table *t) {
       if (ttisnil(&t->array[m - 1])) j = m;
       else i = m;
     }
-    return i;
+    return t->lenhint = i;
   }
   /* else must find a boundary in hash part */
   else if (isdummy(t))  /* hash part is empty? hash表是空 */
-    return j;  /* that is easy... */
-  else return unbound_search(t, j);//hash表不为空,
+    return t->lenhint = j;  /* that is easy... */
+  else return t->lenhint = unbound_search(t, j);//hash表不为空,
 }
 
 
@@ -757,7 +1764,11 @@ int luaH_getn (Table *t) {
 #if defined(LUA_DEBUG)
 
 Node *luaH_mainposition (const Table *t, const TValue *key) {
+#if defined(LUA_USE_SWISSTABLE)
+  return gnode(t, (h1(keyhash(key)) & groupmask(t)) * GROUPSIZE);
+#else
   return mainposition(t, key);
+#endif
 }
 
 int luaH_isdummy (const Table *t) { return isdummy(t); }
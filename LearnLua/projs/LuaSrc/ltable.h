@@ -46,10 +46,56 @@
   (gkey(cast(Node *, cast(char *, (v)) - offsetof(Node, i_val))))
 
 
+/*
+** Records (see 'Shape'): keys in 'shape', values in 'fields'. Without
+** LUA_USE_SHAPES no table is a record, and these are empty.
+*/
+#if defined(LUA_USE_SHAPES)
+
+#define sizefields(t)	((t)->sizefields)
+#define nfields(t)	((t)->shape ? (t)->shape->nkeys : 0)
+#define gfield(t,i)	(&(t)->fields[i])
+#define gfieldkey(t,i)	((t)->shape->keys[i])
+
+LUAI_FUNC void luaH_initshapes (lua_State *L);
+LUAI_FUNC void luaH_freeshapes (lua_State *L);
+
+#else
+
+#define sizefields(t)	0
+#define nfields(t)	0
+#define gfield(t,i)	check_exp(0, cast(TValue *, NULL))
+#define gfieldkey(t,i)	check_exp(0, cast(TString *, NULL))
+
+#define luaH_initshapes(L)	((void)0)
+#define luaH_freeshapes(L)	((void)0)
+
+#endif
+
+
+/*
+** Hash part still being migrated by an incremental rehash, as a table
+** of its own (NULL if none); GC traversals visit it after 'node'.
+*/
+#if defined(LUA_USE_INCREHASH)
+#define oldpart(t)	((t)->rh != NULL && (t)->rh->old.node != NULL ? \
+                         &(t)->rh->old : cast(Table *, NULL))
+#else
+#define oldpart(t)	cast(Table *, NULL)
+#endif
+
+#define sizeoldpart(t)	(oldpart(t) ? sizenode(oldpart(t)) : 0)
+
+/* the hash part of 'h' after 'p' */
+#define nextpart(h,p)	((p) == (h) ? oldpart(h) : cast(Table *, NULL))
+
+
 LUAI_FUNC const TValue *luaH_getint (Table *t, lua_Integer key);
 LUAI_FUNC void luaH_setint (lua_State *L, Table *t, lua_Integer key,
                                                     TValue *value);
 LUAI_FUNC const TValue *luaH_getshortstr (Table *t, TString *key);
+LUAI_FUNC const TValue *luaH_getshortstrcached (Table *t, TString *key,
+                                                FieldCache *fc);
 LUAI_FUNC const TValue *luaH_getstr (Table *t, TString *key);
 LUAI_FUNC const TValue *luaH_get (Table *t, const TValue *key);
 LUAI_FUNC TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key);
@@ -59,6 +105,7 @@ LUAI_FUNC void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
                                                     unsigned int nhsize);
 LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize);
 LUAI_FUNC void luaH_free (lua_State *L, Table *t);
+LUAI_FUNC void luaH_clear (lua_State *L, Table *t);
 LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
 LUAI_FUNC int luaH_getn (Table *t);
 
@@ -185,12 +185,45 @@ static int tconcat (lua_State *L) {
 }
 
 
+/*
+** {======================================================
+** Preallocation and reuse
+** =======================================================
+*/
+
+/*
+** table.new(narray, nhash): a table with room for 'narray' array
+** elements and 'nhash' other entries
+*/
+static int tnew (lua_State *L) {
+  lua_Integer narr = luaL_optinteger(L, 1, 0);
+  lua_Integer nrec = luaL_optinteger(L, 2, 0);
+  luaL_argcheck(L, 0 <= narr && narr <= INT_MAX, 1, "out of range");
+  luaL_argcheck(L, 0 <= nrec && nrec <= INT_MAX, 2, "out of range");
+  lua_createtable(L, (int)narr, (int)nrec);
+  return 1;
+}
+
+
+/*
+** table.clear(t): removes all entries of 't', keeping its memory
+*/
+static int tclear (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_cleartable(L, 1);
+  return 0;
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** Pack/unpack
 ** =======================================================
 */
 
+
 static int pack (lua_State *L) {
   int i;
   int n = lua_gettop(L);  /* number of elements to pack */
@@ -429,6 +462,8 @@ static const luaL_Reg tab_funcs[] = {
   {"maxn", maxn},
 #endif
   {"insert", tinsert},
+  {"new", tnew},
+  {"clear", tclear},
   {"pack", pack},
   {"unpack", unpack},
   {"remove", tremove},
@@ -0,0 +1,339 @@
+/*
+** $Id: ltrace.c $
+** Recorder of traces of hot loops
+** See Copyright Notice in lua.h
+*/
+
+#define ltrace_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "lapi.h"
+#include "ldebug.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lstate.h"
+#include "lstring.h"
+#include "ltable.h"
+#include "ltm.h"
+#include "ltrace.h"
+
+
+/*
+** The interpreter counts the backward jumps of each loop (OP_FORLOOP,
+** OP_TFORLOOP and OP_JMP with a negative offset), using the inline-cache
+** slot of the jump instruction as its counter. When a loop gets hot,
+** 'luaR_start' sets MASKREC in the hook mask, so that the next
+** iteration goes through 'luaG_traceexec', which calls 'luaR_record'
+** for each instruction. The recording stops when that iteration
+** reaches the backward jump again; instructions of functions called by
+** the loop are not recorded. Any other way out of the loop (a 'break',
+** an error, a very long iteration) discards the trace. Each loop is
+** recorded at most once.
+*/
+
+
+#define ci_func(ci)		(clLvalue((ci)->func))
+
+
+void luaR_start (lua_State *L, CallInfo *ci, const Instruction *pc) {
+  Proto *p = ci_func(ci)->p;
+  Trace *tr;
+  if (L->rec != NULL)  /* already recording another loop? */
+    return;
+  tr = luaM_new(L, Trace);
+  tr->next = NULL;
+  tr->p = p;
+  tr->ci = ci;
+  tr->endpc = cast_int(pc - p->code);
+  tr->startpc = tr->endpc + 1 + GETARG_sBx(*pc);
+  tr->n = tr->size = tr->skipped = 0;
+  tr->ins = NULL;
+  L->rec = tr;
+  L->hookmask |= MASKREC;
+}
+
+
+static void freetrace (lua_State *L, Trace *tr) {
+  luaM_freearray(L, tr->ins, tr->size);
+  luaM_free(L, tr);
+}
+
+
+void luaR_abort (lua_State *L) {
+  if (L->rec != NULL) {
+    freetrace(L, L->rec);
+    L->rec = NULL;
+  }
+  L->hookmask &= ~MASKREC;
+}
+
+
+/*
+** remove from the list of traces the ones of a prototype being freed
+*/
+void luaR_freeproto (lua_State *L, Proto *p) {
+  Trace **tr = &G(L)->traces;
+  while (*tr != NULL) {
+    if ((*tr)->p == p) {
+      Trace *dead = *tr;
+      *tr = dead->next;
+      freetrace(L, dead);
+    }
+    else
+      tr = &(*tr)->next;
+  }
+}
+
+
+/* is 'ci' still in the call stack of 'L'? */
+static int isactive (lua_State *L, CallInfo *ci) {
+  CallInfo *c;
+  for (c = L->ci; c != &L->base_ci; c = c->previous) {
+    if (c == ci)
+      return 1;
+  }
+  return 0;
+}
+
+
+/* type of RK(x) */
+#define rktype(base,k,x)	ttype(ISK(x) ? (k) + INDEXK(x) : (base) + (x))
+
+
+/* register the types of the operands read by instruction 'i' */
+static void settypes (CallInfo *ci, Instruction i, TraceIns *ti) {
+  LClosure *cl = ci_func(ci);
+  StkId base = ci->u.l.base;
+  TValue *k = cl->p->k;
+  OpCode op = GET_OPCODE(i);
+  ti->ta = ti->tb = ti->tc = NOTYPE;
+  if (getOpMode(op) == iABC) {
+    switch (getBMode(op)) {
+      case OpArgR: ti->tb = ttype(base + GETARG_B(i)); break;
+      case OpArgK: ti->tb = rktype(base, k, GETARG_B(i)); break;
+      default: break;
+    }
+    switch (getCMode(op)) {
+      case OpArgR: ti->tc = ttype(base + GETARG_C(i)); break;
+      case OpArgK: ti->tc = rktype(base, k, GETARG_C(i)); break;
+      default: break;
+    }
+  }
+  switch (op) {
+    case OP_GETTABUP:
+      ti->tb = ttype(cl->upvals[GETARG_B(i)]->v);
+      break;
+    case OP_SETTABUP:
+      ti->ta = ttype(cl->upvals[GETARG_A(i)]->v);
+      break;
+    case OP_SETUPVAL: case OP_SETTABLE: case OP_TEST: case OP_CALL:
+    case OP_TAILCALL: case OP_FORLOOP: case OP_TFORCALL: case OP_SETLIST:
+      ti->ta = ttype(base + GETARG_A(i));
+      break;
+    default: break;
+  }
+}
+
+
+/*
+** Rewrite the arithmetic and comparison instructions of a finished
+** trace to the quickened forms matching the types it saw. (Quickened
+** instructions check their types, so a wrong guess only costs one
+** fallback to the generic form.)
+*/
+static void specialize (Trace *tr) {
+  int j;
+  for (j = 0; j < tr->n; j++) {
+    TraceIns *ti = &tr->ins[j];
+    OpCode q;
+    switch (luaP_generic(cast(OpCode, ti->op))) {
+      case OP_ADD: q = OP_ADDII; break;
+      case OP_SUB: q = OP_SUBII; break;
+      case OP_MUL: q = OP_MULII; break;
+      case OP_EQ: q = OP_EQII; break;
+      case OP_LT: q = OP_LTII; break;
+      case OP_LE: q = OP_LEII; break;
+      default: continue;
+    }
+    /* each integer form is followed by its float form */
+    if (ti->tb == LUA_TNUMINT && ti->tc == LUA_TNUMINT)
+      SET_OPCODE(tr->p->code[ti->pc], q);
+    else if (ti->tb == LUA_TNUMFLT && ti->tc == LUA_TNUMFLT)
+      SET_OPCODE(tr->p->code[ti->pc], q + 1);
+  }
+}
+
+
+static void finishtrace (lua_State *L, Trace *tr) {
+  global_State *g = G(L);
+  L->rec = NULL;
+  L->hookmask &= ~MASKREC;
+  luaM_reallocvector(L, tr->ins, tr->size, tr->n, TraceIns);
+  tr->size = tr->n;
+  tr->ci = NULL;
+  specialize(tr);
+  tr->p->traced = 1;
+  tr->next = g->traces;
+  g->traces = tr;
+}
+
+
+/*
+** Called (through 'luaG_traceexec') before each instruction while a
+** loop is being recorded
+*/
+void luaR_record (lua_State *L) {
+  Trace *tr = L->rec;
+  CallInfo *ci = L->ci;
+  TraceIns *ti;
+  int pc;
+  lua_assert(tr != NULL);
+  if (ci != tr->ci) {  /* not in the frame of the loop? */
+    if (++tr->skipped > LUAI_MAXTRACE * 10 || !isactive(L, tr->ci))
+      luaR_abort(L);  /* iteration too long or loop's frame is gone */
+    return;
+  }
+  if (ci_func(ci)->p != tr->p)  /* frame was reused by another function? */
+    pc = -1;
+  else
+    pc = pcRel(ci->u.l.savedpc, tr->p);
+  if (pc < tr->startpc || pc > tr->endpc || tr->n >= LUAI_MAXTRACE) {
+    luaR_abort(L);  /* left the loop or trace too long */
+    return;
+  }
+  luaM_growvector(L, tr->ins, tr->n, tr->size, TraceIns, LUAI_MAXTRACE,
+                  "instructions in a trace");
+  ti = &tr->ins[tr->n++];
+  if (pc == tr->startpc && tr->n > 1) {
+    /* back at the start: the backward jump ran as part of the previous
+       instruction (a test followed by a jump, or OP_TFORCALL) without
+       being fetched; its operands are gone */
+    pc = tr->endpc;
+    ti->ta = ti->tb = ti->tc = NOTYPE;
+  }
+  else
+    settypes(ci, tr->p->code[pc], ti);
+  ti->pc = pc;
+  ti->op = cast_byte(GET_OPCODE(tr->p->code[pc]));
+  if (pc == tr->endpc)  /* completed one iteration? */
+    finishtrace(L, tr);
+}
+
+
+/* name of a type recorded in a trace */
+static const char *tracetype (int t) {
+  switch (t) {
+    case LUA_TNUMINT: return "integer";
+    case LUA_TNUMFLT: return "float";
+    default: return ttypename(novariant(t));
+  }
+}
+
+
+/* t[k] = v */
+static void setfield (lua_State *L, Table *t, const char *k,
+                      const TValue *v) {
+  TValue key;
+  setsvalue(L, &key, luaS_new(L, k));
+  setobj2t(L, luaH_set(L, t, &key), v);
+}
+
+
+static void setintfield (lua_State *L, Table *t, const char *k,
+                         lua_Integer i) {
+  TValue v;
+  setivalue(&v, i);
+  setfield(L, t, k, &v);
+}
+
+
+static void setstrfield (lua_State *L, Table *t, const char *k,
+                         const char *s) {
+  TValue v;
+  setsvalue(L, &v, luaS_new(L, s));
+  setfield(L, t, k, &v);
+}
+
+
+static void settypefield (lua_State *L, Table *t, const char *k, int tp) {
+  if (tp != NOTYPE)
+    setstrfield(L, t, k, tracetype(tp));
+}
+
+
+/*
+** Build the description of a trace: fields 'source', 'line' (of the
+** loop start), 'startpc' and 'endpc' (1-based, as in 'luac -l'), and a
+** list with one table per instruction, with fields 'pc', 'line', 'op'
+** and the types of the operands it read ('a', 'b', 'c').
+*/
+static Table *maketrace (lua_State *L, Trace *tr) {
+  Proto *p = tr->p;
+  Table *t = luaH_new(L);
+  TValue v;
+  int j;
+  sethvalue(L, &v, t);
+  setobj2s(L, L->top, &v);  /* anchor it */
+  api_incr_top(L);
+  if (p->source) {
+    setsvalue(L, &v, p->source);
+    setfield(L, t, "source", &v);
+  }
+  setintfield(L, t, "line", getfuncline(p, tr->startpc));
+  setintfield(L, t, "startpc", tr->startpc + 1);
+  setintfield(L, t, "endpc", tr->endpc + 1);
+  for (j = 0; j < tr->n; j++) {
+    TraceIns *ti = &tr->ins[j];
+    Table *e = luaH_new(L);
+    sethvalue(L, &v, e);
+    luaH_setint(L, t, j + 1, &v);
+    setintfield(L, e, "pc", ti->pc + 1);
+    setintfield(L, e, "line", getfuncline(p, ti->pc));
+    setstrfield(L, e, "op", luaP_opnames[ti->op]);
+    settypefield(L, e, "a", ti->ta);
+    settypefield(L, e, "b", ti->tb);
+    settypefield(L, e, "c", ti->tc);
+  }
+  L->top--;
+  return t;
+}
+
+
+/*
+** Pops a function (or nil) and pushes a list with the traces recorded
+** for the loops of that function (or of all functions). No collection
+** can run while the list is built, so the traces cannot be freed.
+*/
+LUA_API void lua_gettraces (lua_State *L) {
+  StkId o;
+  Proto *p = NULL;
+  int all;
+  Table *res;
+  Trace *tr;
+  int n = 0;
+  lua_lock(L);
+  o = L->top - 1;
+  api_check(L, ttisfunction(o) || ttisnil(o), "function or nil expected");
+  all = ttisnil(o);
+  if (ttisLclosure(o))
+    p = clLvalue(o)->p;
+  res = luaH_new(L);
+  sethvalue(L, o, res);  /* replace the argument with the result */
+  for (tr = G(L)->traces; tr != NULL; tr = tr->next) {
+    if (all || tr->p == p) {
+      TValue v;
+      sethvalue(L, &v, maketrace(L, tr));
+      luaH_setint(L, res, ++n, &v);
+    }
+  }
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
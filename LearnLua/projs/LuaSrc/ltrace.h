@@ -0,0 +1,62 @@
+/*
+** $Id: ltrace.h $
+** Recorder of traces of hot loops
+** See Copyright Notice in lua.h
+*/
+
+#ifndef ltrace_h
+#define ltrace_h
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/* number of backward jumps after which a loop is recorded */
+#if !defined(LUAI_HOTLOOP)
+#define LUAI_HOTLOOP	56
+#endif
+
+/* maximum number of instructions in a trace */
+#if !defined(LUAI_MAXTRACE)
+#define LUAI_MAXTRACE	500
+#endif
+
+
+/*
+** private bit in 'L->hookmask': while set, the interpreter calls
+** 'luaG_traceexec' (and so 'luaR_record') for each instruction
+*/
+#define MASKREC		(1 << 7)
+
+/* type of an operand that an instruction does not read */
+#define NOTYPE		cast_byte(LUA_TNONE)
+
+
+/* one executed instruction */
+typedef struct TraceIns {
+  int pc;
+  lu_byte op;  /* opcode as executed */
+  lu_byte ta, tb, tc;  /* types (with variant bits) of operands read */
+} TraceIns;
+
+
+/* one iteration of a hot loop */
+typedef struct Trace {
+  struct Trace *next;  /* next trace in 'g->traces' */
+  Proto *p;
+  CallInfo *ci;  /* frame running the loop (while recording) */
+  int startpc;  /* first instruction of the loop body */
+  int endpc;  /* backward jump that closes the loop */
+  int n;  /* number of instructions in 'ins' */
+  int size;  /* size of 'ins' */
+  int skipped;  /* instructions run by called functions (while recording) */
+  TraceIns *ins;
+} Trace;
+
+
+LUAI_FUNC void luaR_start (lua_State *L, CallInfo *ci, const Instruction *pc);
+LUAI_FUNC void luaR_record (lua_State *L);
+LUAI_FUNC void luaR_abort (lua_State *L);
+LUAI_FUNC void luaR_freeproto (lua_State *L, Proto *p);
+
+#endif
@@ -185,7 +185,11 @@ LUA_API const char     *(lua_typename) (lua_State *L, int tp);
 LUA_API lua_Number      (lua_tonumberx) (lua_State *L, int idx, int *isnum);
 LUA_API lua_Integer     (lua_tointegerx) (lua_State *L, int idx, int *isnum);
 LUA_API int             (lua_toboolean) (lua_State *L, int idx);
+/* may allocate (and run the collector) for numbers and string views */
 LUA_API const char     *(lua_tolstring) (lua_State *L, int idx, size_t *len);
+/* no ending zero; allocates only to convert numbers */
+LUA_API const char     *(lua_tolstringview) (lua_State *L, int idx,
+                                             size_t *len);
 LUA_API size_t          (lua_rawlen) (lua_State *L, int idx);
 LUA_API lua_CFunction   (lua_tocfunction) (lua_State *L, int idx);
 LUA_API void	       *(lua_touserdata) (lua_State *L, int idx);
@@ -229,6 +233,8 @@ LUA_API void        (lua_pushnil) (lua_State *L);
 LUA_API void        (lua_pushnumber) (lua_State *L, lua_Number n);
 LUA_API void        (lua_pushinteger) (lua_State *L, lua_Integer n);
 LUA_API const char *(lua_pushlstring) (lua_State *L, const char *s, size_t len);
+LUA_API const char *(lua_pushsubstring) (lua_State *L, int idx, size_t i,
+                                                         size_t l);
 LUA_API const char *(lua_pushstring) (lua_State *L, const char *s);
 LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
@@ -266,6 +272,7 @@ LUA_API void  (lua_seti) (lua_State *L, int idx, lua_Integer n);
 LUA_API void  (lua_rawset) (lua_State *L, int idx);
 LUA_API void  (lua_rawseti) (lua_State *L, int idx, lua_Integer n);
 LUA_API void  (lua_rawsetp) (lua_State *L, int idx, const void *p);
+LUA_API void  (lua_cleartable) (lua_State *L, int idx);
 LUA_API int   (lua_setmetatable) (lua_State *L, int objindex);
 LUA_API void  (lua_setuservalue) (lua_State *L, int idx);
 
@@ -312,6 +319,12 @@ LUA_API int (lua_isyieldable) (lua_State *L);
 #define LUA_GCSETPAUSE		6
 #define LUA_GCSETSTEPMUL	7
 #define LUA_GCISRUNNING		9
+#define LUA_GCGEN		10
+#define LUA_GCINC		11
+#define LUA_GCSTEPUS		12
+#define LUA_GCPARMARK		13
+#define LUA_GCBGSWEEP		14
+#define LUA_GCLIMIT		15
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
@@ -332,6 +345,9 @@ LUA_API size_t   (lua_stringtonumber) (lua_State *L, const char *s);
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
 
+LUA_API size_t    (lua_setmemlimit) (lua_State *L, size_t limit);
+LUA_API size_t    (lua_setallocsampling) (lua_State *L, size_t rate);
+
 
 
 /*
@@ -443,6 +459,12 @@ LUA_API lua_Hook (lua_gethook) (lua_State *L);
 LUA_API int (lua_gethookmask) (lua_State *L);
 LUA_API int (lua_gethookcount) (lua_State *L);
 
+LUA_API void (lua_gettraces) (lua_State *L);
+
+LUA_API int (lua_heapsnapshot) (lua_State *L, lua_Writer writer, void *data);
+LUA_API int (lua_dumpallocsamples) (lua_State *L, lua_Writer writer,
+                                    void *data, int reset);
+
 
 struct lua_Debug {
   int event;
@@ -322,7 +322,7 @@ static void PrintCode(const Proto* f)
     printf("%d",MYK(ax));
     break;
   }
-  switch (o)
+  switch (luaP_generic(o))	/* comments as for the generic forms */
   {
    case OP_LOADK:
     printf("\t; "); PrintConstant(f,bx);
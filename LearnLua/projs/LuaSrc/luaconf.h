@@ -36,6 +36,15 @@
 /* #define LUA_32BITS */
 
 
+/*
+@@ LUA_NANBOX packs each value in 64 bits instead of 128 (see lobject.h),
+** halving stack slots and array parts. Floats are 'double' and integers
+** have only 32 bits; light userdata and light C functions must fit in 48
+** bits (as in the user space of x86-64 and ARM64 systems).
+*/
+/* #define LUA_NANBOX */
+
+
 /*
 @@ LUA_USE_C89 controls the use of non-ISO-C89 features.
 ** Define it if you want Lua to avoid the use of a few C99 features
@@ -126,6 +135,13 @@
 #endif
 #define LUA_FLOAT_TYPE	LUA_FLOAT_FLOAT
 
+#elif defined(LUA_NANBOX)	/* }{ */
+/*
+** 32-bit integers and 'double' (the integer must fit in a NaN payload)
+*/
+#define LUA_INT_TYPE	LUA_INT_INT
+#define LUA_FLOAT_TYPE	LUA_FLOAT_DOUBLE
+
 #elif defined(LUA_C89_NUMBERS)	/* }{ */
 /*
 ** largest types available for C89 ('long' and 'double')
@@ -705,6 +721,57 @@
 #define luai_apicheck(l,e)	assert(e)
 #endif
 
+
+/*
+@@ LUA_USE_JIT compiles hot Lua functions to machine code (ljit.c).
+** It is only available on x86-64 with LUA_USE_POSIX.
+*/
+/* #define LUA_USE_JIT */
+
+/*
+@@ LUA_USE_PARMARK lets the collector mark in parallel, with helper
+** threads, in the atomic step and in full collections (lgcpar.c).
+** It needs LUA_USE_POSIX; helpers are started with LUA_GCPARMARK.
+*/
+/* #define LUA_USE_PARMARK */
+
+/*
+@@ LUA_USE_BGSWEEP lets a helper thread free the memory of the objects
+** the collector sweeps (lgcfree.c). It needs LUA_USE_POSIX and a thread
+** safe allocator; the helper is started with LUA_GCBGSWEEP.
+*/
+/* #define LUA_USE_BGSWEEP */
+
+/*
+@@ LUA_USE_FULLHASH hashes strings on all their bytes (lhash.c) instead
+** of sampling long ones, with SSE2/AVX2 or NEON kernels for long
+** strings. It needs C99.
+*/
+/* #define LUA_USE_FULLHASH */
+
+/*
+@@ LUA_USE_SHAPES stores tables whose keys are all short strings as
+** records: a shape (key layout) shared by similar tables plus a dense
+** vector of values (ltable.c). Other keys or too many keys turn them
+** back into plain hash tables.
+*/
+/* #define LUA_USE_SHAPES */
+
+/*
+@@ LUA_USE_SWISSTABLE lays out the hash part of tables as a "Swiss
+** table": open addressing probed in groups of 16 slots through a vector
+** of control bytes (with SSE2 when available) instead of chained
+** scatter (ltable.c).
+*/
+/* #define LUA_USE_SWISSTABLE */
+
+/*
+@@ LUA_USE_INCREHASH grows large hash parts incrementally (ltable.c):
+** running key counts size the new part without a recount, and the
+** entries of the old one move over during the insertions that follow.
+*/
+/* #define LUA_USE_INCREHASH */
+
 /* }================================================================== */
 
 
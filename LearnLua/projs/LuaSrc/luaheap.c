@@ -0,0 +1,644 @@
+/*
+** $Id: luaheap.c $
+** Lua heap snapshot analyzer (reads files written by debug.heapsnapshot)
+** See Copyright Notice in lua.h
+*/
+
+#define luaheap_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lgc.h"
+#include "lobject.h"
+#include "lsnapshot.h"
+
+#define PROGNAME	"luaheap"	/* default program name */
+#define NONE		((size_t)-1)
+#define MAXPATH		12		/* maximum number of steps in a path */
+
+static int listing=20;			/* number of objects to list */
+static const char* progname=PROGNAME;	/* actual program name */
+static const char* input=NULL;		/* snapshot file name */
+
+typedef struct HEdge
+{
+ size_t to;				/* id, then index of target */
+ int kind;
+ int ktype;
+ size_t kid;				/* key: id or label index */
+ lua_Integer ki;
+ double kn;
+} HEdge;
+
+typedef struct HNode
+{
+ size_t id;
+ int tt;
+ size_t size;
+ size_t len;				/* strings: full length */
+ char* str;				/* strings: contents (maybe cut) */
+ size_t source;				/* prototypes: id of source */
+ int line;				/* prototypes: line defined */
+ size_t edges,nedges;			/* its edges */
+ size_t po;				/* postorder number */
+ size_t parent,pedge;			/* in the depth-first tree */
+ size_t idom;				/* immediate dominator */
+ size_t retained;
+} HNode;
+
+static HNode* nodes=NULL;
+static size_t nnodes=0,sizenodes=0;
+static HEdge* edges=NULL;
+static size_t nedges=0,sizeedges=0;
+static char** labels=NULL;
+static size_t nlabels=0,sizelabels=0;
+static size_t* map=NULL;		/* hash of ids into node indices */
+static size_t sizemap=0;
+
+static void fatal(const char* message)
+{
+ fprintf(stderr,"%s: %s\n",progname,message);
+ exit(EXIT_FAILURE);
+}
+
+static void cannot(const char* what)
+{
+ fprintf(stderr,"%s: cannot %s %s: %s\n",progname,what,input,strerror(errno));
+ exit(EXIT_FAILURE);
+}
+
+static void usage(const char* message)
+{
+ if (*message=='-')
+  fprintf(stderr,"%s: unrecognized option '%s'\n",progname,message);
+ else
+  fprintf(stderr,"%s: %s\n",progname,message);
+ fprintf(stderr,
+  "usage: %s [options] snapshot\n"
+  "Available options are:\n"
+  "  -n count list 'count' objects with largest retained sizes (default 20)\n"
+  "  --       stop handling options\n"
+  ,progname);
+ exit(EXIT_FAILURE);
+}
+
+#define IS(s)	(strcmp(argv[i],s)==0)
+
+static void doargs(int argc, char* argv[])
+{
+ int i;
+ if (argv[0]!=NULL && *argv[0]!=0) progname=argv[0];
+ for (i=1; i<argc; i++)
+ {
+  if (*argv[i]!='-')			/* end of options; keep it */
+   break;
+  else if (IS("--"))			/* end of options; skip it */
+  {
+   ++i;
+   break;
+  }
+  else if (IS("-n"))			/* number of objects to list */
+  {
+   if (++i>=argc || !isdigit((unsigned char)*argv[i])) usage("'-n' needs a count");
+   listing=atoi(argv[i]);
+  }
+  else					/* unknown option */
+   usage(argv[i]);
+ }
+ if (i!=argc-1) usage("one snapshot file expected");
+ input=argv[i];
+}
+
+static void* grow(void* b, size_t* size, size_t n, size_t elem)
+{
+ if (n>=*size)
+ {
+  *size=(*size==0) ? 1024 : 2*(*size);
+  b=realloc(b,*size*elem);
+  if (b==NULL) fatal("not enough memory");
+ }
+ return b;
+}
+
+/*
+** {======================================================
+** Reading
+** =======================================================
+*/
+
+static const unsigned char* p;		/* reading position */
+static const unsigned char* pend;
+
+static int getbyte(void)
+{
+ if (p>=pend) fatal("truncated snapshot");
+ return *p++;
+}
+
+static size_t getvarint(void)
+{
+ size_t x=0;
+ int shift=0,b;
+ do
+ {
+  b=getbyte();
+  if (shift<(int)(8*sizeof(size_t))) x|=(size_t)(b&0x7f)<<shift;
+  shift+=7;
+ } while (b&0x80);
+ return x;
+}
+
+static void getblock(void* b, size_t n)
+{
+ if ((size_t)(pend-p)<n) fatal("truncated snapshot");
+ memcpy(b,p,n);
+ p+=n;
+}
+
+static char* getstring(size_t n)
+{
+ char* s=malloc(n+1);
+ if (s==NULL) fatal("not enough memory");
+ getblock(s,n);
+ s[n]=0;
+ return s;
+}
+
+static void getnode(void)
+{
+ HNode* n;
+ nodes=grow(nodes,&sizenodes,nnodes,sizeof(HNode));
+ n=&nodes[nnodes++];
+ memset(n,0,sizeof(HNode));
+ n->id=getvarint();
+ n->tt=getbyte();
+ n->size=getvarint();
+ n->edges=nedges;
+ n->source=0;
+ if (n->tt==LUA_TSHRSTR || n->tt==LUA_TLNGSTR)
+ {
+  n->len=getvarint();
+  n->str=getstring((n->len<SNAPSTRMAX) ? n->len : SNAPSTRMAX);
+ }
+ else if (n->tt==LUA_TPROTO)
+ {
+  n->source=getvarint();
+  n->line=(int)getvarint();
+ }
+}
+
+static void getedge(void)
+{
+ HEdge* e;
+ if (nnodes==0) fatal("bad snapshot (edge without node)");
+ edges=grow(edges,&sizeedges,nedges,sizeof(HEdge));
+ e=&edges[nedges++];
+ e->kind=getbyte();
+ e->ktype=getbyte();
+ switch (e->ktype)
+ {
+  case SNAP_KNONE: break;
+  case SNAP_KOBJ: case SNAP_KPTR: e->kid=getvarint(); break;
+  case SNAP_KINT:
+  {
+   size_t u=getvarint();
+   e->ki=(lua_Integer)((u>>1)^(0-(u&1)));
+   break;
+  }
+  case SNAP_KFLT: getblock(&e->kn,sizeof(e->kn)); break;
+  case SNAP_KBOOL: e->ki=getbyte(); break;
+  case SNAP_KLABEL:
+  {
+   size_t n=getvarint();
+   labels=grow(labels,&sizelabels,nlabels,sizeof(char*));
+   labels[nlabels]=getstring(n);
+   e->kid=nlabels++;
+   break;
+  }
+  default: fatal("bad snapshot (unknown key)");
+ }
+ e->to=getvarint();
+ nodes[nnodes-1].nedges++;
+}
+
+static void readsnapshot(void)
+{
+ FILE* f=fopen(input,"rb");
+ unsigned char* b;
+ long n;
+ if (f==NULL) cannot("open");
+ if (fseek(f,0,SEEK_END)!=0 || (n=ftell(f))<0 || fseek(f,0,SEEK_SET)!=0) cannot("read");
+ b=malloc(n+1);
+ if (b==NULL) fatal("not enough memory");
+ if (fread(b,1,n,f)!=(size_t)n) cannot("read");
+ fclose(f);
+ p=b; pend=b+n;
+ if (n<5 || memcmp(p,LUA_SNAPSIGNATURE,4)!=0) fatal("not a heap snapshot");
+ p+=4;
+ if (getbyte()!=LUA_SNAPVERSION) fatal("snapshot version mismatch");
+ for (;;)
+ {
+  int c=getbyte();
+  if (c==SNAP_NODE) getnode();
+  else if (c==SNAP_EDGE) getedge();
+  else if (c==SNAP_END)
+  {
+   if (getvarint()+1!=nnodes) fatal("bad snapshot (wrong number of nodes)");
+   break;
+  }
+  else fatal("bad snapshot (unknown record)");
+ }
+ free(b);
+}
+
+/* }====================================================== */
+
+/*
+** {======================================================
+** Analysis
+** =======================================================
+*/
+
+static size_t hashid(size_t id)
+{
+ return (id>>4)*2654435761u;
+}
+
+static void buildmap(void)
+{
+ size_t i;
+ for (sizemap=1024; sizemap<2*nnodes; sizemap*=2) ;
+ map=malloc(sizemap*sizeof(size_t));
+ if (map==NULL) fatal("not enough memory");
+ for (i=0; i<sizemap; i++) map[i]=NONE;
+ for (i=0; i<nnodes; i++)
+ {
+  size_t h=hashid(nodes[i].id)&(sizemap-1);
+  while (map[h]!=NONE) h=(h+1)&(sizemap-1);
+  map[h]=i;
+ }
+}
+
+static size_t findid(size_t id)
+{
+ size_t h=hashid(id)&(sizemap-1);
+ while (map[h]!=NONE)
+ {
+  if (nodes[map[h]].id==id) return map[h];
+  h=(h+1)&(sizemap-1);
+ }
+ return NONE;
+}
+
+#define strong(e)	(((e)->kind&LUAC_RWEAK)==0 && (e)->to!=NONE)
+
+static size_t* order;			/* nodes in postorder */
+static size_t norder=0;
+
+/* iterative depth-first search from the root over strong edges */
+static void search(void)
+{
+ size_t* stack=malloc(nnodes*sizeof(size_t));
+ size_t* next=malloc(nnodes*sizeof(size_t));	/* next edge to follow */
+ size_t top=0,i;
+ order=malloc(nnodes*sizeof(size_t));
+ if (stack==NULL || next==NULL || order==NULL) fatal("not enough memory");
+ for (i=0; i<nnodes; i++)
+ {
+  nodes[i].po=NONE; nodes[i].parent=NONE; nodes[i].idom=NONE;
+  next[i]=0;
+ }
+ stack[top++]=0;
+ nodes[0].parent=0;
+ while (top>0)
+ {
+  size_t v=stack[top-1];
+  HNode* n=&nodes[v];
+  if (next[v]<n->nedges)
+  {
+   size_t ei=n->edges+next[v]++;
+   HEdge* e=&edges[ei];
+   if (strong(e) && nodes[e->to].parent==NONE)
+   {
+    nodes[e->to].parent=v;
+    nodes[e->to].pedge=ei;
+    stack[top++]=e->to;
+   }
+  }
+  else
+  {
+   n->po=norder;
+   order[norder++]=v;
+   top--;
+  }
+ }
+ free(stack);
+ free(next);
+}
+
+static size_t intersect(size_t a, size_t b)
+{
+ while (a!=b)
+ {
+  while (nodes[a].po<nodes[b].po) a=nodes[a].idom;
+  while (nodes[b].po<nodes[a].po) b=nodes[b].idom;
+ }
+ return a;
+}
+
+/* dominators by the iterative algorithm of Cooper, Harvey and Kennedy */
+static void dominators(void)
+{
+ size_t* npreds=calloc(nnodes+1,sizeof(size_t));
+ size_t* preds;
+ size_t i,j;
+ int changed;
+ if (npreds==NULL) fatal("not enough memory");
+ for (i=0; i<nedges; i++)
+  if (strong(&edges[i])) npreds[edges[i].to+1]++;
+ for (i=0; i<nnodes; i++) npreds[i+1]+=npreds[i];
+ preds=malloc((npreds[nnodes]+1)*sizeof(size_t));
+ if (preds==NULL) fatal("not enough memory");
+ for (i=0; i<nnodes; i++)
+ {
+  HNode* n=&nodes[i];
+  for (j=n->edges; j<n->edges+n->nedges; j++)
+   if (strong(&edges[j])) preds[npreds[edges[j].to]++]=i;
+ }
+ for (i=nnodes; i>0; i--) npreds[i]=npreds[i-1];	/* restore starts */
+ npreds[0]=0;
+ nodes[0].idom=0;
+ do
+ {
+  changed=0;
+  for (i=norder-1; i-->0; )		/* reverse postorder, skipping root */
+  {
+   size_t v=order[i],nidom=NONE;
+   for (j=npreds[v]; j<npreds[v+1]; j++)
+   {
+    size_t u=preds[j];
+    if (nodes[u].idom==NONE) continue;	/* not processed yet */
+    nidom=(nidom==NONE) ? u : intersect(u,nidom);
+   }
+   if (nodes[v].idom!=nidom)
+   {
+    nodes[v].idom=nidom;
+    changed=1;
+   }
+  }
+ } while (changed);
+ for (i=0; i<nnodes; i++) nodes[i].retained=nodes[i].size;
+ for (i=0; i+1<norder; i++)		/* children before their dominators */
+ {
+  size_t v=order[i];
+  nodes[nodes[v].idom].retained+=nodes[v].retained;
+ }
+ free(npreds);
+ free(preds);
+}
+
+static void analyze(void)
+{
+ size_t i;
+ if (nnodes==0 || nodes[0].tt!=SNAP_TROOT) fatal("bad snapshot (no root)");
+ buildmap();
+ for (i=0; i<nedges; i++) edges[i].to=findid(edges[i].to);
+ search();
+ dominators();
+}
+
+/* }====================================================== */
+
+/*
+** {======================================================
+** Printing
+** =======================================================
+*/
+
+static const char* typename(int tt)
+{
+ switch (tt)
+ {
+  case LUA_TSHRSTR: case LUA_TLNGSTR: return "string";
+  case LUA_TTABLE: return "table";
+  case LUA_TLCL: return "function";
+  case LUA_TCCL: return "C function";
+  case LUA_TUSERDATA: return "userdata";
+  case LUA_TTHREAD: return "thread";
+  case LUA_TPROTO: return "proto";
+  case SNAP_TROOT: return "root";
+  default: return "?";
+ }
+}
+
+static void printstring(const char* s, size_t n)
+{
+ size_t i;
+ for (i=0; i<n; i++)
+ {
+  int c=(unsigned char)s[i];
+  if (c=='"' || c=='\\') printf("\\%c",c);
+  else if (isprint(c)) putchar(c);
+  else printf("\\%03d",c);
+ }
+}
+
+static void printsource(size_t proto)
+{
+ size_t s=(proto==NONE) ? NONE : findid(nodes[proto].source);
+ if (s==NONE)
+  printf("?");
+ else
+ {
+  const char* src=nodes[s].str;
+  size_t n=strlen(src);
+  if (*src=='@' || *src=='=') { src++; n--; }
+  printstring(src,n);
+ }
+ if (proto!=NONE) printf(":%d",nodes[proto].line);
+}
+
+static size_t protoof(size_t v)
+{
+ HNode* n=&nodes[v];
+ size_t j;
+ for (j=n->edges; j<n->edges+n->nedges; j++)
+  if (edges[j].kind==LUAC_RPROTO && edges[j].to!=NONE) return edges[j].to;
+ return NONE;
+}
+
+static void printobject(size_t v)
+{
+ HNode* n=&nodes[v];
+ printf("%s",typename(n->tt));
+ if (n->tt==LUA_TSHRSTR || n->tt==LUA_TLNGSTR)
+ {
+  printf(" \"");
+  printstring(n->str,(n->len<SNAPSTRMAX) ? n->len : SNAPSTRMAX);
+  printf((n->len>SNAPSTRMAX) ? "...\"" : "\"");
+ }
+ else if (n->tt==LUA_TLCL)
+ {
+  printf(" <");
+  printsource(protoof(v));
+  printf(">");
+ }
+ else if (n->tt==LUA_TPROTO)
+ {
+  printf(" <");
+  printsource(v);
+  printf(">");
+ }
+}
+
+static int isname(const char* s, size_t n)
+{
+ size_t i;
+ if (n==0 || isdigit((unsigned char)s[0])) return 0;
+ for (i=0; i<n; i++)
+  if (!isalnum((unsigned char)s[i]) && s[i]!='_') return 0;
+ return 1;
+}
+
+static void printkey(const HEdge* e)
+{
+ switch (e->ktype)
+ {
+  case SNAP_KOBJ:
+  {
+   size_t k=findid(e->kid);
+   HNode* n=(k==NONE) ? NULL : &nodes[k];
+   if (n!=NULL && (n->tt==LUA_TSHRSTR || n->tt==LUA_TLNGSTR))
+   {
+    if (n->len<=SNAPSTRMAX && isname(n->str,n->len))
+     printf(".%s",n->str);
+    else
+    {
+     printf("[\"");
+     printstring(n->str,(n->len<SNAPSTRMAX) ? n->len : SNAPSTRMAX);
+     printf((n->len>SNAPSTRMAX) ? "...\"]" : "\"]");
+    }
+   }
+   else
+    printf("[%s]",(n==NULL) ? "?" : typename(n->tt));
+   break;
+  }
+  case SNAP_KINT: printf("[" LUA_INTEGER_FMT "]",(LUAI_UACINT)e->ki); break;
+  case SNAP_KFLT: printf("[%g]",e->kn); break;
+  case SNAP_KBOOL: printf("[%s]",e->ki ? "true" : "false"); break;
+  case SNAP_KPTR: printf("[%p]",(void*)e->kid); break;
+  case SNAP_KLABEL: printf("%s",labels[e->kid]); break;
+  default: break;
+ }
+}
+
+static void printedge(const HEdge* e)
+{
+ switch (e->kind&~LUAC_RWEAK)
+ {
+  case LUAC_RVALUE: case SNAP_RROOT: printkey(e); break;
+  case LUAC_RKEY: printf(".<key>"); break;
+  case LUAC_RMETA: printf(".<metatable>"); break;
+  case LUAC_RUPVAL: printf(".<upvalue "); printkey(e); printf(">"); break;
+  case LUAC_RUSER: printf(".<uservalue>"); break;
+  case LUAC_RPROTO: printf(".<proto>"); break;
+  case LUAC_RCONST: printf(".<constant "); printkey(e); printf(">"); break;
+  case LUAC_RSTACK: printf(".<stack "); printkey(e); printf(">"); break;
+  case LUAC_RNAME: printf(".<name>"); break;
+  case LUAC_RCACHE: printf(".<cache>"); break;
+  case LUAC_RPARENT: printf(".<parent>"); break;
+  default: printf(".?"); break;
+ }
+}
+
+/* print the path to 'v' in the depth-first tree */
+static void printpath(size_t v)
+{
+ size_t path[MAXPATH];
+ int n=0,i;
+ for (; v!=0 && n<MAXPATH; v=nodes[v].parent) path[n++]=nodes[v].pedge;
+ if (v!=0) printf("...");
+ for (i=n-1; i>=0; i--)
+ {
+  const HEdge* e=&edges[path[i]];
+  if (i==n-1 && v==0 && e->kind==SNAP_RROOT && n>1 &&
+      strcmp(labels[e->kid],"registry")==0 &&
+      edges[path[i-1]].ktype==SNAP_KINT && edges[path[i-1]].ki==LUA_RIDX_GLOBALS)
+  {
+   printf("_G");			/* registry[LUA_RIDX_GLOBALS] */
+   i--;
+  }
+  else
+   printedge(e);
+ }
+}
+
+static int byretained(const void* a, const void* b)
+{
+ size_t ra=nodes[*(const size_t*)a].retained,rb=nodes[*(const size_t*)b].retained;
+ return (ra<rb) ? 1 : (ra>rb) ? -1 : 0;
+}
+
+static void report(void)
+{
+ static const int types[]={LUA_TTABLE,LUA_TSHRSTR,LUA_TLNGSTR,LUA_TLCL,
+  LUA_TCCL,LUA_TPROTO,LUA_TUSERDATA,LUA_TTHREAD};
+ size_t total=0,reached=0,i;
+ size_t* top;
+ size_t ntop=0;
+ unsigned t;
+ for (i=1; i<nnodes; i++)
+ {
+  total+=nodes[i].size;
+  if (nodes[i].idom!=NONE) reached++;
+ }
+ printf("%lu objects, %lu bytes; %lu not strongly reachable\n",
+  (unsigned long)(nnodes-1),(unsigned long)total,(unsigned long)(nnodes-1-reached));
+ printf("\n%-12s %10s %12s\n","type","count","bytes");
+ for (t=0; t<sizeof(types)/sizeof(types[0]); t++)
+ {
+  size_t count=0,bytes=0;
+  for (i=1; i<nnodes; i++)
+   if (nodes[i].tt==types[t]) { count++; bytes+=nodes[i].size; }
+  if (count>0)
+   printf("%-12s %10lu %12lu\n",
+    (types[t]==LUA_TLNGSTR) ? "long string" : typename(types[t]),
+    (unsigned long)count,(unsigned long)bytes);
+ }
+ top=malloc(nnodes*sizeof(size_t));
+ if (top==NULL) fatal("not enough memory");
+ for (i=1; i<nnodes; i++)
+  if (nodes[i].idom!=NONE) top[ntop++]=i;
+ qsort(top,ntop,sizeof(size_t),byretained);
+ printf("\n%12s %10s  %s\n","retained","size","object / path");
+ for (i=0; i<ntop && i<(size_t)listing; i++)
+ {
+  size_t v=top[i];
+  printf("%12lu %10lu  ",(unsigned long)nodes[v].retained,(unsigned long)nodes[v].size);
+  printobject(v);
+  printf("\n%24s","");
+  printpath(v);
+  printf("\n");
+ }
+ free(top);
+}
+
+/* }====================================================== */
+
+int main(int argc, char* argv[])
+{
+ doargs(argc,argv);
+ readsnapshot();
+ analyze();
+ report();
+ return EXIT_SUCCESS;
+}
@@ -18,16 +18,19 @@
 
 #include "lua.h"
 
+#include "lctype.h"
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "ltrace.h"
 #include "lvm.h"
 
 
@@ -35,6 +38,21 @@
 #define MAXTAGLOOP	2000
 
 
+/*
+** By default, use jump tables in the main interpreter loop on gcc
+** and compatible compilers (each opcode then ends with its own
+** indirect branch). Compile with LUA_USE_JUMPTABLE=0 to get the
+** portable 'switch' dispatch (always used by other compilers).
+*/
+#if !defined(LUA_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define LUA_USE_JUMPTABLE	1
+#else
+#define LUA_USE_JUMPTABLE	0
+#endif
+#endif
+
+
 
 /*
 ** 'l_intfitsf' checks whether a given integer can be converted to a
@@ -65,6 +83,41 @@
 
 
 
+/*
+** 'luaO_str2num' of a string value. A view with no copy of its own has
+** no ending zero, so its contents (without surrounding spaces) are
+** copied to a buffer first: a local one for usual numerals, a
+** temporary one from 'malloc' for longer ones (there is no state here
+** to use its allocator). The parent string is shared and must not be
+** changed.
+*/
+static size_t l_str2num (const TValue *obj, TValue *result) {
+  TString *ts = tsvalue(obj);
+  if (isstrview(ts) && strview(ts)->cstr == NULL) {
+    char sbuff[L_MAXLENNUM + 1];
+    char *buff = sbuff;
+    const char *s = strview(ts)->data;
+    size_t l = ts->u.lnglen;
+    size_t sz;
+    while (l > 0 && lisspace(cast_uchar(*s))) { s++; l--; }
+    while (l > 0 && lisspace(cast_uchar(s[l - 1]))) l--;
+    if (l > L_MAXLENNUM) {  /* too long for the local buffer? */
+      buff = (char *)malloc((l + 1) * sizeof(char));
+      if (buff == NULL)
+        return 0;  /* cannot convert it */
+    }
+    memcpy(buff, s, l * sizeof(char));
+    buff[l] = '\0';
+    sz = luaO_str2num(buff, result);
+    if (buff != sbuff)
+      free(buff);
+    return (sz == l + 1) ? ts->u.lnglen + 1 : 0;
+  }
+  return luaO_str2num(isstrview(ts) ? strview(ts)->cstr : getstr(ts),
+                      result);
+}
+
+
 /*
 ** Try to convert a value to a float. The float case is already handled
 ** by the macro 'tonumber'.
@@ -77,7 +130,7 @@ int luaV_tonumber_ (const TValue *obj, lua_Number *n) {
     return 1;
   }
   else if (cvt2num(obj) &&  /* string convertible to number?, 判断obj是不是string */
-            luaO_str2num(svalue(obj), &v) == vslen(obj) + 1) {//解析字符串,转为数值(integer或float)
+            l_str2num(obj, &v) == vslen(obj) + 1) {//解析字符串,转为数值(integer或float)
     *n = nvalue(&v);  /* convert result of 'luaO_str2num' to a float */
     return 1;
   }
@@ -111,7 +164,7 @@ int luaV_tointeger (const TValue *obj, lua_Integer *p, int mode) {
     return 1;
   }
   else if (cvt2num(obj) &&
-            luaO_str2num(svalue(obj), &v) == vslen(obj) + 1) {
+            l_str2num(obj, &v) == vslen(obj) + 1) {
     obj = &v;
     goto again;  /* convert result from 'luaO_str2num' to an integer */
   }
@@ -134,8 +187,8 @@ int luaV_tointeger (const TValue *obj, lua_Integer *p, int mode) {
 ** the extreme case when the initial value is LUA_MININTEGER, in which
 ** case the LUA_MININTEGER limit would still run the loop once.
 */
-static int forlimit (const TValue *obj, lua_Integer *p, lua_Integer step,
-                     int *stopnow) {
+int luaV_forlimit (const TValue *obj, lua_Integer *p, lua_Integer step,
+                   int *stopnow) {
   *stopnow = 0;  /* usually, let loops run */
   if (!luaV_tointeger(obj, p, (step < 0 ? 2 : 1))) {  /* not fit in integer? */
     lua_Number n;  /* try to convert to float */
@@ -256,12 +309,12 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key, StkId val, cons
 ** -larger than zero if 'ls' is smaller-equal-larger than 'rs'.
 ** The code is a little tricky because it allows '\0' in the strings
 ** and it uses 'strcoll' (to respect locales) for each segments
-** of the strings.
+** of the strings. (So views need their zero-terminated copies.)
 */
-static int l_strcmp (const TString *ls, const TString *rs) {
-  const char *l = getstr(ls);
+static int l_strcmp (lua_State *L, TString *ls, TString *rs) {
+  const char *l = luaS_cstr(L, ls);
   size_t ll = tsslen(ls);
-  const char *r = getstr(rs);
+  const char *r = luaS_cstr(L, rs);
   size_t lr = tsslen(rs);
   for (;;) {  /* for each segment */
     int temp = strcoll(l, r);
@@ -379,7 +432,7 @@ int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
   if (ttisnumber(l) && ttisnumber(r))  /* both operands are numbers? */
     return LTnum(l, r);
   else if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) < 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) < 0;
   else if ((res = luaT_callorderTM(L, l, r, TM_LT)) < 0)  /* no metamethod? */
     luaG_ordererror(L, l, r);  /* error */
   return res;
@@ -399,7 +452,7 @@ int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r) {
   if (ttisnumber(l) && ttisnumber(r))  /* both operands are numbers? */
     return LEnum(l, r);
   else if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) <= 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) <= 0;
   else if ((res = luaT_callorderTM(L, l, r, TM_LE)) >= 0)  /* try 'le' */
     return res;
   else {  /* try 'lt': */
@@ -674,7 +727,7 @@ void luaV_finishOp (lua_State *L) {
   CallInfo *ci = L->ci;
   StkId base = ci->u.l.base;
   Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
-  OpCode op = GET_OPCODE(inst);
+  OpCode op = luaP_generic(GET_OPCODE(inst));
   switch (op) {  /* finish its execution */
     case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_IDIV:
     case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
@@ -751,9 +804,21 @@ void luaV_finishOp (lua_State *L) {
 	ISK(GETARG_C(i)) ? k+INDEXK(GETARG_C(i)) : base+GETARG_C(i))
 
 
+/*
+** count an iteration of the loop closed by the backward jump at 'pc'
+** (its inline-cache slot is free, so it holds the counter) and record
+** the loop when it gets hot
+*/
+#define hotloop(ci,pc) \
+  { FieldCache *hc = &cl->p->ic[(pc) - cl->p->code]; \
+    if (hc->idx < LUAI_HOTLOOP && ++hc->idx == LUAI_HOTLOOP) \
+      luaR_start(L, ci, pc); }
+
+
 /* execute a jump instruction */
 #define dojump(ci,i,e) \
   { int a = GETARG_A(i); \
+    if (GETARG_sBx(i) < 0) hotloop(ci, (ci)->u.l.savedpc - 1 + e); \
     if (a != 0) luaF_close(L, ci->u.l.base + a - 1); \
     ci->u.l.savedpc += GETARG_sBx(i) + e; }
 
@@ -772,7 +837,7 @@ void luaV_finishOp (lua_State *L) {
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
   i = *(ci->u.l.savedpc++); \
-  if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) \
+  if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT | MASKREC)) \
     Protect(luaG_traceexec(L)); \
   ra = RA(i); /* WARNING: any stack reallocation invalidates 'ra' */ \
   lua_assert(base == ci->u.l.base); \
@@ -784,12 +849,56 @@ void luaV_finishOp (lua_State *L) {
 #define vmbreak		break
 
 
+/*
+** rewrite the instruction being executed with opcode 'o' (quickening;
+** the generic and quickened forms share the same arguments)
+*/
+#define quicken(ci,o)  \
+	SET_OPCODE(*cast(Instruction *, (ci)->u.l.savedpc - 1), o)
+
+/* quicken a comparison whose operands are both integers or both floats */
+#define quickencmp(ci,rb,rc,oi,of) { \
+  if (ttisinteger(rb) && ttisinteger(rc)) quicken(ci, oi); \
+  else if (ttisfloat(rb) && ttisfloat(rc)) quicken(ci, of); }
+
+
+/*
+** after a superinstruction, run the next instruction (with opcode 'o')
+** in the same dispatch, going to label 'lbl' of its case; when a hook
+** is set, the next instruction goes through 'vmfetch' as usual
+*/
+#define dofused(o,lbl) { \
+  if (L->hookmask) { vmbreak; } \
+  i = *(ci->u.l.savedpc++); \
+  ra = RA(i); \
+  lua_assert(GET_OPCODE(i) == o); \
+  goto lbl; }
+
+
+/* raw equality with a nil, boolean or short-string constant (OP_EQK) */
+#define eqk(v,kc)	(ttype(v) == ttype(kc) && (ttisnil(kc) || \
+	(ttisboolean(kc) ? bvalue(v) == bvalue(kc) \
+	                 : eqshrstr(tsvalue(v), tsvalue(kc)))))
+
+
+/* inline cache of the instruction being executed */
+#define fieldcache(ci,cl) \
+	(&(cl)->p->ic[(ci)->u.l.savedpc - (cl)->p->code - 1])
+
+
 /*
 ** copy of 'luaV_gettable', but protecting the call to potential
-** metamethod (which can reallocate the stack)
+** metamethod (which can reallocate the stack). Used by instructions
+** with an RK(C) key: constant short-string keys are looked up through
+** the instruction's inline cache.
 */
 #define gettableProtected(L,t,k,v)  { const TValue *slot; \
-  if (luaV_fastget(L,t,k,slot,luaH_get)) { setobj2s(L, v, slot); } \
+  if (!ttistable(t)) slot = NULL; \
+  else if (ISK(GETARG_C(i)) && ttisshrstring(k)) \
+    slot = luaH_getshortstrcached(hvalue(t), tsvalue(k), \
+                                  fieldcache(ci, cl)); \
+  else slot = luaH_get(hvalue(t), k); \
+  if (slot != NULL && !ttisnil(slot)) { setobj2s(L, v, slot); } \
   else Protect(luaV_finishget(L,t,k,v,slot)); }
 
 
@@ -805,12 +914,27 @@ void luaV_execute (lua_State *L) {
   LClosure *cl;
   TValue *k;
   StkId base;
+#if LUA_USE_JUMPTABLE
+#include "ljumptab.h"
+#endif
   ci->callstatus |= CIST_FRESH;  /* fresh invocation of 'luaV_execute" */
  newframe:  /* reentry point when frame changes (call/return) */
   lua_assert(ci == L->ci);
   cl = clLvalue(ci->func);  /* local reference to function's closure */
   k = cl->p->k;  /* local reference to function's constant table */
   base = ci->u.l.base;  /* local copy of function's base */
+#if defined(LUA_USE_JIT)
+  if (cl->p->jit != NULL && !L->hookmask) {  /* run compiled code? */
+    int status = luaJ_run(L, ci);
+    if (status == LUAJ_RETURN && (ci->callstatus & CIST_FRESH))
+      return;  /* external invocation: return */
+    else if (status != LUAJ_EXIT) {  /* called or returned to Lua code */
+      ci = L->ci;
+      goto newframe;  /* restart over the new frame */
+    }
+    base = ci->u.l.base;  /* continue interpreting at 'savedpc' */
+  }
+#endif
   /* main loop of interpreter */
   for (;;) {
     Instruction i;
@@ -822,7 +946,9 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_LOADK) {
-        TValue *rb = k + GETARG_Bx(i);
+        TValue *rb;
+       l_loadk:
+        rb = k + GETARG_Bx(i);
         setobj2s(L, ra, rb);
         vmbreak;
       }
@@ -857,8 +983,10 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
-        StkId rb = RB(i);
-        TValue *rc = RKC(i);
+        StkId rb; TValue *rc;
+       l_gettable:
+        rb = RB(i);
+        rc = RKC(i);
         gettableProtected(L, rb, rc, ra);
         vmbreak;
       }
@@ -892,55 +1020,62 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_SELF) {
-        const TValue *aux;
         StkId rb = RB(i);
-        TValue *rc = RKC(i);
-        TString *key = tsvalue(rc);  /* key must be a string */
+        TValue *rc = RKC(i);  /* key must be a string */
         setobjs2s(L, ra + 1, rb);
-        if (luaV_fastget(L, rb, key, aux, luaH_getstr)) {
-          setobj2s(L, ra, aux);
-        }
-        else Protect(luaV_finishget(L, rb, rc, ra, aux));
+        gettableProtected(L, rb, rc, ra);
         vmbreak;
       }
       vmcase(OP_ADD) {
-        TValue *rb = RKB(i);
-        TValue *rc = RKC(i);
+        TValue *rb; TValue *rc;
         lua_Number nb; lua_Number nc;
+       l_add:
+        rb = RKB(i);
+        rc = RKC(i);
         if (ttisinteger(rb) && ttisinteger(rc)) {
           lua_Integer ib = ivalue(rb); lua_Integer ic = ivalue(rc);
           setivalue(ra, intop(+, ib, ic));
+          quicken(ci, OP_ADDII);
         }
         else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
           setfltvalue(ra, luai_numadd(L, nb, nc));
+          if (ttisfloat(rb) && ttisfloat(rc)) quicken(ci, OP_ADDFF);
         }
         else { Protect(luaT_trybinTM(L, rb, rc, ra, TM_ADD)); }
         vmbreak;
       }
       vmcase(OP_SUB) {
-        TValue *rb = RKB(i);
-        TValue *rc = RKC(i);
+        TValue *rb; TValue *rc;
         lua_Number nb; lua_Number nc;
+       l_sub:
+        rb = RKB(i);
+        rc = RKC(i);
         if (ttisinteger(rb) && ttisinteger(rc)) {
           lua_Integer ib = ivalue(rb); lua_Integer ic = ivalue(rc);
           setivalue(ra, intop(-, ib, ic));
+          quicken(ci, OP_SUBII);
         }
         else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
           setfltvalue(ra, luai_numsub(L, nb, nc));
+          if (ttisfloat(rb) && ttisfloat(rc)) quicken(ci, OP_SUBFF);
         }
         else { Protect(luaT_trybinTM(L, rb, rc, ra, TM_SUB)); }
         vmbreak;
       }
       vmcase(OP_MUL) {
-        TValue *rb = RKB(i);
-        TValue *rc = RKC(i);
+        TValue *rb; TValue *rc;
         lua_Number nb; lua_Number nc;
+       l_mul:
+        rb = RKB(i);
+        rc = RKC(i);
         if (ttisinteger(rb) && ttisinteger(rc)) {
           lua_Integer ib = ivalue(rb); lua_Integer ic = ivalue(rc);
           setivalue(ra, intop(*, ib, ic));
+          quicken(ci, OP_MULII);
         }
         else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
           setfltvalue(ra, luai_nummul(L, nb, nc));
+          if (ttisfloat(rb) && ttisfloat(rc)) quicken(ci, OP_MULFF);
         }
         else { Protect(luaT_trybinTM(L, rb, rc, ra, TM_MUL)); }
         vmbreak;
@@ -1099,8 +1234,11 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_EQ) {
-        TValue *rb = RKB(i);
-        TValue *rc = RKC(i);
+        TValue *rb; TValue *rc;
+       l_eq:
+        rb = RKB(i);
+        rc = RKC(i);
+        quickencmp(ci, rb, rc, OP_EQII, OP_EQFF);
         Protect(
           if (luaV_equalobj(L, rb, rc) != GETARG_A(i))
             ci->u.l.savedpc++;
@@ -1110,8 +1248,13 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_LT) {
+        TValue *rb; TValue *rc;
+       l_lt:
+        rb = RKB(i);
+        rc = RKC(i);
+        quickencmp(ci, rb, rc, OP_LTII, OP_LTFF);
         Protect(
-          if (luaV_lessthan(L, RKB(i), RKC(i)) != GETARG_A(i))
+          if (luaV_lessthan(L, rb, rc) != GETARG_A(i))
             ci->u.l.savedpc++;
           else
             donextjump(ci);
@@ -1119,8 +1262,13 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_LE) {
+        TValue *rb; TValue *rc;
+       l_le:
+        rb = RKB(i);
+        rc = RKC(i);
+        quickencmp(ci, rb, rc, OP_LEII, OP_LEFF);
         Protect(
-          if (luaV_lessequal(L, RKB(i), RKC(i)) != GETARG_A(i))
+          if (luaV_lessequal(L, rb, rc) != GETARG_A(i))
             ci->u.l.savedpc++;
           else
             donextjump(ci);
@@ -1210,6 +1358,7 @@ void luaV_execute (lua_State *L) {
           lua_Integer idx = intop(+, ivalue(ra), step); /* increment index */
           lua_Integer limit = ivalue(ra + 1);
           if ((0 < step) ? (idx <= limit) : (limit <= idx)) {
+            hotloop(ci, ci->u.l.savedpc - 1);
             ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
             chgivalue(ra, idx);  /* update internal index... */
             setivalue(ra + 3, idx);  /* ...and external index */
@@ -1221,6 +1370,7 @@ void luaV_execute (lua_State *L) {
           lua_Number limit = fltvalue(ra + 1);
           if (luai_numlt(0, step) ? luai_numle(idx, limit)
                                   : luai_numle(limit, idx)) {
+            hotloop(ci, ci->u.l.savedpc - 1);
             ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
             chgfltvalue(ra, idx);  /* update internal index... */
             setfltvalue(ra + 3, idx);  /* ...and external index */
@@ -1235,7 +1385,7 @@ void luaV_execute (lua_State *L) {
         lua_Integer ilimit;
         int stopnow;
         if (ttisinteger(init) && ttisinteger(pstep) &&
-            forlimit(plimit, &ilimit, ivalue(pstep), &stopnow)) {
+            luaV_forlimit(plimit, &ilimit, ivalue(pstep), &stopnow)) {
           /* all values are integer */
           lua_Integer initv = (stopnow ? 0 : ivalue(init));
           setivalue(plimit, ilimit);
@@ -1273,6 +1423,7 @@ void luaV_execute (lua_State *L) {
         l_tforloop:
         if (!ttisnil(ra + 1)) {  /* continue loop? */
           setobjs2s(L, ra, ra + 1);  /* save control variable */
+          hotloop(ci, ci->u.l.savedpc - 1);
            ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
         }
         vmbreak;
@@ -1331,6 +1482,157 @@ void luaV_execute (lua_State *L) {
         lua_assert(0);
         vmbreak;
       }
+      vmcase(OP_ADDII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          setivalue(ra, intop(+, ivalue(rb), ivalue(rc)));
+        }
+        else { quicken(ci, OP_ADD); goto l_add; }
+        vmbreak;
+      }
+      vmcase(OP_ADDFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          setfltvalue(ra, luai_numadd(L, fltvalue(rb), fltvalue(rc)));
+        }
+        else { quicken(ci, OP_ADD); goto l_add; }
+        vmbreak;
+      }
+      vmcase(OP_SUBII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          setivalue(ra, intop(-, ivalue(rb), ivalue(rc)));
+        }
+        else { quicken(ci, OP_SUB); goto l_sub; }
+        vmbreak;
+      }
+      vmcase(OP_SUBFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          setfltvalue(ra, luai_numsub(L, fltvalue(rb), fltvalue(rc)));
+        }
+        else { quicken(ci, OP_SUB); goto l_sub; }
+        vmbreak;
+      }
+      vmcase(OP_MULII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          setivalue(ra, intop(*, ivalue(rb), ivalue(rc)));
+        }
+        else { quicken(ci, OP_MUL); goto l_mul; }
+        vmbreak;
+      }
+      vmcase(OP_MULFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          setfltvalue(ra, luai_nummul(L, fltvalue(rb), fltvalue(rc)));
+        }
+        else { quicken(ci, OP_MUL); goto l_mul; }
+        vmbreak;
+      }
+      vmcase(OP_EQII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          if ((ivalue(rb) == ivalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+        }
+        else { quicken(ci, OP_EQ); goto l_eq; }
+        vmbreak;
+      }
+      vmcase(OP_EQFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          if (luai_numeq(fltvalue(rb), fltvalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+        }
+        else { quicken(ci, OP_EQ); goto l_eq; }
+        vmbreak;
+      }
+      vmcase(OP_LTII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          if ((ivalue(rb) < ivalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+        }
+        else { quicken(ci, OP_LT); goto l_lt; }
+        vmbreak;
+      }
+      vmcase(OP_LTFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          if (luai_numlt(fltvalue(rb), fltvalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+        }
+        else { quicken(ci, OP_LT); goto l_lt; }
+        vmbreak;
+      }
+      vmcase(OP_LEII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          if ((ivalue(rb) <= ivalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+        }
+        else { quicken(ci, OP_LE); goto l_le; }
+        vmbreak;
+      }
+      vmcase(OP_LEFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          if (luai_numle(fltvalue(rb), fltvalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+        }
+        else { quicken(ci, OP_LE); goto l_le; }
+        vmbreak;
+      }
+      vmcase(OP_EQK) {
+        TValue *rb = RKB(i);
+        TValue *rc = k + INDEXK(GETARG_C(i));
+        if (eqk(rb, rc) != GETARG_A(i))
+          ci->u.l.savedpc++;
+        else
+          donextjump(ci);
+        vmbreak;
+      }
+      vmcase(OP_LOADK2) {
+        setobj2s(L, ra, k + GETARG_Bx(i));
+        dofused(OP_LOADK, l_loadk);
+      }
+      vmcase(OP_GETTABUP2) {
+        TValue *upval = cl->upvals[GETARG_B(i)]->v;
+        TValue *rc = RKC(i);
+        gettableProtected(L, upval, rc, ra);
+        dofused(OP_GETTABLE, l_gettable);
+      }
+      vmcase(OP_GETTABLE2) {
+        StkId rb = RB(i);
+        TValue *rc = RKC(i);
+        gettableProtected(L, rb, rc, ra);
+        dofused(OP_GETTABLE, l_gettable);
+      }
     }
   }
 }
@@ -0,0 +1,93 @@
+--[[
+  VM dispatch benchmark: instructions per second on a few standard workloads.
+
+  usage:  lua dispatch.lua [scale]
+
+  Each workload first runs under a count hook to learn how many VM
+  instructions it executes (not timed), then runs three more times
+  without any hook; the best time is reported. Build the interpreter
+  with and without LUA_USE_JUMPTABLE (e.g. -DLUA_USE_JUMPTABLE=0) and
+  compare the "Minstr/s" column.
+]]
+
+local scale = tonumber(arg and arg[1]) or 1
+local clock = os.clock
+
+local workloads = {}
+
+workloads[#workloads + 1] = {"fib", function(n)
+  local function fib(x) if x < 2 then return x end return fib(x - 1) + fib(x - 2) end
+  return fib(27 + n)
+end}
+
+workloads[#workloads + 1] = {"loops", function(n)
+  local s = 0
+  for i = 1, 10000000 * n do
+    if i % 3 == 0 then s = s + i elseif i % 5 == 0 then s = s - 1 else s = s ~ i end
+  end
+  return s
+end}
+
+workloads[#workloads + 1] = {"float", function(n)
+  local x, y = 0.0, 1.0
+  for i = 1, 5000000 * n do
+    x = x * 0.5 + y * 1.5
+    y = y - x / 3.0
+  end
+  return x + y
+end}
+
+workloads[#workloads + 1] = {"tables", function(n)
+  local t = {}
+  for i = 1, 1000000 * n do t[i] = i end
+  local s = 0
+  for r = 1, 5 do
+    for i = 1, #t do s = s + t[i] end
+  end
+  return s
+end}
+
+workloads[#workloads + 1] = {"methods", function(n)
+  local Point = {}
+  Point.__index = Point
+  function Point.new(x, y) return setmetatable({x = x, y = y}, Point) end
+  function Point:add(o) self.x = self.x + o.x; self.y = self.y + o.y end
+  local p, d = Point.new(0, 0), Point.new(1, 2)
+  for i = 1, 3000000 * n do p:add(d) end
+  return p.x + p.y
+end}
+
+workloads[#workloads + 1] = {"strings", function(n)
+  local parts = {}
+  for i = 1, 300000 * n do
+    parts[#parts + 1] = ("item" .. i):sub(2, -2)
+  end
+  return #table.concat(parts, ",")
+end}
+
+local function count(f)
+  local c = 0
+  local step = 1000
+  debug.sethook(function() c = c + step end, "", step)
+  f(scale)
+  debug.sethook()
+  return c
+end
+
+print(string.format("%-10s %14s %10s %12s", "workload", "instructions", "seconds", "Minstr/s"))
+local totali, totalt = 0, 0
+for _, w in ipairs(workloads) do
+  local name, f = w[1], w[2]
+  local ninstr = count(f)
+  local t = math.huge
+  for _ = 1, 3 do
+    collectgarbage()
+    local t0 = clock()
+    f(scale)
+    t = math.min(t, clock() - t0)
+  end
+  totali, totalt = totali + ninstr, totalt + t
+  print(string.format("%-10s %14d %10.3f %12.1f", name, ninstr, t, ninstr / t / 1e6))
+end
+print(string.format("%-10s %14d %10.3f %12.1f", "total", totali, totalt,
+                    totali / totalt / 1e6))
@@ -0,0 +1,73 @@
+--[[
+  String hash benchmark: short identifier keys and long JSON-blob keys.
+
+  usage:  lua hash.lua [scale]
+
+  Each workload runs three times; the best time is reported. Build the
+  interpreter with and without LUA_USE_FULLHASH and compare the times.
+  The JSON blobs differ only in a few bytes in the middle, which the
+  sampling hash (one byte in every (len >> 5) + 1) mostly skips.
+]]
+
+local scale = tonumber(arg and arg[1]) or 1
+local clock = os.clock
+
+local workloads = {}
+
+-- building identifiers interns them: one hash per concatenation
+workloads[#workloads + 1] = {"idents", function(n)
+  local t = {}
+  local c = 0
+  for i = 1, 2000000 * n do
+    local k = "field_" .. (i % 5000)
+    local v = t[k]
+    if v then c = c + v else t[k] = 1 end
+  end
+  return c
+end}
+
+-- fields and methods with constant keys (hashed once, when loaded)
+workloads[#workloads + 1] = {"fields", function(n)
+  local p = {x = 0, y = 0, name = "p", count = 0}
+  for _ = 1, 5000000 * n do
+    p.x = p.x + 1; p.y = p.x + p.y; p.count = p.count + 1
+  end
+  return p.count
+end}
+
+local function blob (i, pad)
+  return '{"type":"event","source":"' .. pad .. '","id":"' ..
+         string.format("%08d", i) .. '","payload":"' .. pad .. '"}'
+end
+
+-- long keys: each lookup hashes a fresh copy of the key
+local function jsonkeys (n, padlen)
+  local pad = string.rep("abcdefghij", padlen // 10)
+  local nkeys = 2000
+  local t = {}
+  for i = 1, nkeys do t[blob(i, pad)] = i end
+  local s = 0
+  for r = 1, 20 * n do
+    for i = 1, nkeys do s = s + t[blob(i, pad)] end
+  end
+  return s
+end
+
+workloads[#workloads + 1] = {"json300", function(n) return jsonkeys(n, 150) end}
+workloads[#workloads + 1] = {"json2k", function(n) return jsonkeys(n, 1000) end}
+
+print(string.format("%-10s %10s", "workload", "seconds"))
+local total = 0
+for _, w in ipairs(workloads) do
+  local name, f = w[1], w[2]
+  local t = math.huge
+  for _ = 1, 3 do
+    collectgarbage()
+    local t0 = clock()
+    f(scale)
+    t = math.min(t, clock() - t0)
+  end
+  total = total + t
+  print(string.format("%-10s %10.3f", name, t))
+end
+print(string.format("%-10s %10.3f", "total", total))
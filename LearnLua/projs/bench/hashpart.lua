@@ -0,0 +1,116 @@
+--[[
+  Hash part benchmark: lookup-heavy and insert-heavy table workloads.
+
+  usage:  lua hashpart.lua [scale]
+
+  Each workload runs three times; the best time is reported. Build the
+  interpreter with and without LUA_USE_SWISSTABLE and compare the times.
+  Keys are chosen to stay out of the array part: strings, sparse
+  integers, floats and tables.
+]]
+
+local scale = tonumber(arg and arg[1]) or 1
+local clock = os.clock
+
+local workloads = {}
+
+local function strkeys (n)
+  local ks = {}
+  for i = 1, n do ks[i] = "key" .. i end
+  return ks
+end
+
+-- lookups of present string keys in a large table (cache misses)
+workloads[#workloads + 1] = {"get-str", function(n)
+  local ks = strkeys(200000)
+  local t = {}
+  for i = 1, #ks do t[ks[i]] = i end
+  local s = 0
+  for _ = 1, 10 * n do
+    for i = 1, #ks do s = s + t[ks[i]] end
+  end
+  return s
+end}
+
+-- lookups of sparse integer keys, half of them absent
+workloads[#workloads + 1] = {"get-int", function(n)
+  local t = {}
+  for i = 1, 100000 do t[i * 16] = i end
+  local s = 0
+  for _ = 1, 10 * n do
+    for i = 1, 200000 do
+      local v = t[i * 8]
+      if v then s = s + v end
+    end
+  end
+  return s
+end}
+
+-- small tables: field lookups that mostly hit a single group
+workloads[#workloads + 1] = {"get-small", function(n)
+  local objs = {}
+  for i = 1, 1000 do
+    objs[i] = {[1.5] = i, [true] = i, [objs] = i, k1 = i, k2 = i, k3 = i}
+  end
+  local s = 0
+  for _ = 1, 5000 * n do
+    for i = 1, #objs do
+      local o = objs[i]
+      s = s + o[1.5] + o[true] + o[objs] + o.k3
+    end
+  end
+  return s
+end}
+
+-- building large tables from scratch (rehashes included)
+workloads[#workloads + 1] = {"ins-str", function(n)
+  local ks = strkeys(200000)
+  local c = 0
+  for _ = 1, 5 * n do
+    local t = {}
+    for i = 1, #ks do t[ks[i]] = i end
+    c = c + 1
+  end
+  return c
+end}
+
+workloads[#workloads + 1] = {"ins-obj", function(n)
+  local objs = {}
+  for i = 1, 200000 do objs[i] = {} end
+  local c = 0
+  for _ = 1, 5 * n do
+    local t = {}
+    for i = 1, #objs do t[objs[i]] = i end
+    c = c + 1
+  end
+  return c
+end}
+
+-- a cache with a bounded number of live keys: insert, hit, evict
+workloads[#workloads + 1] = {"churn", function(n)
+  local t = {}
+  local s = 0
+  for i = 1, 2000000 * n do
+    local k = i * 7.25
+    t[k] = i
+    s = s + (t[(i - 3) * 7.25] or 0)
+    t[(i - 1000) * 7.25] = nil
+  end
+  return s
+end}
+
+print(string.format("%-10s %10s", "workload", "seconds"))
+local total = 0
+for _, w in ipairs(workloads) do
+  local name, f = w[1], w[2]
+  local t = math.huge
+  for _ = 1, 3 do
+    collectgarbage()
+    local t0 = clock()
+    f(scale)
+    t = math.min(t, clock() - t0)
+  end
+  total = total + t
+  print(string.format("%-10s %10.3f", name, t))
+end
+print(string.format("%-10s %10.3f", "total", total))
@@ -0,0 +1,71 @@
+--[[
+  Baseline compiler benchmark: small "handler" functions called many
+  times (each one is compiled after LUAI_JITCALLS calls).
+
+  usage:  lua jit.lua [scale]
+
+  Each workload runs three times; the best time is reported. Build the
+  interpreter with and without LUA_USE_JIT and compare the times.
+]]
+
+local scale = tonumber(arg and arg[1]) or 1
+local clock = os.clock
+
+local workloads = {}
+
+workloads[#workloads + 1] = {"sum", function(n)
+  local function handler(req)
+    local s = 0
+    for i = 1, #req do s = s + req[i] * 2 end
+    if s > 100 then s = s - 1 else s = s + 1 end
+    return s
+  end
+  local req = {1, 2, 3, 4, 5, 6, 7, 8}
+  local acc = 0
+  for _ = 1, 1000000 * n do acc = acc + handler(req) end
+  return acc
+end}
+
+workloads[#workloads + 1] = {"intloop", function(n)
+  local function handler(k)
+    local a, b = 0, 1
+    for _ = 1, k do a, b = b, (a + b) & 0xffff end
+    return a
+  end
+  local acc = 0
+  for i = 1, 100000 * n do acc = acc ~ handler(50 + i % 7) end
+  return acc
+end}
+
+workloads[#workloads + 1] = {"fields", function(n)
+  local function handler(p, d)
+    p.x = p.x + d.x
+    p.y = p.y + d.y
+    return p.x < p.y
+  end
+  local p, d = {x = 0, y = 0}, {x = 1, y = 2}
+  local c = 0
+  for _ = 1, 2000000 * n do if handler(p, d) then c = c + 1 end end
+  return c
+end}
+
+workloads[#workloads + 1] = {"fib", function(n)
+  local function fib(x) if x < 2 then return x end return fib(x - 1) + fib(x - 2) end
+  return fib(27 + n)
+end}
+
+print(string.format("%-10s %10s", "workload", "seconds"))
+local total = 0
+for _, w in ipairs(workloads) do
+  local name, f = w[1], w[2]
+  local t = math.huge
+  for _ = 1, 3 do
+    collectgarbage()
+    local t0 = clock()
+    f(scale)
+    t = math.min(t, clock() - t0)
+  end
+  total = total + t
+  print(string.format("%-10s %10.3f", name, t))
+end
+print(string.format("%-10s %10.3f", "total", total))